@@ -0,0 +1,141 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadBufferAllocMgr.h
+ */
+
+#ifndef XPADBUFFERALLOCMGR_H_
+#define XPADBUFFERALLOCMGR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "lima/HwBufferMgr.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class XpadBufferAllocMgr
+ * \brief Frame buffer allocator for the Xpad buffer ring
+ *
+ * All the buffers live in a single mapping: anonymous memory
+ * (optionally backed by hugepages), a caller-provided memory region
+ * or a POSIX shared memory segment that other processes on the host
+ * can map to read the frames without copy. The buffers can be locked
+ * in RAM and pre-faulted on a given NUMA node before the acquisition
+ * so that the first pass through the ring does not trigger page faults.
+ *******************************************************************/
+class XpadBufferAllocMgr : public BufferAllocMgr {
+DEB_CLASS_NAMESPC(DebModCamera, "XpadBufferAllocMgr", "Xpad");
+
+public:
+	enum Mode {
+		Anonymous,	///< private anonymous memory
+		External,	///< memory region provided by the caller
+		SharedMemory	///< POSIX shared memory segment
+	};
+
+	/// Header at the start of a shared memory segment, the buffers
+	/// follow at header_size, buffer_size bytes apart. Frame n is in
+	/// buffer n % nb_buffers.
+	struct ShmHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t header_size;
+		uint32_t nb_buffers;
+		uint64_t buffer_size;
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;
+		int32_t  last_frame;	///< last frame published to LIMA, -1 if none
+	};
+	enum { SHM_MAGIC = 0x58504144, SHM_VERSION = 1 };
+
+	XpadBufferAllocMgr();
+	virtual ~XpadBufferAllocMgr();
+
+	virtual int getMaxNbBuffers(const FrameDim& frame_dim);
+	virtual void allocBuffers(int nb_buffers, const FrameDim& frame_dim);
+	virtual const FrameDim& getFrameDim();
+	virtual void getNbBuffers(int& nb_buffers);
+	virtual void releaseBuffers();
+	virtual void *getBufferPtr(int buffer_nb);
+
+	void setExternalMemory(void *base, size_t size);
+	void setSharedMemory(const std::string& name);
+	Mode getMode() const;
+	const std::string& getSharedMemoryName() const;
+
+	//! Record the last frame published (shared memory header)
+	void setLastFrame(int frame_nb);
+
+	void setHugePages(bool flag);
+	bool getHugePages() const;
+	void setLockMemory(bool flag);
+	bool getLockMemory() const;
+
+	//! Remap if the options changed, then optionally touch every page on numa_node (-1: no binding)
+	void prepare(bool prefault, int numa_node);
+	double getPrefaultTime() const;		// ms spent in the last prefault
+	bool isHugePageBacked() const;
+
+	static int getCurrentNumaNode();
+	static bool isNumaNode(int node);	// node present on the host
+	static int getCpuNumaNode(int cpu);	// -1 if unknown
+
+private:
+	void mapBuffers();
+	void unmapBuffers();
+
+	FrameDim m_frame_dim;
+	int m_nb_buffers;
+	size_t m_buffer_size;
+	char *m_mem;
+	size_t m_mem_size;
+	char *m_map;
+	size_t m_map_size;
+	ShmHeader *m_shm_header;
+
+	Mode m_mode;
+	Mode m_map_mode;
+	void *m_ext_base;
+	size_t m_ext_size;
+	std::string m_shm_name;
+	std::string m_map_shm_name;
+
+	bool m_huge_pages;
+	bool m_lock_memory;
+	bool m_map_huge_pages;
+	bool m_map_lock_memory;
+	bool m_mapped_huge;
+	bool m_mapped_locked;
+	int m_prefault_node;
+	bool m_prefaulted;
+	double m_prefault_time;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADBUFFERALLOCMGR_H_ */
@@ -29,6 +29,8 @@
 
 #include <stdlib.h>
 #include <limits>
+#include <vector>
+#include <map>
 #include <stdarg.h>
 #include <strings.h>
 #include "lima/HwMaxImageSizeCallback.h"
@@ -37,6 +39,13 @@
 #include "imXpadInterface.h"
 #include "lima/Debug.h"
 #include "imXpadClient.h"
+#include "imXpadProcessing.h"
+#include "imXpadFrameStats.h"
+#include "imXpadSparseWriter.h"
+#include "imXpadSpillBuffer.h"
+#include "imXpadRawWriter.h"
+#include "imXpadChunkWriter.h"
+#include "imXpadFrameRing.h"
 #include <unistd.h>
 #include <sys/time.h>
 
@@ -129,10 +138,26 @@ namespace lima {
       void stopAcq();
       void waitAcqEnd();
       void setWaitAcqEndTime(unsigned int time);
+      void setArmHandshake(bool flag);
+      bool getArmHandshake();
+      double getArmLatency();
+      void setPrearm(bool flag);
+      bool getPrearm();
+      int getExposureParametersSkipped();
+      //! Ask the server for 16 bit pixels with the Bpp16S image type
+      void setWire16Bit(bool flag);
+      bool getWire16Bit();
+      int getWirePixelDepth();		// bytes per pixel of the last frame received
 
       // -- detector info object
       void getImageType(ImageType& type);
       void setImageType(ImageType type);
+      //! Bpp16S promoted to Bpp32S for the next acquisitions when a frame overflows
+      void setAdaptivePixelDepth(bool flag);
+      bool getAdaptivePixelDepth();
+      bool getPixelDepthPromoted();
+      int getAcqMaxCount();		// of the last acquisition, -1 = unknown
+      int getAcqOverflowFrames();	// 16 bit frames saturated in the last acquisition
       void getDetectorType(std::string& type);
       void getDetectorModel(std::string& model);
       void getImageSize(Size& size);
@@ -143,15 +168,215 @@ namespace lima {
       void getChipMask();
       void getChipNumber();
 
+      // -- roi object: whole modules read out, whole chips kept
+      void checkRoi(const Roi& set_roi, Roi& hw_roi);
+      void setRoi(const Roi& set_roi);
+      void getRoi(Roi& hw_roi);
+
+      // -- bin object: done by the plugin, 1, 2 or 4 in each direction
+      void checkBin(Bin& bin);
+      void setBin(const Bin& bin);
+      void getBin(Bin& bin);
+      double getBinTime();
+      //! Time of the binning (us per frame) on synthetic frames of the current size
+      double benchmarkBinning(int bin_x, int bin_y, int nb_frames);
+
       // -- Buffer control object
       HwBufferCtrlObj* getBufferCtrlObj();
       void setNbFrames(int nb_frames);
       void getNbFrames(int& nb_frames);
       void sendExposeCommand();
       int readFrameExpose(void *ptr, int frame_nb);
+      //! ptr is buffer_size bytes, the frame refused if it does not fit
+      int readFrameExpose(void *ptr, size_t buffer_size, int frame_nb);
       int getDataExposeReturn();
       int getNbHwAcquiredFrames();
 
+      // -- Buffer allocation
+      void setBufferHugePages(bool flag);
+      bool getBufferHugePages();
+      void setBufferLockMemory(bool flag);
+      bool getBufferLockMemory();
+      void setBufferPrefault(bool flag);
+      bool getBufferPrefault();
+      void setBufferNumaNode(int node);
+      int getBufferNumaNode();
+      void setBufferSharedMemory(std::string name);
+      std::string getBufferSharedMemory();
+      void setBufferExternalMemory(void *base, long long size);
+      double getBufferPrefaultTime();
+      double getFirstFrameLatency();
+
+      // -- Acquisition sequence
+      void addSequenceEntry(int nb_frames, double exp_time, double lat_time, TrigMode trig_mode);
+      void clearSequence();
+      int getSequenceLength();
+      int getSequenceNbFrames();
+      int getFrameSequenceIndex(int frame_nb);
+
+      // -- Client-side processing (image transfer flag ON)
+      void setAccNbFrames(int nb_frames);
+      int getAccNbFrames();
+      void setAccSliding(bool flag);
+      bool getAccSliding();
+      void setClientGeometricalCorrection(bool flag);
+      bool getClientGeometricalCorrection();
+      void setGeometryEdgeWidth(int nb_pixels);
+      int getGeometryEdgeWidth();
+      void setGeometryModuleGap(int nb_lines);
+      int getGeometryModuleGap();
+      void setClientFlatFieldCorrection(bool flag);
+      bool getClientFlatFieldCorrection();
+      //! Fetch a server white image (cached) for the client flat-field
+      void loadWhiteImage(std::string fileName);
+      std::string getLoadedWhiteImage();
+      void clearWhiteImageCache();
+      //! Fetch the server dead/noisy pixel mask for the client masking
+      void loadDeadNoisyMask();
+      int getNbMaskedPixels();
+      void setClientPixelMaskMode(int mode);	// 0 = off, 1 = sentinel, 2 = interpolation
+      int getClientPixelMaskMode();
+      void setPixelMaskSentinel(int value);
+      int getPixelMaskSentinel();
+      void setPileUpCorrection(bool flag);
+      bool getPileUpCorrection();
+      void setPileUpDeadTime(double dead_time_ns);
+      double getPileUpDeadTime();
+      //! One dead time per chip or per raw pixel (ns)
+      void setPileUpDeadTimes(const std::vector<double>& dead_times_ns);
+      void setPileUpScale(int scale);
+      int getPileUpScale();
+      double getPileUpTime();
+      void setProcessingThreads(int nb_threads);
+      int getProcessingThreads();
+      double getProcessingTime();
+
+      // -- Live mode (nb frames = 0)
+      void setLiveMaxFrameRate(double rate);
+      double getLiveMaxFrameRate();
+      int getLiveFramesShown();
+      int getLiveFramesSkipped();
+      int getLiveRearms();
+
+      // -- Frame publication
+      void setFramePublishBatch(int nb_frames);
+      int getFramePublishBatch();
+      void setFramePublishMaxDelay(double delay_ms);
+      double getFramePublishMaxDelay();
+
+      // -- Frame statistics, computed while decoding the frames received
+      void setFrameStatistics(bool flag);
+      bool getFrameStatistics();
+      void setFrameStatsNbRecords(int nb_records);	// size of the ring
+      int getFrameStatsNbRecords();
+      void setSaturationLevel(int level);		// counts of a saturated pixel
+      int getSaturationLevel();
+      int getLastFrameStatsNb();			// -1 = none
+      //! False if the frame is not in the ring
+      bool getFrameStats(int frame_nb, FrameStats& stats);
+
+      // -- Roi counters, computed while decoding the frames received
+      int addRoiCounter(const Roi& roi);		// returns the counter index
+      int addMaskRoiCounter(const std::vector<int32_t>& pixels, int width);
+      void clearRoiCounters();
+      int getNbRoiCounters();
+      void setRoiCountersNbRecords(int nb_records);	// size of the ring
+      int getRoiCountersNbRecords();
+      int getLastRoiCountersFrameNb();		// -1 = none
+      //! Frames still in the ring, getNbRoiCounters() + 1 values per frame (frame nb. first)
+      int readRoiCounters(int first_frame, int nb_frames, std::vector<long long>& data);
+
+      // -- Sparse output: pixels above a threshold streamed to a file
+      void setSparseOutput(bool flag);
+      bool getSparseOutput();
+      void setSparseThreshold(int threshold);
+      int getSparseThreshold();
+      void setSparseFilePrefix(const std::string& prefix);	// <prefix>_<acq. nb>.sparse
+      std::string getSparseFilePrefix();
+      std::string getSparseFileName();			// of the last acquisition
+      double getSparseCompressionRatio(int frame_nb);	// 0 = unknown
+      double getSparseMeanCompressionRatio();		// of the last acquisition
+
+      // -- Raw output: frames received streamed to disk with O_DIRECT, besides LIMA
+      void setRawOutput(bool flag);
+      bool getRawOutput();
+      void setRawFilePrefix(const std::string& prefix);	// <prefix>_<acq. nb>_<file nb>.raw
+      std::string getRawFilePrefix();
+      void setRawFileSize(long long size);		// preallocated per file (bytes)
+      long long getRawFileSize();
+      void setRawQueueFrames(int nb_frames);		// frames waiting for the writer thread
+      int getRawQueueFrames();
+      std::string getRawIndexFileName();		// of the last acquisition
+      int getRawFramesWritten();
+      int getRawFramesDropped();			// after a write error
+      int getRawMaxQueueDepth();
+      double getRawWriteRate();				// MB/s, while writing
+
+      // -- HDF5 output: frames received compressed (bitshuffle-LZ4) by the plugin, besides LIMA
+      void setHdf5Output(bool flag);
+      bool getHdf5Output();
+      void setHdf5FilePrefix(const std::string& prefix);	// <prefix>_<acq. nb>.h5
+      std::string getHdf5FilePrefix();
+      void setHdf5CompressThreads(int nb_threads);
+      int getHdf5CompressThreads();
+      void setHdf5QueueFrames(int nb_frames);		// frames waiting for compression or writing
+      int getHdf5QueueFrames();
+      std::string getHdf5FileName();			// of the last acquisition
+      int getHdf5FramesWritten();
+      int getHdf5FramesDropped();			// after a write error
+      int getHdf5MaxQueueDepth();
+      double getHdf5CompressionRatio();
+      double getHdf5CompressRate();			// MB/s of frames, per thread
+      double getHdf5WriteRate();			// MB/s of chunks, while writing
+      double getHdf5Throughput();			// MB/s of frames, whole acquisition
+
+      // -- Frame ring: frames received published in POSIX shared memory for local readers
+      void setFrameRing(const std::string& name);	// shm name, empty = off
+      std::string getFrameRing();
+      void setFrameRingNbFrames(int nb_frames);
+      int getFrameRingNbFrames();
+      int getFrameRingPublished();			// frames of the last acquisition
+
+      // -- Spill file: frames received while the LIMA buffers are full
+      void setSpillFile(const std::string& file_name);	// empty = off
+      std::string getSpillFile();
+      void setSpillNbFrames(int nb_frames);		// size of the spill file, in frames
+      int getSpillNbFrames();
+      //! the control layer calls setLastFrameReleased(), needed by the spill file
+      void setReleaseReporting(bool flag);
+      bool getReleaseReporting();
+      //! LIMA is done with the frames up to frame_nb (processed and saved), their buffers are free
+      void setLastFrameReleased(int frame_nb);
+      int getSpillDepth();				// frames waiting in the spill file
+      int getSpillMaxDepth();				// of the last acquisition
+      int getSpilledFrames();
+      int getDrainedFrames();
+      int getDiscardedFrames();			// read after LIMA stopped taking frames
+
+      // -- Scheduling of the acquisition and file ingest threads
+      void setAcqThreadCpus(const std::string& cpus);	// as taskset -c: "2", "2,3", "0-3,8"
+      std::string getAcqThreadCpus();			// empty = cpus of the process
+      void setIngestThreadCpus(const std::string& cpus);
+      std::string getIngestThreadCpus();
+      void setAcqRtPriority(int priority);		// SCHED_FIFO priority, 0 = normal scheduling
+      int getAcqRtPriority();
+      void setReceiveBusyPoll(int usec);		// socket busy poll of the frame reads, 0 = off
+      int getReceiveBusyPoll();
+      //! Interval between the frames received in the last acquisition (us)
+      int getFrameIntervalNb();
+      double getFrameIntervalMean();
+      double getFrameIntervalStdDev();
+      double getFrameIntervalMax();
+
+      // -- File transfer mode (image transfer flag OFF)
+      int readFrameFile(void *ptr, int frame_nb);
+      void setFileIngestThreads(int nb_threads);
+      int getFileIngestThreads();
+      void setFileIngestWindow(int nb_frames);
+      int getFileIngestWindow();
+      int getFileIngestWindowOccupancy();
+      int getFileIngestMaxWindowOccupancy();
+
       //-- Synch control object
       void setTrigMode(TrigMode mode);
       void getTrigMode(TrigMode& mode);
@@ -381,6 +606,93 @@ namespace lima {
       AcqThread               *m_acq_thread;
       XpadStatus::XpadState   m_state;
 
+      //---------------------------------
+      //- File ingest pool (image transfer flag OFF)
+      class                   FileIngestThread;
+      std::vector<FileIngestThread*> m_ingest_threads;
+      mutable Cond            m_ingest_cond;
+      int                     m_ingest_window;
+      bool                    m_ingest_active;
+      bool                    m_ingest_failed;	// a file could not be read
+      bool                    m_ingest_exit;
+      int                     m_ingest_running;
+      int                     m_ingest_busy;
+      int                     m_ingest_next_frame;
+      int                     m_ingest_publish_frame;
+      int                     m_ingest_occupancy;
+      int                     m_ingest_max_occupancy;
+      std::vector<int>        m_ingest_slots;
+
+      void startFileIngest();
+      void stopFileIngest();
+      bool waitIngestedFrame(int frame_nb);
+      void stopFileIngestThreads();
+
+      //---------------------------------
+      //- Raw output
+      bool                    m_raw_output;
+      RawWriter               m_raw_writer;
+
+      void writeRawFrame(const void *frame);
+
+      //---------------------------------
+      //- HDF5 output
+      bool                    m_hdf5_output;
+      ChunkWriter             m_chunk_writer;
+
+      void writeChunkFrame(const void *frame);
+
+      //---------------------------------
+      //- Frame ring
+      FrameRing               m_frame_ring;
+      std::string             m_frame_ring_name;
+      int                     m_frame_ring_nb_frames;
+
+      //! the frame just read by readFrameExpose(), under its received frame nb.
+      void publishRingFrame(const void *frame);
+
+      //---------------------------------
+      //- Spill file
+      SpillBuffer             m_spill;
+      std::string             m_spill_file;
+      int                     m_spill_nb_frames;
+      bool                    m_spill_active;
+      bool                    m_spill_write;
+      int                     m_spill_buffer_frames;
+      int                     m_last_frame_released;
+      int                     m_last_frame_published;	// handed to LIMA
+      bool                    m_release_reporting;
+      int                     m_spill_max_depth;
+      int                     m_spilled_frames;
+      int                     m_drained_frames;
+      int                     m_discarded_frames;
+      std::vector<char>       m_discard_frame;
+
+      bool isLimaBufferFree(int frame_nb);
+      void *getReceiveBuffer(int frame_nb);
+      bool commitReceivedFrame(int frame_nb);
+      bool drainSpill(int nb_wait);
+      void discardFrames();
+
+      //---------------------------------
+      //- Thread scheduling
+      pid_t                   m_acq_tid;
+      std::vector<pid_t>      m_ingest_tids;
+      std::string             m_acq_thread_cpus;
+      std::string             m_ingest_thread_cpus;
+      int                     m_acq_rt_priority;
+      int                     m_receive_busy_poll;
+      Timestamp               m_frame_interval_ts;
+      int                     m_frame_interval_nb;
+      double                  m_frame_interval_sum;
+      double                  m_frame_interval_sum2;
+      double                  m_frame_interval_max;
+
+      //! tid 0: the settings are checked only; returns the NUMA node of
+      //! the cpus, -1 if they are on several nodes or it is unknown
+      int setThreadScheduling(pid_t tid, const std::string& cpus, int rt_priority);
+      void recordFrameInterval();
+
       //---------------------------------
       //- XPAD stuff
       unsigned int	    	    m_module_mask;
@@ -409,8 +721,144 @@ namespace lima {
       int                     m_burstNumber;
       unsigned int			m_stack_images;
 
+      //---------------------------------
+      //- Buffer allocation
+      bool                    m_buffer_prefault;
+      int                     m_buffer_numa_node;
+      int                     m_acq_numa_node;
+      Timestamp               m_expose_timestamp;
+      double                  m_first_frame_latency;
+
+      //---------------------------------
+      //- Frame publication
+      int                     m_publish_batch;
+      double                  m_publish_max_delay;
+      int                     m_publish_batch_size;
+      Timestamp               m_publish_start_ts;
+      Timestamp               m_publish_batch_ts;
+      std::vector<HwFrameInfoType> m_publish_pending;
+
+      int getNbBufferFrames();
+      void startFramePublish();
+      //! timestamp: reception of the frame, now if not set
+      bool publishFrame(int frame_nb, const Timestamp& timestamp = Timestamp());
+      bool flushFrames();
+      //! flushes the pending frames if no frame comes before their max. delay
+      bool flushFramesIfIdle();
+
+      //---------------------------------
+      //- Live mode
+      #define LIVE_SEGMENT_FRAMES         9999
+
+      double                  m_live_max_frame_rate;
+      int                     m_live_frames_skipped;
+      int                     m_live_rearms;
+      Timestamp               m_live_last_shown;
+      int                     m_live_segment_frames;
+      bool                    m_live_buffer_free;
+
+      bool rearmLive();
+      void startLiveSegment();
+      bool isLiveFrameShown();
+      bool isSegmentEnd();
+
+      //---------------------------------
+      //- Arm/end of acquisition handshake
+      #define STATE_POLL_PERIOD           500
+
+      Mutex                   m_xpad_alt_lock;
+      bool                    m_arm_handshake;
+      double                  m_arm_latency;
+
+      bool readDetectorState(XpadStatus::XpadState& state);
+      bool waitDetectorState(XpadStatus::XpadState state, unsigned int timeout_usec);
+
+      //---------------------------------
+      //- Exposure parameters last applied on the server
+      std::string             m_exposure_params;
+      bool                    m_prearm;
+      int                     m_exposure_params_skipped;
+
+      std::string getExposureParameters(int nb_frames, unsigned int exp_time_usec,
+                                        unsigned int lat_time_usec, unsigned int xpad_trigger_mode);
+      unsigned int getXpadTrigMode(TrigMode mode);
+
+      //---------------------------------
+      //- Acquisition sequence
+      struct SequenceEntry {
+        int                   nb_frames;
+        unsigned int          exp_time_usec;
+        unsigned int          lat_time_usec;
+        unsigned int          xpad_trigger_mode;
+      };
+      std::vector<SequenceEntry> m_sequence;
+      std::vector<int>        m_sequence_ends;
+      std::vector<SequenceEntry> m_acq_sequence;	// copied by prepareAcq()
+      std::vector<int>        m_acq_sequence_ends;
+      int                     m_sequence_entry;
+      int                     m_segment_end;
+
+      bool rearmSequence();
+      void checkSequenceChange();
+
+      //---------------------------------
+      //- Client-side processing
+      Processing              m_processing;
+      std::vector<int32_t>    m_raw_frame;
+      bool                    m_float_output;		// Bpp32F frames, filled by m_processing
+      std::map<std::string, std::vector<int32_t> > m_white_cache;	// by name and module mask
+      std::string             m_white_image;
+
+      //---------------------------------
+      //- Hardware roi
+      Roi                     m_roi;
+      unsigned int            m_roi_module_mask;	// modules read out, 0 = m_module_mask
+
+      void mapRoi(const Roi& set_roi, Roi& hw_roi, int& first_module, int& last_module);
+      void sendModuleMask(unsigned int module_mask);
+
+      //---------------------------------
+      //- 16 bit transfer
+      bool                    m_wire_16bit;
+      bool                    m_wire_16bit_supported;	// not refused by the server
+
+      bool isWire16Bit();
+      //! prearmed: sent on the alternate connection, not to be cached
+      int sendExposureParameters(const std::string& cmd, bool& prearmed);
+
+      //---------------------------------
+      //- Adaptive pixel depth
+      bool                    m_adaptive_pixel_depth;
+      bool                    m_pixel_depth_promoted;
+      bool                    m_pixel_depth_change;	// decided by the last acquisition
+      int                     m_acq_max_count;
+      int                     m_acq_overflow_frames;
+
+      void updatePixelDepth();
+      void applyPixelDepthChange();
+
+      //---------------------------------
+      //- Frame statistics
+      bool                    m_frame_statistics;
+      FrameStatsCalc          m_stats_calc;
+      FrameStatsRing          m_stats_ring;
+      FrameStats              m_frame_stats;		// of the frame being read (acq. thread)
+      RoiCounters             m_roi_counters;
+      int                     m_frames_received;	// roi counter and frame ring frame nb., live frames not shown included
+
+      bool                    m_sparse_output;
+      SparseWriter            m_sparse_writer;
+
+      bool isDecodeStatsActive();
+      void storeFrameStats(const FrameStats& stats, int counter_frame_nb);
+
+      bool isProcessingFrames();
+      void getRawImageSize(Size& size);
+      void checkProcessingChange(bool frame_size = false);
+      void updateImageSize();
+
       // Buffer control object
-      SoftBufferCtrlObj m_bufferCtrlObj;
+      BufferCtrlObj m_bufferCtrlObj;
     };
 
   } // namespace imXpad
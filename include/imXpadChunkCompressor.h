@@ -0,0 +1,70 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadChunkCompressor.h
+ */
+
+
+#ifndef XPADCHUNKCOMPRESSOR_H_
+#define XPADCHUNKCOMPRESSOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class ChunkCompressor
+ * \brief Bitshuffle-LZ4 compression of a frame into an HDF5 chunk
+ *
+ * The chunk is the one the bitshuffle HDF5 filter (id 32008, LZ4)
+ * reads back: uint64 big-endian size, uint32 big-endian block size
+ * (bytes), then per block of elements a uint32 big-endian compressed
+ * size and the LZ4 block of its bit-transposed elements; the last
+ * elements (size % 8) are copied as they are.
+ * An instance holds the work buffers: one per thread.
+ *******************************************************************/
+class ChunkCompressor {
+public:
+	enum { FilterId = 32008, Lz4 = 2 };
+
+	ChunkCompressor();
+
+	static size_t getBlockSize(int elem_size);	// elements, bitshuffle default
+	static size_t getMaxChunkSize(size_t nb_elems, int elem_size);
+	//! Returns the chunk size, dst of getMaxChunkSize() bytes
+	size_t compress(const void *src, size_t nb_elems, int elem_size, void *dst);
+
+private:
+	size_t compressBlock(const char *src, size_t nb_elems, int elem_size, char *dst);
+
+	std::vector<char> m_planes;
+	std::vector<char> m_bits;
+	std::vector<uint16_t> m_hash;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADCHUNKCOMPRESSOR_H_ */
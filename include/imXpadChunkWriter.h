@@ -0,0 +1,144 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadChunkWriter.h
+ */
+
+
+#ifndef XPADCHUNKWRITER_H_
+#define XPADCHUNKWRITER_H_
+
+#include <string>
+#include <vector>
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+#include "lima/Timestamp.h"
+#include "lima/Debug.h"
+#include "imXpadChunkCompressor.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class ChunkWriter
+ * \brief Compresses the frames received and writes them to HDF5
+ *
+ * The frames are copied to a queue, compressed by a pool of threads
+ * into bitshuffle-LZ4 chunks (see ChunkCompressor) and written in the
+ * order received by a writer thread with the HDF5 direct chunk write,
+ * bypassing the HDF5 filter pipeline:
+ *   <prefix>_<acq. nb>.h5, dataset /entry/data/data
+ *   (frames x height x width, one chunk per frame, filter 32008)
+ * Needs the plugin built with HDF5 (IMXPAD_ENABLE_HDF5).
+ *******************************************************************/
+class ChunkWriter {
+DEB_CLASS_NAMESPC(DebModCamera, "ChunkWriter", "Xpad");
+
+public:
+	ChunkWriter();
+	~ChunkWriter();
+
+	static bool isAvailable();		// built with HDF5
+
+	void setFilePrefix(const std::string& prefix);
+	const std::string& getFilePrefix();
+	void setNbThreads(int nb_threads);	// compression threads
+	int getNbThreads();
+	void setQueueFrames(int nb_frames);
+	int getQueueFrames();
+
+	//! Start of an acquisition: next file
+	void open(const FrameDim& frame_dim);
+	//! Copy the frame to the queue, waits for a free slot
+	void put(const void *frame);
+	//! Wait for the queue written, close the file
+	void close();
+	bool isOpen();
+
+	const std::string& getFileName();	// of the last acquisition
+	int getNbFramesWritten();
+	int getNbFramesDropped();		// after a write error
+	int getMaxQueueDepth();
+	double getCompressionRatio();		// frame bytes / chunk bytes
+	double getCompressRate();		// MB/s of frames, per compression thread
+	double getWriteRate();			// MB/s of chunks, while writing
+	double getThroughput();			// MB/s of frames, first put to last written
+
+private:
+	class CompressThread;
+	class WriterThread;
+	struct H5File;
+
+	enum SlotState { Free, Filled, Compressing, Compressed };
+
+	void startThreads();
+	void stopThreads();
+	void allocQueue();
+	void openFile();
+	bool writeChunk(int frame_nb, const char *chunk, size_t size);
+	void closeFile();
+	int getSlotToCompress();
+	void compressSlot(int slot, ChunkCompressor& compressor);
+	void writeSlot();
+
+	Cond m_cond;
+	std::vector<CompressThread *> m_threads;
+	WriterThread *m_writer_thread;
+	int m_nb_running;
+	bool m_thread_exit;
+
+	std::string m_prefix;
+	std::string m_file_name;
+	int m_nb_threads;
+	int m_queue_frames;
+	int m_acq_nb;
+	bool m_open;
+	bool m_failed;
+	H5File *m_h5;
+
+	FrameDim m_frame_dim;
+	size_t m_frame_size;
+	size_t m_chunk_max_size;
+	std::vector<char> m_frames;
+	std::vector<char> m_chunks;
+	std::vector<SlotState> m_states;
+	std::vector<size_t> m_chunk_sizes;
+	int m_head;
+	int m_depth;
+
+	int m_write_frame_nb;
+	int m_nb_written;
+	int m_nb_dropped;
+	int m_max_depth;
+	long long m_frame_bytes;	// of the frames compressed
+	long long m_chunk_bytes;
+	long long m_written_bytes;
+	double m_compress_time;		// summed over the threads (s)
+	double m_write_time;
+	Timestamp m_first_put;
+	Timestamp m_last_written;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADCHUNKWRITER_H_ */
@@ -29,7 +29,10 @@
 #define XPADCLIENT_CPP_
 
 #include <netinet/in.h>
+#include <stdint.h>
+#include <vector>
 #include "lima/Debug.h"
+#include "imXpadFrameStats.h"
 #include <fstream>
 #include <arpa/inet.h>
 
@@ -58,8 +61,17 @@ public:
     //void getData(void* bptr, unsigned short xpad_format);
     int sendParametersFile(const char* filePath);
     int receiveParametersFile(const char* filePath);
+    //! -1 if the server does not send expected_size bytes
+    int receiveData(std::vector<char>& data, uint32_t expected_size);
     void sendExposeCommand();
-    int getDataExpose(void* bptr, unsigned short xpadFormat);
+    //! stats_calc adds the frame to stats if both are not NULL, -1 if the
+    //! frame is not exactly buffer_size bytes once converted to xpadFormat
+    int getDataExpose(void* bptr, size_t buffer_size, unsigned short xpadFormat,
+                      const FrameStatsCalc *stats_calc = NULL, FrameStats *stats = NULL);
+    int getRawDataExpose(std::vector<int32_t>& data, int& width, int& height);
+    int getWirePixelDepth();		// bytes per pixel of the last frame
+    int setBusyPoll(int usec);		// SO_BUSY_POLL of the socket, 0 = off
+    int waitData(int timeout_ms);	// 1 data to read, 0 timeout, -1 error
     void getExposeCommandReturn(int &value);
 	std::string getErrorMessage() const;
 	std::vector<std::string> getDebugMessages() const;
@@ -79,6 +91,9 @@ private:
 	int m_just_read;
 	std::string m_errorMessage;
 	std::vector<std::string> m_debugMessages;
+	std::vector<int32_t> m_raw_data;
+	std::vector<int16_t> m_raw_data16;
+	int m_wire_pixel_depth;
 
 	enum ServerResponse {
 		CLN_NEXT_PROMPT,		// '> ': at prompt
@@ -91,6 +106,11 @@ private:
 		CLN_NEXT_STRRET			// '* ': read string ret value
 	};
 	void sendCmd(const std::string cmd);
+	int readFrameHeader(uint32_t& data_size, int& width, int& height);
+	int readFramePayload(void *buff, uint32_t data_size);
+	int refuseFramePayload(uint32_t data_size, const std::string& errmsg);	// always -1
+	int readData(void *buff, size_t size);	// -1 on error or closed connection
+	int discardData(size_t size);		// reads and drops size bytes
 	int waitForResponse(std::string& value);
 	int waitForResponse(double& value);
 	int waitForResponse(int& value);
@@ -0,0 +1,159 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadFrameRing.h
+ */
+
+
+#ifndef XPADFRAMERING_H_
+#define XPADFRAMERING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "lima/SizeUtils.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \struct FrameRingHeader
+ * \brief Header at the start of a frame ring shared memory segment
+ *
+ * Followed at 64 bytes by nb_slots FrameSlotHeader, the frames start
+ * at header_size, slot_size bytes apart. Frame n is in slot
+ * n % nb_slots. A segment retired by the plugin (geometry changed or
+ * ring closed) gets a zero magic: readers map the name again.
+ *******************************************************************/
+struct FrameRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t nb_slots;
+	uint64_t slot_size;
+	uint32_t slot_header_size;
+	uint32_t acq_nb;		///< incremented at each acquisition start
+	int32_t  last_frame;		///< last frame published this acquisition, -1 if none
+	uint32_t reserved[7];
+};
+
+/*******************************************************************
+ * \struct FrameSlotHeader
+ * \brief Seqlock header of a frame slot
+ *
+ * seq is odd while the slot is written: a reader reads seq (even),
+ * then the header and the frame, then seq again; the frame is valid
+ * if seq did not change.
+ *******************************************************************/
+struct FrameSlotHeader {
+	uint32_t seq;
+	int32_t  frame_nb;		///< received frame nb., the LIMA one but in live mode
+	uint32_t acq_nb;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;			///< bytes per pixel
+	uint32_t image_type;		///< LIMA ImageType
+	uint32_t reserved;
+	uint64_t data_size;
+	double   timestamp;		///< s since the acquisition start
+	char     pad[16];
+};
+
+/*******************************************************************
+ * \class FrameRing
+ * \brief Publishes the frames received in a POSIX shared memory ring
+ *
+ * Written by the acquisition thread only, which never waits for the
+ * readers: a frame not read in time is overwritten.
+ *******************************************************************/
+class FrameRing {
+DEB_CLASS_NAMESPC(DebModCamera, "FrameRing", "Xpad");
+
+public:
+	enum { MAGIC = 0x58504652, VERSION = 1 };
+
+	FrameRing();
+	~FrameRing();
+
+	//! Start of an acquisition, the segment is kept if the geometry is unchanged
+	void open(const std::string& name, const FrameDim& frame_dim, int nb_frames);
+	//! Retire and unlink the segment
+	void close();
+	bool isOpen() const;
+
+	void publish(int frame_nb, const void *frame, double timestamp);
+	int getNbPublished() const;		// this acquisition
+
+private:
+	void map();
+	void unmap();
+
+	std::string m_name;
+	FrameDim m_frame_dim;
+	int m_nb_slots;
+	size_t m_slot_size;
+	char *m_map;
+	size_t m_map_size;
+	FrameRingHeader *m_header;
+	FrameSlotHeader *m_slots;
+	char *m_data;
+	int m_nb_published;
+};
+
+/*******************************************************************
+ * \class FrameRingReader
+ * \brief Maps a frame ring read-only, in the process of a consumer
+ *******************************************************************/
+class FrameRingReader {
+DEB_CLASS_NAMESPC(DebModCamera, "FrameRingReader", "Xpad");
+
+public:
+	FrameRingReader();
+	~FrameRingReader();
+
+	void open(const std::string& name);
+	void close();
+	//! The plugin has retired the segment: open it again
+	bool isStale() const;
+
+	uint32_t getAcqNb() const;
+	int getLastFrameNb() const;		// -1 = none
+
+	//! The frame in place, NULL if not in the ring; valid as long as
+	//! isValid(frame_nb, seq), to be checked after using it
+	const void *getFrame(int frame_nb, FrameSlotHeader& header, uint32_t& seq) const;
+	bool isValid(int frame_nb, uint32_t seq) const;
+	//! Copy of the frame, false if not in the ring
+	bool readFrame(int frame_nb, void *dst, size_t size, FrameSlotHeader& header) const;
+
+private:
+	std::string m_name;
+	char *m_map;
+	size_t m_map_size;
+	const FrameRingHeader *m_header;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADFRAMERING_H_ */
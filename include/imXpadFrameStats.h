@@ -0,0 +1,135 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadFrameStats.h
+ */
+
+#ifndef XPADFRAMESTATS_H_
+#define XPADFRAMESTATS_H_
+
+#include <stdint.h>
+#include <vector>
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+#include "lima/Debug.h"
+#include "imXpadRoiCounters.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \struct SparseEvent
+ * \brief A pixel above the sparse threshold
+ *******************************************************************/
+struct SparseEvent {
+	uint32_t index;				// line * width + column
+	int32_t count;
+};
+
+/*******************************************************************
+ * \struct FrameStats
+ * \brief Statistics of the pixels of a frame, as received
+ *******************************************************************/
+struct FrameStats {
+	int frame_nb;				// -1 = no frame
+	long long sum;
+	int32_t min;
+	int32_t max;
+	int nb_saturated;			// pixels at or above the saturation level
+	std::vector<long long> chip_sums;	// modules top to bottom, chips left to right,
+						// empty if the frame is not tiled by chips
+	std::vector<long long> roi_sums;	// see FrameStatsCalc::setRoiCounters
+	std::vector<SparseEvent> events;	// see FrameStatsCalc::setSparseEvents, not kept in the ring
+
+	FrameStats() { reset(); }
+	void reset(int nb = -1);
+};
+
+/*******************************************************************
+ * \class FrameStatsCalc
+ * \brief Adds the pixels of a frame to its statistics
+ *
+ * Called by the loops decoding the frames, row by row, so that the
+ * pixels are read once for both.
+ *******************************************************************/
+class FrameStatsCalc {
+DEB_CLASS_NAMESPC(DebModCamera, "FrameStatsCalc", "Xpad");
+
+public:
+	FrameStatsCalc();
+
+	void setChipSize(const Size& chip_size);
+	Size getChipSize() const;
+	void setSaturation(int32_t level);
+	int32_t getSaturation() const;
+	//! Roi sums computed in the same pass, NULL = none
+	void setRoiCounters(const RoiCounters *roi_counters);
+	//! Pixels above threshold listed in the same pass
+	void setSparseEvents(bool flag);
+	bool getSparseEvents() const;
+	void setSparseThreshold(int32_t threshold);
+	int32_t getSparseThreshold() const;
+
+	//! Add frame to stats, narrowed to 16 bit (truncated) in out16 if not NULL
+	void add(FrameStats& stats, const int32_t *frame, const Size& size, int16_t *out16 = NULL) const;
+	void add(FrameStats& stats, const int16_t *frame, const Size& size) const;
+
+private:
+	template <class T>
+	void addFrame(FrameStats& stats, const T *frame, const Size& size, int16_t *out16) const;
+
+	Size m_chip_size;
+	int32_t m_saturation;
+	const RoiCounters *m_roi_counters;
+	bool m_sparse_events;
+	int32_t m_sparse_threshold;
+};
+
+/*******************************************************************
+ * \class FrameStatsRing
+ * \brief Statistics of the last frames, by frame number
+ *******************************************************************/
+class FrameStatsRing {
+DEB_CLASS_NAMESPC(DebModCamera, "FrameStatsRing", "Xpad");
+
+public:
+	FrameStatsRing(int nb_records = 1024);
+
+	void setNbRecords(int nb_records);
+	int getNbRecords();
+	void clear();
+
+	void put(const FrameStats& stats);
+	//! False if the frame is not in the ring (not received yet or overwritten)
+	bool get(int frame_nb, FrameStats& stats);
+	int getLastFrameNb();			// -1 = none
+
+private:
+	Mutex m_lock;
+	std::vector<FrameStats> m_records;
+	int m_last_frame_nb;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADFRAMESTATS_H_ */
@@ -28,6 +28,10 @@
 #define XPADINTERFACE_H_
 
 #include "lima/HwInterface.h"
+#include "lima/HwBufferMgr.h"
+#include "lima/HwRoiCtrlObj.h"
+#include "lima/HwBinCtrlObj.h"
+#include "imXpadBufferAllocMgr.h"
 #include <sys/time.h>
 
 namespace lima {
@@ -76,7 +80,7 @@ class BufferCtrlObj : public HwBufferCtrlObj
     DEB_CLASS_NAMESPC(DebModCamera, "BufferCtrlObj", "Xpad");
 
  public:
-    BufferCtrlObj(Camera& simu);
+    BufferCtrlObj(Camera& cam);
     virtual ~BufferCtrlObj();
 
     virtual void setFrameDim(const FrameDim& frame_dim);
@@ -99,8 +103,14 @@ class BufferCtrlObj : public HwBufferCtrlObj
     virtual void registerFrameCallback(HwFrameCallback& frame_cb);
     virtual void unregisterFrameCallback(HwFrameCallback& frame_cb);
 
+    StdBufferCbMgr& getBuffer();
+    XpadBufferAllocMgr& getAllocMgr();
+
  private:
-    BufferCtrlMgr& m_buffer_mgr;
+    Camera& m_cam;
+    XpadBufferAllocMgr m_buffer_alloc_mgr;
+    StdBufferCbMgr m_buffer_cb_mgr;
+    BufferCtrlMgr m_buffer_mgr;
 };
 
 /*******************************************************************
@@ -134,6 +144,51 @@ private:
 	Camera& m_cam;
 };
 
+/*******************************************************************
+ * \class RoiCtrlObj
+ * \brief Control object providing Xpad hardware roi interface
+ *
+ * The roi is extended to whole modules, only those being read out,
+ * and to whole chips, the other columns cropped by the plugin
+ *******************************************************************/
+
+class RoiCtrlObj: public HwRoiCtrlObj {
+DEB_CLASS_NAMESPC(DebModCamera, "RoiCtrlObj", "Xpad");
+
+public:
+	RoiCtrlObj(Camera& cam);
+	virtual ~RoiCtrlObj();
+
+	virtual void checkRoi(const Roi& set_roi, Roi& hw_roi);
+	virtual void setRoi(const Roi& set_roi);
+	virtual void getRoi(Roi& hw_roi);
+
+private:
+	Camera& m_cam;
+};
+
+/*******************************************************************
+ * \class BinCtrlObj
+ * \brief Control object providing Xpad hardware binning interface
+ *
+ * The binning is done by the plugin on the frames received
+ *******************************************************************/
+
+class BinCtrlObj: public HwBinCtrlObj {
+DEB_CLASS_NAMESPC(DebModCamera, "BinCtrlObj", "Xpad");
+
+public:
+	BinCtrlObj(Camera& cam);
+	virtual ~BinCtrlObj();
+
+	virtual void setBin(const Bin& bin);
+	virtual void getBin(Bin& bin);
+	virtual void checkBin(Bin& bin);
+
+private:
+	Camera& m_cam;
+};
+
 /*******************************************************************
  * \class Interface
  * \brief Xpad hardware interface
@@ -160,6 +215,8 @@ private:
 	DetInfoCtrlObj m_det_info;
     HwBufferCtrlObj*  m_bufferCtrlObj;
     SyncCtrlObj m_sync;
+    RoiCtrlObj m_roi;
+    BinCtrlObj m_bin;
     Config* m_config;
 };
 
@@ -0,0 +1,255 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadProcessing.h
+ */
+
+#ifndef XPADPROCESSING_H_
+#define XPADPROCESSING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "lima/Constants.h"
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class Processing
+ * \brief Client-side processing of the frames received from the server
+ *
+ * The acquisition thread hands each raw frame (32 bit pixels, as sent
+ * by the server) to processFrame(), which runs the enabled stages and
+ * writes the output frame in the LIMA buffer. A stage can consume
+ * several raw frames per output frame (accumulation).
+ *******************************************************************/
+class Processing {
+DEB_CLASS_NAMESPC(DebModCamera, "Processing", "Xpad");
+
+public:
+	enum MaskMode { MaskOff, MaskSentinel, MaskInterpolate };
+
+	Processing();
+	~Processing();
+
+	//! Sum nb_frames raw frames per output frame (1 = off)
+	void setAccNbFrames(int nb_frames);
+	int getAccNbFrames();
+	//! Sliding window: an output frame per raw frame once the window is full
+	void setAccSliding(bool flag);
+	bool getAccSliding();
+	//! Raw frames the detector must acquire for nb_frames output frames
+	int getNbRawFrames(int nb_frames);
+
+	//! Geometrical correction: chip border pixels widened, gaps between modules
+	void setChipSize(const Size& chip_size);
+	void setGeometry(bool flag);
+	bool getGeometry();
+	void setGeometryEdgeWidth(int nb_pixels);	// output pixels per chip border pixel
+	int getGeometryEdgeWidth();
+	void setGeometryModuleGap(int nb_lines);	// empty lines between modules
+	int getGeometryModuleGap();
+
+	//! Flat-field: frames scaled by mean(white) / white, white image in the raw layout
+	void setWhiteImage(const std::vector<int32_t>& white, const Size& raw_size);
+	void clearWhiteImage();
+	bool hasWhiteImage();
+	void setFlatField(bool flag);		// applied from the next output frame on
+	bool getFlatField();
+
+	//! Dead/noisy pixels, raw pixel indexes: set to a sentinel or to the mean of their neighbors
+	void setPixelMask(const std::vector<int32_t>& pixels, const Size& raw_size);
+	void clearPixelMask();
+	int getNbMaskedPixels();
+	void setMaskMode(MaskMode mode);
+	MaskMode getMaskMode();
+	void setMaskSentinel(int32_t value);
+	int32_t getMaskSentinel();
+
+	//! Pile-up: non-paralyzable dead-time correction C / (1 - C * tau / exposure)
+	void setPileUp(bool flag);
+	bool getPileUp();
+	//! Dead times (s): one value, one per chip or one per raw pixel
+	void setPileUpDeadTimes(const std::vector<double>& dead_times);
+	void getPileUpDeadTimes(std::vector<double>& dead_times);
+	void setPileUpScale(int scale);		// integer frames hold scale x counts
+	int getPileUpScale();
+	void setExposureTime(double exp_time);	// of the raw frames (s)
+	double getPileUpTime();			// us per output frame, mean since reset()
+
+	//! Raw frames made of the lines of full_raw_size from first_line
+	//! (module subset), the tables above being for the full detector
+	void setRawWindow(int first_line, const Size& full_raw_size);
+	//! Sums of bin pixels, after the geometrical correction
+	void setBin(const Bin& bin);
+	Bin getBin();
+	double getBinTime();			// us per output frame, mean since reset()
+	//! Time of the bin stage (us per frame) on nb_frames synthetic raw frames
+	double benchmarkBin(const Size& raw_size, const Bin& bin, int nb_frames);
+	//! Crop of the output frames (binned), empty = none
+	void setCrop(const Roi& crop);
+	Roi getCrop();
+
+	//! Max. count of the integer output frames, found by the conversion to the output type
+	void setTrackMax(bool flag);
+	bool getTrackMax();
+	void resetMaxCount();
+	int32_t getMaxCount();			// since resetMaxCount(), INT32_MIN = no frame
+	long long getNbOverflowFrames();	// 16 bit frames saturated, since resetMaxCount()
+
+	//! Size of the output frames for raw frames of raw_size, bin and crop excluded
+	Size getOutputSize(const Size& raw_size);
+	//! Output columns of the chips and output lines of the modules, end excluded
+	void getChipLayout(const Size& raw_size, std::vector<int>& col_begin, std::vector<int>& col_end,
+			   std::vector<int>& row_begin, std::vector<int>& row_end);
+
+	//! Threads sharing the work of the parallel stages (1 = acquisition thread only)
+	void setNbThreads(int nb_threads);
+	int getNbThreads();
+
+	//! True if at least one stage is enabled
+	bool isActive();
+	//! Drop the pending state (start of an acquisition or a sequence entry)
+	void reset();
+
+	//! Process a raw frame (modified in place), true when an output frame was written in out
+	bool processFrame(int32_t *raw, const Size& raw_size, void *out, const FrameDim& out_dim);
+
+	double getProcessingTime();		// us per raw frame, mean since reset()
+
+private:
+	class WorkerThread;
+	enum Job { GeometryJob, FlatFieldJob, PileUpJob, BinJob };
+
+	Size getFullRawSize();
+	bool isMaskActive();
+	void buildMask();
+	void applyMask(int32_t *frame);
+	void accumulate(const int32_t *raw, size_t nb_pixels);
+	bool isPileUpActive();
+	int getOutputScale();
+	void buildPileUpTable();
+	void applyPileUp(const int32_t *frame);
+	void buildGeometryTable(const Size& raw_size);
+	void applyGeometry(const int32_t *frame);
+	const int32_t *applyLayout(const int32_t *frame, Size& size);
+	void buildFlatField();
+	void applyFlatField(const int32_t *frame, void *out, ImageType out_type, int32_t *max);
+	void runParallel(Job job, int nb_rows);
+	void runJob(Job job, int begin, int end);
+	void stopThreads();
+
+	Mutex m_lock;
+	Size m_raw_size;
+
+	// accumulation
+	int m_acc_nb_frames;
+	bool m_acc_sliding;
+	std::vector<int32_t> m_acc;
+	std::vector<int32_t> m_acc_window;	// last raw frames (sliding)
+	int m_acc_count;			// raw frames summed in m_acc
+	int m_acc_slot;				// oldest frame of the window
+
+	// raw window, bin, crop
+	int m_window_first_line;
+	Size m_window_full_size;		// empty = no window
+	Bin m_bin;
+	Size m_bin_size;
+	std::vector<int32_t> m_bin_frame;
+	const int32_t *m_bin_src;
+	int m_bin_src_width;
+	long long m_bin_nb_frames;
+	double m_bin_time;
+	Roi m_crop;
+	std::vector<int32_t> m_crop_frame;
+
+	// dead/noisy pixels
+	MaskMode m_mask_mode;
+	int32_t m_mask_sentinel;
+	std::vector<int32_t> m_mask_full;	// sorted pixel indexes, full detector
+	Size m_mask_full_size;
+	Size m_mask_size;			// raw size m_mask was built for
+	std::vector<int32_t> m_mask;		// sorted raw pixel indexes of the window
+	std::vector<int32_t> m_mask_neighbors;	// 4 per masked pixel, -1 = none
+
+	// pile-up
+	bool m_pileup;
+	std::vector<double> m_pileup_dead_times;
+	int m_pileup_scale;
+	double m_exp_time;
+	std::vector<float> m_pileup_table;	// tau / (acc. exposure) per raw pixel, empty = to be built
+	std::vector<int32_t> m_pileup_frame;
+	const int32_t *m_pileup_src;
+	long long m_pileup_nb_frames;
+	double m_pileup_time;
+
+	// geometrical correction
+	Size m_chip_size;
+	bool m_geometry;
+	int m_geo_edge_width;
+	int m_geo_module_gap;
+	Size m_geo_raw_size;			// raw size the table was built for
+	Size m_geo_size;
+	std::vector<int32_t> m_geo_table;	// output pixel -> raw pixel, -1 = gap
+	std::vector<int32_t> m_geo_split;	// (output pixel, width, part) of split border pixels
+	std::vector<int32_t> m_geo_frame;
+	const int32_t *m_geo_src;
+
+	// flat-field
+	bool m_flat_field;
+	std::vector<int32_t> m_white;
+	Size m_white_size;
+	std::vector<int32_t> m_flat_white;	// white image with the mask applied
+	std::vector<float> m_flat_coef;		// per output pixel, empty = to be built
+	Size m_flat_size;
+	std::vector<int32_t> m_flat_frame;	// before conversion to 16 bit
+	const int32_t *m_flat_src;
+	void *m_flat_out;
+	ImageType m_flat_type;
+
+	// output max. count
+	bool m_track_max;
+	int32_t m_max_count;
+	long long m_nb_overflow_frames;
+
+	// worker threads
+	std::vector<WorkerThread*> m_threads;
+	Cond m_thread_cond;
+	Job m_job;
+	int m_job_rows;
+	int m_job_seq;
+	int m_job_pending;
+	int m_threads_running;
+	bool m_threads_exit;
+
+	long long m_nb_raw_frames;
+	double m_processing_time;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADPROCESSING_H_ */
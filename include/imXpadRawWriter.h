@@ -0,0 +1,134 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadRawWriter.h
+ */
+
+
+#ifndef XPADRAWWRITER_H_
+#define XPADRAWWRITER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+#include "lima/Timestamp.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class RawWriter
+ * \brief Streams the frames received to disk, bypassing LIMA saving
+ *
+ * The frames are copied to a queue of aligned slots and written by a
+ * thread with O_DIRECT to preallocated files, one slot per frame:
+ *   <prefix>_<acq. nb>_<file nb>.raw
+ * with an index of the frames, little-endian:
+ *   <prefix>_<acq. nb>.idx
+ *   header: "XPADRAWI", uint32 version, width, height, bytes per pixel,
+ *           frame size, slot size (frame size rounded up to the alignment)
+ *   frame:  int32 frame nb. (order of reception), uint32 file nb.,
+ *           uint64 offset in the file, double timestamp (s)
+ *******************************************************************/
+class RawWriter {
+DEB_CLASS_NAMESPC(DebModCamera, "RawWriter", "Xpad");
+
+public:
+	enum { Alignment = 4096 };		// of the O_DIRECT buffers, sizes and offsets
+
+	RawWriter();
+	~RawWriter();
+
+	void setFilePrefix(const std::string& prefix);
+	const std::string& getFilePrefix();
+	void setFileSize(long long size);	// preallocated size of a file (bytes)
+	long long getFileSize();
+	void setQueueFrames(int nb_frames);
+	int getQueueFrames();
+
+	//! Start of an acquisition: next index and files
+	void open(const FrameDim& frame_dim);
+	//! Copy the frame to the queue, waits for a free slot
+	void put(const void *frame, double timestamp);
+	//! Wait for the queue written, release the unused preallocation
+	void close();
+	bool isOpen();
+
+	const std::string& getIndexFileName();	// of the last acquisition
+	int getNbFramesWritten();
+	int getNbFramesDropped();		// after a write error
+	int getMaxQueueDepth();
+	double getWriteRate();			// MB/s, last acquisition
+
+private:
+	class WriterThread;
+
+	void openFile(int file_nb);
+	void closeFile();
+	void writeFrames();
+	void allocQueue();
+	void freeQueue();
+
+	Cond m_cond;
+	WriterThread *m_thread;
+	bool m_thread_running;
+	bool m_thread_exit;
+
+	std::string m_prefix;
+	long long m_file_size;
+	int m_queue_frames;
+	int m_acq_nb;
+	bool m_open;
+	bool m_failed;
+
+	FrameDim m_frame_dim;
+	size_t m_frame_size;
+	size_t m_slot_size;
+	int m_file_frames;
+	char *m_queue;
+	size_t m_queue_size;
+	int m_head;
+	int m_depth;
+	std::vector<double> m_timestamps;
+
+	std::string m_index_file_name;
+	FILE *m_index;
+	int m_fd;
+	int m_file_nb;
+	int m_file_pos;			// frames in the current file
+
+	int m_write_frame_nb;
+	int m_nb_put;
+	int m_nb_written;
+	int m_nb_dropped;
+	int m_max_depth;
+	double m_write_time;		// spent in pwrite (s)
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADRAWWRITER_H_ */
@@ -0,0 +1,102 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadRoiCounters.h
+ */
+
+#ifndef XPADROICOUNTERS_H_
+#define XPADROICOUNTERS_H_
+
+#include <stdint.h>
+#include <vector>
+#include "lima/SizeUtils.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class RoiCounters
+ * \brief Sums of rectangular or masked rois, computed while decoding
+ *
+ * The rois are in the coordinates of the frames as received. Each roi
+ * is turned into spans of pixels per row when defined, addRow() is
+ * called by the decoding loop (see FrameStatsCalc) with the row still
+ * in cache. The sums of each frame are put in a ring made of records
+ * with a sequence number (seqlock): one writer per record, readers
+ * never block the writers.
+ *******************************************************************/
+class RoiCounters {
+DEB_CLASS_NAMESPC(DebModCamera, "RoiCounters", "Xpad");
+
+public:
+	enum { MaxNbRois = 64 };
+
+	RoiCounters(int nb_records = 4096);
+
+	//! Returns the index of the roi
+	int addRoi(const Roi& roi);
+	//! Pixel indexes (line * width + column) in frames of width columns
+	int addMaskRoi(const std::vector<int32_t>& pixels, int width);
+	void clearRois();
+	int getNbRois() const;
+
+	//! Sums of the rois in row of a frame of width columns added to sums
+	void addRow(int row, const int32_t *src, int width, long long *sums) const;
+	void addRow(int row, const int16_t *src, int width, long long *sums) const;
+
+	void setNbRecords(int nb_records);
+	int getNbRecords() const;
+	void clearRecords();
+	void put(int frame_nb, const long long *sums);
+	//! Frames first_frame to first_frame + nb_frames - 1 still in the ring, a row of
+	//! getNbRois() + 1 values per frame (frame nb. first), returns the number of frames
+	int read(int first_frame, int nb_frames, std::vector<long long>& data) const;
+	int getLastFrameNb() const;		// -1 = none
+
+private:
+	struct Span {
+		int roi;
+		int begin;
+		int end;			// excluded
+	};
+
+	template <class T>
+	void addSpans(int row, const T *src, int width, long long *sums) const;
+	void addSpan(int row, int roi, int begin, int end);
+	void allocRing();
+
+	int m_nb_rois;
+	std::vector<std::vector<Span> > m_row_spans;	// by row
+
+	// ring, m_nb_rois sums per record
+	int m_nb_records;
+	std::vector<long long> m_sums;
+	std::vector<int> m_frame_nbs;
+	std::vector<int> m_seqs;		// odd while the record is written
+	volatile int m_last_frame_nb;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADROICOUNTERS_H_ */
@@ -0,0 +1,88 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadSparseWriter.h
+ */
+
+#ifndef XPADSPARSEWRITER_H_
+#define XPADSPARSEWRITER_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "lima/SizeUtils.h"
+#include "lima/ThreadUtils.h"
+#include "lima/Debug.h"
+#include "imXpadFrameStats.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class SparseWriter
+ * \brief Streams the sparse events of the frames to a file
+ *
+ * A file <prefix>_<acq. nb>.sparse per acquisition, little-endian:
+ *   header: "XPADSPRS", uint32 version, width, height, dense bytes per pixel
+ *   frame:  int32 frame nb., uint32 nb. events,
+ *           nb. events x (uint32 pixel index, int32 count)
+ * The frames are written as they are received, out of order with
+ * several file ingest threads.
+ *******************************************************************/
+class SparseWriter {
+DEB_CLASS_NAMESPC(DebModCamera, "SparseWriter", "Xpad");
+
+public:
+	SparseWriter(int nb_ratios = 4096);
+	~SparseWriter();
+
+	void setFilePrefix(const std::string& prefix);
+	const std::string& getFilePrefix();
+	const std::string& getFileName();	// of the last acquisition
+
+	//! Start of an acquisition: next file
+	void open(const Size& frame_size, int pixel_bytes);
+	void close();
+	void write(int frame_nb, const std::vector<SparseEvent>& events);
+
+	//! Dense size / sparse size of a recent frame, 0 = unknown
+	double getRatio(int frame_nb);
+	//! Of all the frames of the last acquisition
+	double getMeanRatio();
+
+private:
+	Mutex m_lock;
+	std::string m_prefix;
+	std::string m_file_name;
+	int m_acq_nb;
+	FILE *m_file;
+	long long m_dense_frame_bytes;
+	long long m_dense_bytes;
+	long long m_sparse_bytes;
+	std::vector<int> m_ratio_frames;	// ring by frame nb.
+	std::vector<float> m_ratios;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADSPARSEWRITER_H_ */
@@ -0,0 +1,88 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadSpillBuffer.h
+ */
+
+
+#ifndef XPADSPILLBUFFER_H_
+#define XPADSPILLBUFFER_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "lima/Timestamp.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace imXpad {
+
+/*******************************************************************
+ * \class SpillBuffer
+ * \brief FIFO of frames in a memory-mapped file
+ *
+ * Holds the frames received while the LIMA buffer ring is full, in
+ * the order they were received, until they can be copied back to it.
+ * Filled and drained by the acquisition thread only.
+ *******************************************************************/
+class SpillBuffer {
+DEB_CLASS_NAMESPC(DebModCamera, "SpillBuffer", "Xpad");
+
+public:
+	SpillBuffer();
+	~SpillBuffer();
+
+	//! Map nb_frames slots of frame_size bytes, the mapping is kept if unchanged
+	void open(const std::string& file_name, size_t frame_size, int nb_frames);
+	void close();
+	bool isOpen() const;
+	void clear();
+
+	bool empty() const;
+	bool full() const;
+	int getDepth() const;			// frames held
+	int getNbFrames() const;		// capacity
+	size_t getFrameSize() const;
+
+	//! Slot of the next frame, written before push()
+	void *getWriteSlot();
+	void push(int frame_nb, const Timestamp& timestamp);
+	//! Oldest frame
+	void *front(int& frame_nb, Timestamp& timestamp);
+	void pop();
+
+private:
+	std::string m_file_name;
+	int m_fd;
+	char *m_map;
+	size_t m_frame_size;
+	int m_nb_frames;
+	int m_head;
+	int m_depth;
+	std::vector<int> m_frame_nbs;
+	std::vector<Timestamp> m_timestamps;
+};
+
+} // namespace imXpad
+} // namespace lima
+
+#endif /* XPADSPILLBUFFER_H_ */
@@ -0,0 +1,39 @@
+/*
+ * XpadBinCtrlObj.cpp
+ */
+
+#include "imXpadInterface.h"
+#include "imXpadCamera.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+BinCtrlObj::BinCtrlObj(Camera& cam) : m_cam(cam) {
+    DEB_CONSTRUCTOR();
+}
+
+BinCtrlObj::~BinCtrlObj() {
+    DEB_DESTRUCTOR();
+}
+
+void BinCtrlObj::setBin(const Bin& bin) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(bin);
+
+    m_cam.setBin(bin);
+}
+
+void BinCtrlObj::getBin(Bin& bin) {
+    DEB_MEMBER_FUNCT();
+
+    m_cam.getBin(bin);
+    DEB_RETURN() << DEB_VAR1(bin);
+}
+
+void BinCtrlObj::checkBin(Bin& bin) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(bin);
+
+    m_cam.checkBin(bin);
+    DEB_RETURN() << DEB_VAR1(bin);
+}
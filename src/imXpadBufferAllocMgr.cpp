@@ -0,0 +1,404 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadBufferAllocMgr.cpp
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sstream>
+#include <vector>
+#include "imXpadBufferAllocMgr.h"
+#include "lima/Exceptions.h"
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+using namespace lima;
+using namespace lima::imXpad;
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t alignSize(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+XpadBufferAllocMgr::XpadBufferAllocMgr() :
+    m_nb_buffers(0), m_buffer_size(0), m_mem(NULL), m_mem_size(0),
+    m_map(NULL), m_map_size(0), m_shm_header(NULL),
+    m_mode(Anonymous), m_map_mode(Anonymous), m_ext_base(NULL), m_ext_size(0),
+    m_huge_pages(false), m_lock_memory(false),
+    m_map_huge_pages(false), m_map_lock_memory(false),
+    m_mapped_huge(false), m_mapped_locked(false),
+    m_prefault_node(-1), m_prefaulted(false), m_prefault_time(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+XpadBufferAllocMgr::~XpadBufferAllocMgr() {
+    DEB_DESTRUCTOR();
+    unmapBuffers();
+    if (!m_map_shm_name.empty())
+        shm_unlink(m_map_shm_name.c_str());
+}
+
+int XpadBufferAllocMgr::getMaxNbBuffers(const FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+
+    long long page_size = sysconf(_SC_PAGESIZE);
+    long long nb_pages = sysconf(_SC_PHYS_PAGES);
+    long long frame_size = alignSize(frame_dim.getMemSize(), page_size);
+    if (frame_size <= 0)
+        return 0;
+
+    long long max_nb_buffers;
+    if (m_mode == External)
+        max_nb_buffers = m_ext_size / frame_size;
+    else
+        // same policy as the LIMA soft allocator: at most 70% of the RAM
+        max_nb_buffers = page_size * nb_pages * 7 / 10 / frame_size;
+    DEB_RETURN() << DEB_VAR1(max_nb_buffers);
+    return int(max_nb_buffers);
+}
+
+void XpadBufferAllocMgr::allocBuffers(int nb_buffers, const FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(nb_buffers, frame_dim);
+
+    if (nb_buffers <= 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_buffers);
+
+    if (m_mem && nb_buffers == m_nb_buffers && frame_dim == m_frame_dim)
+        return;
+
+    releaseBuffers();
+    m_frame_dim = frame_dim;
+    m_nb_buffers = nb_buffers;
+    mapBuffers();
+}
+
+const FrameDim& XpadBufferAllocMgr::getFrameDim() {
+    return m_frame_dim;
+}
+
+void XpadBufferAllocMgr::getNbBuffers(int& nb_buffers) {
+    nb_buffers = m_mem ? m_nb_buffers : 0;
+}
+
+void XpadBufferAllocMgr::releaseBuffers() {
+    DEB_MEMBER_FUNCT();
+    unmapBuffers();
+    m_frame_dim = FrameDim();
+    m_nb_buffers = 0;
+}
+
+void *XpadBufferAllocMgr::getBufferPtr(int buffer_nb) {
+    if (!m_mem || buffer_nb < 0 || buffer_nb >= m_nb_buffers)
+        return NULL;
+    return m_mem + buffer_nb * m_buffer_size;
+}
+
+void XpadBufferAllocMgr::mapBuffers() {
+    DEB_MEMBER_FUNCT();
+
+    if (!m_map_shm_name.empty() && (m_mode != SharedMemory || m_shm_name != m_map_shm_name)) {
+        shm_unlink(m_map_shm_name.c_str());
+        m_map_shm_name.clear();
+    }
+
+    m_map_mode = m_mode;
+    m_map_huge_pages = m_huge_pages;
+    m_map_lock_memory = m_lock_memory;
+    m_mapped_huge = false;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    switch (m_mode) {
+    case External:
+        m_buffer_size = alignSize(m_frame_dim.getMemSize(), 64);
+        m_mem_size = m_buffer_size * m_nb_buffers;
+        if (m_mem_size > m_ext_size)
+            THROW_HW_ERROR(Error) << "External memory too small: " << m_mem_size
+                                  << " bytes needed, " << m_ext_size << " provided";
+        m_mem = (char *) m_ext_base;
+        break;
+
+    case SharedMemory: {
+        m_buffer_size = alignSize(m_frame_dim.getMemSize(), page_size);
+        m_mem_size = m_buffer_size * m_nb_buffers;
+        m_map_size = page_size + m_mem_size;
+        int fd = shm_open(m_shm_name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            THROW_HW_ERROR(Error) << "Cannot open shared memory " << m_shm_name
+                                  << ": " << strerror(errno);
+        if (ftruncate(fd, m_map_size) != 0) {
+            close(fd);
+            THROW_HW_ERROR(Error) << "Cannot size shared memory " << m_shm_name
+                                  << ": " << strerror(errno);
+        }
+        void *map = mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            THROW_HW_ERROR(Error) << "Cannot map shared memory " << m_shm_name
+                                  << ": " << strerror(errno);
+        m_map_shm_name = m_shm_name;
+        m_map = (char *) map;
+        m_mem = m_map + page_size;
+
+        const Size& size = m_frame_dim.getSize();
+        m_shm_header = (ShmHeader *) m_map;
+        m_shm_header->magic = SHM_MAGIC;
+        m_shm_header->version = SHM_VERSION;
+        m_shm_header->header_size = page_size;
+        m_shm_header->nb_buffers = m_nb_buffers;
+        m_shm_header->buffer_size = m_buffer_size;
+        m_shm_header->width = size.getWidth();
+        m_shm_header->height = size.getHeight();
+        m_shm_header->depth = m_frame_dim.getDepth();
+        m_shm_header->last_frame = -1;
+        break;
+    }
+
+    case Anonymous:
+        if (m_huge_pages) {
+            m_buffer_size = alignSize(m_frame_dim.getMemSize(), HUGE_PAGE_SIZE);
+            m_mem_size = m_buffer_size * m_nb_buffers;
+            void *map = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (map != MAP_FAILED) {
+                m_map = (char *) map;
+                m_mapped_huge = true;
+            } else
+                DEB_WARNING() << "No hugepages available (" << strerror(errno)
+                              << "), using transparent hugepages";
+        }
+
+        if (!m_map) {
+            m_buffer_size = alignSize(m_frame_dim.getMemSize(), page_size);
+            m_mem_size = m_buffer_size * m_nb_buffers;
+            void *map = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (map == MAP_FAILED)
+                THROW_HW_ERROR(Error) << "Cannot allocate " << m_nb_buffers
+                                      << " buffers: " << strerror(errno);
+            m_map = (char *) map;
+#ifdef MADV_HUGEPAGE
+            if (m_huge_pages)
+                madvise(m_map, m_mem_size, MADV_HUGEPAGE);
+#endif
+        }
+        m_map_size = m_mem_size;
+        m_mem = m_map;
+        break;
+    }
+
+    m_mapped_locked = false;
+    if (m_lock_memory) {
+        if (mlock(m_mem, m_mem_size) == 0)
+            m_mapped_locked = true;
+        else
+            DEB_WARNING() << "Cannot lock buffers in memory: " << strerror(errno);
+    }
+
+    m_prefaulted = false;
+    DEB_TRACE() << "Mapped " << m_nb_buffers << " buffers of " << m_buffer_size
+                << " bytes" << (m_mapped_huge ? " on hugepages" : "");
+}
+
+void XpadBufferAllocMgr::unmapBuffers() {
+    DEB_MEMBER_FUNCT();
+
+    if (!m_mem)
+        return;
+    if (m_mapped_locked)
+        munlock(m_mem, m_mem_size);
+    // the external memory belongs to the caller
+    if (m_map)
+        munmap(m_map, m_map_size);
+    m_map = NULL;
+    m_map_size = 0;
+    m_mem = NULL;
+    m_mem_size = 0;
+    m_shm_header = NULL;
+    m_mapped_huge = false;
+    m_mapped_locked = false;
+    m_prefaulted = false;
+}
+
+void XpadBufferAllocMgr::setExternalMemory(void *base, size_t size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(base, size);
+
+    m_ext_base = base;
+    m_ext_size = base ? size : 0;
+    m_mode = base ? External : Anonymous;
+}
+
+void XpadBufferAllocMgr::setSharedMemory(const std::string& name) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(name);
+
+    if (name.empty()) {
+        m_shm_name.clear();
+        m_mode = Anonymous;
+        return;
+    }
+    m_shm_name = (name[0] == '/') ? name : "/" + name;
+    m_mode = SharedMemory;
+}
+
+XpadBufferAllocMgr::Mode XpadBufferAllocMgr::getMode() const {
+    return m_mode;
+}
+
+const std::string& XpadBufferAllocMgr::getSharedMemoryName() const {
+    return m_shm_name;
+}
+
+void XpadBufferAllocMgr::setLastFrame(int frame_nb) {
+    if (!m_shm_header)
+        return;
+    // the frame data must be visible before the readers see its number
+    __sync_synchronize();
+    m_shm_header->last_frame = frame_nb;
+}
+
+void XpadBufferAllocMgr::setHugePages(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+    m_huge_pages = flag;
+}
+
+bool XpadBufferAllocMgr::getHugePages() const {
+    return m_huge_pages;
+}
+
+void XpadBufferAllocMgr::setLockMemory(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+    m_lock_memory = flag;
+}
+
+bool XpadBufferAllocMgr::getLockMemory() const {
+    return m_lock_memory;
+}
+
+void XpadBufferAllocMgr::prepare(bool prefault, int numa_node) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(prefault, numa_node);
+
+    if (!m_mem)
+        return;
+
+    // options changed since the buffers were mapped: remap them in place,
+    // the LIMA buffer managers always go through getBufferPtr()
+    if (m_mode != m_map_mode || m_shm_name != m_map_shm_name ||
+        m_huge_pages != m_map_huge_pages || m_lock_memory != m_map_lock_memory) {
+        unmapBuffers();
+        mapBuffers();
+    }
+
+    if (m_shm_header)
+        m_shm_header->last_frame = -1;
+
+    if (!prefault || (m_prefaulted && numa_node == m_prefault_node))
+        return;
+
+    Timestamp t0 = Timestamp::now();
+
+    if (numa_node >= 0 && !isNumaNode(numa_node)) {
+        DEB_WARNING() << "No NUMA node " << numa_node << ", buffers not bound";
+        numa_node = -1;
+    }
+    if (numa_node >= 0) {
+        const size_t long_bits = 8 * sizeof(long);
+        std::vector<unsigned long> node_mask(numa_node / long_bits + 1, 0);
+        node_mask[numa_node / long_bits] |= 1UL << (numa_node % long_bits);
+        if (syscall(SYS_mbind, m_mem, m_mem_size, MPOL_PREFERRED, &node_mask[0],
+                    node_mask.size() * long_bits, MPOL_MF_MOVE) != 0)
+            DEB_WARNING() << "Cannot bind buffers to NUMA node " << numa_node
+                          << ": " << strerror(errno);
+    }
+
+    // write one byte per page, the kernel allocates it on the preferred node
+    size_t page_size = m_mapped_huge ? HUGE_PAGE_SIZE : sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < m_mem_size; offset += page_size)
+        m_mem[offset] = 0;
+
+    m_prefaulted = true;
+    m_prefault_node = numa_node;
+    m_prefault_time = (Timestamp::now() - t0) * 1e3;
+    DEB_TRACE() << "Pre-faulted " << m_mem_size << " bytes in " << m_prefault_time << " ms";
+}
+
+double XpadBufferAllocMgr::getPrefaultTime() const {
+    return m_prefault_time;
+}
+
+bool XpadBufferAllocMgr::isHugePageBacked() const {
+    return m_mapped_huge;
+}
+
+int XpadBufferAllocMgr::getCurrentNumaNode() {
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return -1;
+    return node;
+}
+
+int XpadBufferAllocMgr::getCpuNumaNode(int cpu) {
+    // the cpu directory has a link to its node: nodeN
+    std::ostringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu;
+    DIR *dir = opendir(path.str().c_str());
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent *entry;
+    while (node < 0 && (entry = readdir(dir)) != NULL)
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4]))
+            node = atoi(entry->d_name + 4);
+    closedir(dir);
+    return node;
+}
+
+bool XpadBufferAllocMgr::isNumaNode(int node) {
+    if (node < 0)
+        return false;
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node;
+    return access(path.str().c_str(), F_OK) == 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * XpadBufferCtrlObj.cpp
+ */
+
+#include "imXpadInterface.h"
+#include "imXpadCamera.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+BufferCtrlObj::BufferCtrlObj(Camera& cam) :
+    m_cam(cam), m_buffer_cb_mgr(m_buffer_alloc_mgr), m_buffer_mgr(m_buffer_cb_mgr)
+{
+    DEB_CONSTRUCTOR();
+}
+
+BufferCtrlObj::~BufferCtrlObj() {
+    DEB_DESTRUCTOR();
+}
+
+void BufferCtrlObj::setFrameDim(const FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.setFrameDim(frame_dim);
+}
+
+void BufferCtrlObj::getFrameDim(FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getFrameDim(frame_dim);
+}
+
+void BufferCtrlObj::setNbBuffers(int nb_buffers) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.setNbBuffers(nb_buffers);
+}
+
+void BufferCtrlObj::getNbBuffers(int& nb_buffers) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getNbBuffers(nb_buffers);
+}
+
+void BufferCtrlObj::setNbConcatFrames(int nb_concat_frames) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.setNbConcatFrames(nb_concat_frames);
+}
+
+void BufferCtrlObj::getNbConcatFrames(int& nb_concat_frames) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getNbConcatFrames(nb_concat_frames);
+}
+
+void BufferCtrlObj::getMaxNbBuffers(int& max_nb_buffers) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getMaxNbBuffers(max_nb_buffers);
+}
+
+void *BufferCtrlObj::getBufferPtr(int buffer_nb, int concat_frame_nb) {
+    DEB_MEMBER_FUNCT();
+    return m_buffer_mgr.getBufferPtr(buffer_nb, concat_frame_nb);
+}
+
+void *BufferCtrlObj::getFramePtr(int acq_frame_nb) {
+    DEB_MEMBER_FUNCT();
+    return m_buffer_mgr.getFramePtr(acq_frame_nb);
+}
+
+void BufferCtrlObj::getStartTimestamp(Timestamp& start_ts) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getStartTimestamp(start_ts);
+}
+
+void BufferCtrlObj::getFrameInfo(int acq_frame_nb, HwFrameInfoType& info) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.getFrameInfo(acq_frame_nb, info);
+}
+
+void BufferCtrlObj::registerFrameCallback(HwFrameCallback& frame_cb) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.registerFrameCallback(frame_cb);
+}
+
+void BufferCtrlObj::unregisterFrameCallback(HwFrameCallback& frame_cb) {
+    DEB_MEMBER_FUNCT();
+    m_buffer_mgr.unregisterFrameCallback(frame_cb);
+}
+
+StdBufferCbMgr& BufferCtrlObj::getBuffer() {
+    return m_buffer_cb_mgr;
+}
+
+XpadBufferAllocMgr& BufferCtrlObj::getAllocMgr() {
+    return m_buffer_alloc_mgr;
+}
@@ -28,11 +28,16 @@
 #include <iostream>
 #include <string>
 #include <math.h>
+#include <string.h>
 #include <iomanip>
+#include <algorithm>
 #include "imXpadCamera.h"
 #include "lima/Exceptions.h"
 #include "lima/Debug.h"
 #include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
 #include <ostream>
 #include <fstream>
@@ -42,6 +47,34 @@ using namespace std;
 using namespace lima;
 using namespace lima::imXpad;
 
+static const string WIRE_16BIT_FIELD = " 16";
+static const int SPILL_POLL_USEC = 1000;
+static const int FILE_POLL_USEC = 50;
+
+// cpu list as taskset -c: "2", "2,3", "0-3,8"
+static bool parseCpuList(const string& cpus, cpu_set_t& cpu_set)
+{
+  CPU_ZERO(&cpu_set);
+  istringstream is(cpus);
+  string item;
+  while (getline(is, item, ','))
+    {
+      int first, last;
+      char sep, extra;
+      istringstream is_item(item);
+      if (!(is_item >> first))
+	return false;
+      last = first;
+      if (is_item >> sep && (sep != '-' || !(is_item >> last) || is_item >> extra))
+	return false;
+      if (first < 0 || last < first || last >= CPU_SETSIZE)
+	return false;
+      for (int cpu = first; cpu <= last; cpu++)
+	CPU_SET(cpu, &cpu_set);
+    }
+  return CPU_COUNT(&cpu_set) > 0;
+}
+
 
 #define CHECK_DETECTOR_ACCESS {if(m_thread_running == false || (m_thread_running && m_process_id > 0) || (m_nb_frames != 0 && m_acq_frame_nb == m_nb_frames)){ }else {return;}}
 
@@ -63,6 +96,22 @@ private:
   Camera& m_cam;
 };
 
+//---------------------------
+//- file ingest worker thread
+//---------------------------
+class Camera::FileIngestThread: public Thread {
+  DEB_CLASS_NAMESPC(DebModCamera, "Camera", "FileIngestThread");
+public:
+  FileIngestThread(Camera &aCam);
+  virtual ~FileIngestThread();
+
+protected:
+  virtual void threadFunction();
+
+private:
+  Camera& m_cam;
+};
+
 //---------------------------
 // @brief  Ctor
 //---------------------------m_npixels
@@ -70,10 +119,76 @@ private:
 Camera::Camera(string hostname, int port) :
   m_hostname(hostname),
   m_port(port),
-  m_state(XpadStatus::Idle)
+  m_state(XpadStatus::Idle),
+  m_ingest_window(4),
+  m_ingest_active(false),
+  m_ingest_failed(false),
+  m_ingest_exit(false),
+  m_ingest_running(0),
+  m_ingest_busy(0),
+  m_ingest_next_frame(0),
+  m_ingest_publish_frame(0),
+  m_ingest_occupancy(0),
+  m_ingest_max_occupancy(0),
+  m_raw_output(false),
+  m_hdf5_output(false),
+  m_frame_ring_nb_frames(64),
+  m_spill_nb_frames(1024),
+  m_spill_active(false),
+  m_spill_write(false),
+  m_spill_buffer_frames(0),
+  m_last_frame_released(-1),
+  m_last_frame_published(-1),
+  m_release_reporting(false),
+  m_spill_max_depth(0),
+  m_spilled_frames(0),
+  m_drained_frames(0),
+  m_discarded_frames(0),
+  m_acq_tid(0),
+  m_acq_rt_priority(0),
+  m_receive_busy_poll(0),
+  m_frame_interval_nb(0),
+  m_frame_interval_sum(0),
+  m_frame_interval_sum2(0),
+  m_frame_interval_max(0),
+  m_buffer_prefault(false),
+  m_buffer_numa_node(-1),
+  m_acq_numa_node(-1),
+  m_first_frame_latency(0),
+  m_publish_batch(1),
+  m_publish_max_delay(10.),
+  m_publish_batch_size(1),
+  m_live_max_frame_rate(0),
+  m_live_frames_skipped(0),
+  m_live_rearms(0),
+  m_live_segment_frames(0),
+  m_live_buffer_free(true),
+  m_arm_handshake(true),
+  m_arm_latency(0),
+  m_prearm(false),
+  m_exposure_params_skipped(0),
+  m_sequence_entry(0),
+  m_segment_end(0),
+  m_float_output(false),
+  m_roi_module_mask(0),
+  m_wire_16bit(false),
+  m_wire_16bit_supported(true),
+  m_adaptive_pixel_depth(false),
+  m_pixel_depth_promoted(false),
+  m_pixel_depth_change(false),
+  m_acq_max_count(-1),
+  m_acq_overflow_frames(0),
+  m_frame_statistics(false),
+  m_frames_received(0),
+  m_sparse_output(false),
+  m_bufferCtrlObj(*this)
 {
   DEB_CONSTRUCTOR();
 
+  m_processing.setChipSize(Size(IMG_COLUMN, IMG_LINE));
+  m_stats_calc.setChipSize(Size(IMG_COLUMN, IMG_LINE));
+  m_stats_calc.setRoiCounters(&m_roi_counters);
+
   /*
   * PCI MODE
   #define XPAD_S70                    101
@@ -138,6 +253,7 @@ Camera::Camera(string hostname, int port) :
 Camera::~Camera() {
   DEB_DESTRUCTOR();
   this->quit();
+  this->stopFileIngestThreads();
 }
 
 int Camera::init() {
@@ -149,6 +265,7 @@ int Camera::init() {
 
   cmd.str(string());
   cmd << "Init";
+  m_exposure_params.clear();
   m_xpad->sendWait(cmd.str(), ret);
 
   if(ret == 1 )
@@ -182,10 +299,68 @@ void Camera::reset() {
   stringstream cmd1;
   cmd1 << "ResetDetector";
   m_xpad->sendNoWait(cmd1.str());
+  m_exposure_params.clear();
   DEB_TRACE() << "Reset of detector  -> OK";
 
 }
 
+string Camera::getExposureParameters(int nb_frames, unsigned int exp_time_usec,
+				     unsigned int lat_time_usec, unsigned int xpad_trigger_mode) {
+  stringstream cmd;
+
+  cmd << "SetExposureParameters " << nb_frames << " " << exp_time_usec << " "
+  << lat_time_usec << " " << m_overflow_time << " " << xpad_trigger_mode << " " << m_xpad_output_signal_mode << " "
+  << m_geometrical_correction_flag << " " << m_flat_field_correction_flag << " "
+  << m_image_transfer_flag << " " << m_image_file_format << " " << m_acquisition_mode << " " << m_stack_images
+  << " /opt/cegitek/tmp_corrected/";
+  // optional field, refused by the servers sending 32 bit pixels only
+  if (isWire16Bit())
+    cmd << WIRE_16BIT_FIELD;
+  return cmd.str();
+}
+
+int Camera::sendExposureParameters(const string& cmd, bool& prearmed) {
+  DEB_MEMBER_FUNCT();
+
+  int value;
+  // pre-arm: the current acquisition still reads frames on the main
+  // connection, prepare the next one on the alternate connection
+  prearmed = m_prearm && m_thread_running && m_process_id == 0;
+  if (prearmed) {
+    DEB_TRACE() << "Pre-arming on the alternate connection";
+    AutoMutex aLock(m_xpad_alt_lock);
+    m_xpad_alt->sendWait(cmd, value);
+  } else
+    m_xpad->sendWait(cmd, value);
+  return value;
+}
+
+bool Camera::isWire16Bit() {
+  // the frames received are copied as they are in the 16 bit buffers
+  return m_wire_16bit && m_wire_16bit_supported && m_image_transfer_flag &&
+    m_image_format == 0 && !isProcessingFrames();
+}
+
+void Camera::setWire16Bit(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_wire_16bit = flag;
+  m_wire_16bit_supported = true;
+}
+
+bool Camera::getWire16Bit() {
+  DEB_MEMBER_FUNCT();
+
+  return m_wire_16bit;
+}
+
+int Camera::getWirePixelDepth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_xpad->getWirePixelDepth();
+}
+
 int Camera::prepareAcq() {
   DEB_MEMBER_FUNCT();
 
@@ -194,17 +369,94 @@ int Camera::prepareAcq() {
   int value;
   stringstream cmd1;
 
+  applyPixelDepthChange();
+
+  // apply the buffer options, fault the ring in now rather than on the first frames
+  int numa_node = (m_buffer_numa_node >= 0)? m_buffer_numa_node: m_acq_numa_node;
+  m_bufferCtrlObj.getAllocMgr().prepare(m_buffer_prefault, numa_node);
+  if (m_spill_file.empty()) {
+    m_spill.close();
+  } else {
+    // without the releases reported, the LIMA ring state is unknown
+    if (!m_release_reporting)
+      THROW_HW_ERROR(Error) << "Spill file needs the frames released reported "
+			    << "(setReleaseReporting)";
+    FrameDim frame_dim;
+    m_bufferCtrlObj.getFrameDim(frame_dim);
+    m_spill.open(m_spill_file, frame_dim.getMemSize(), m_spill_nb_frames);
+  }
+
   m_image_file_format = 1;
-  //if live mode requested (0 frame)
-  int nb_frames = (m_nb_frames == 0)? 9999: m_nb_frames;
-  
-  cmd1 << "SetExposureParameters " << nb_frames << " " << m_exp_time_usec << " "
-  << m_lat_time_usec << " " << m_overflow_time << " " << m_xpad_trigger_mode << " " << m_xpad_output_signal_mode << " "
-  << m_geometrical_correction_flag << " " << m_flat_field_correction_flag << " "
-  << m_image_transfer_flag << " " << m_image_file_format << " " << m_acquisition_mode << " " << m_stack_images
-  << " /opt/cegitek/tmp_corrected/";
+  if (m_sparse_output && isProcessingFrames())
+    THROW_HW_ERROR(Error) << "Sparse output needs frames not processed by the plugin";
+  if (m_sparse_output && m_sparse_writer.getFilePrefix().empty())
+    THROW_HW_ERROR(Error) << "Sparse output needs a file prefix";
+  if (m_raw_output && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "Raw output needs the image transfer flag ON";
+  if (m_raw_output && m_raw_writer.getFilePrefix().empty())
+    THROW_HW_ERROR(Error) << "Raw output needs a file prefix";
+  if (m_hdf5_output && !ChunkWriter::isAvailable())
+    THROW_HW_ERROR(NotSupported) << "HDF5 output needs the plugin built with HDF5";
+  if (m_hdf5_output && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "HDF5 output needs the image transfer flag ON";
+  if (m_hdf5_output && m_chunk_writer.getFilePrefix().empty())
+    THROW_HW_ERROR(Error) << "HDF5 output needs a file prefix";
+  if (!m_frame_ring_name.empty() && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "Frame ring needs the image transfer flag ON";
+  if (m_roi_module_mask && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "Roi of a subset of the modules needs the image transfer flag ON";
+  // the files of a live acquisition would stop with its first segment
+  if (m_nb_frames == 0 && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "Live mode needs the image transfer flag ON";
+  // the max. count is found while converting the frames received
+  m_processing.setTrackMax(m_adaptive_pixel_depth && m_image_transfer_flag && !m_float_output);
+  if (isProcessingFrames() && !m_image_transfer_flag)
+    THROW_HW_ERROR(Error) << "Client-side processing needs the image transfer flag ON";
+
+  // the acq. thread and getFrameSequenceIndex() use the sequence prepared
+  m_acq_sequence = m_sequence;
+  m_acq_sequence_ends = m_sequence_ends;
+
+  // the server acquires the raw frames, an output frame may need several
+  if (!m_sequence.empty()) {
+    // the acq. thread chains the entries, the first one is prepared here
+    if (!m_image_transfer_flag)
+      THROW_HW_ERROR(Error) << "Acquisition sequences need the image transfer flag ON";
+    int seq_nb_frames = getSequenceNbFrames();
+    if (m_nb_frames != seq_nb_frames)
+      THROW_HW_ERROR(InvalidValue) << "Nb frames " << m_nb_frames << " does not match "
+				   << "the sequence: " << seq_nb_frames;
+    const SequenceEntry& entry = m_sequence[0];
+    cmd1 << getExposureParameters(m_processing.getNbRawFrames(entry.nb_frames), entry.exp_time_usec,
+				  entry.lat_time_usec, entry.xpad_trigger_mode);
+  } else {
+    //if live mode requested (0 frame), acquire segments re-armed by the acq. thread
+    int nb_frames = m_processing.getNbRawFrames((m_nb_frames == 0)? LIVE_SEGMENT_FRAMES: m_nb_frames);
+    cmd1 << getExposureParameters(nb_frames, m_exp_time_usec, m_lat_time_usec, m_xpad_trigger_mode);
+  }
 
-  m_xpad->sendWait(cmd1.str(), value);
+  // the server keeps the exposure parameters: do not resend them unchanged
+  if (cmd1.str() == m_exposure_params) {
+    DEB_TRACE() << "Exposure parameters unchanged, not sent";
+    ++m_exposure_params_skipped;
+    value = 0;
+  } else {
+    m_exposure_params.clear();
+    string cmd = cmd1.str();
+    bool prearmed;
+    value = sendExposureParameters(cmd, prearmed);
+    if (value && isWire16Bit()) {
+      // the server does not know the 16 bit transfer: 32 bit frames
+      DEB_WARNING() << "16 bit transfer refused by the server, 32 bit used";
+      m_wire_16bit_supported = false;
+      cmd = cmd.substr(0, cmd.size() - WIRE_16BIT_FIELD.size());
+      value = sendExposureParameters(cmd, prearmed);
+    }
+    // the parameters accepted on the alternate connection during the
+    // previous acquisition are not known to be the ones applied: resent
+    if (!value && !prearmed)
+      m_exposure_params = cmd;
+  }
 
   if(!value){
     DEB_TRACE() << "Default exposure parameter applied SUCCESFULLY";
@@ -230,6 +482,49 @@ void Camera::startAcq() {
   this->waitAcqEnd();
 
   m_acq_frame_nb = 0;
+  m_sequence_entry = 0;
+  m_segment_end = m_acq_sequence.empty()? m_nb_frames: m_acq_sequence[0].nb_frames;
+  m_live_frames_skipped = 0;
+  m_live_rearms = 0;
+  m_live_last_shown = Timestamp();
+  m_live_segment_frames = 0;
+  m_processing.reset();
+  m_processing.resetMaxCount();
+  m_stats_ring.clear();
+  m_roi_counters.clearRecords();
+  m_frames_received = 0;
+  // no spill in live mode, the frames not shown are dropped anyway
+  m_spill_active = m_spill.isOpen() && m_release_reporting && m_image_transfer_flag && m_nb_frames != 0;
+  m_spill.clear();
+  m_spill_buffer_frames = getNbBufferFrames();
+  m_last_frame_published = -1;
+  m_last_frame_released = -1;
+  m_spill_max_depth = m_spilled_frames = m_drained_frames = m_discarded_frames = 0;
+  m_frame_interval_ts = Timestamp();
+  m_frame_interval_nb = 0;
+  m_frame_interval_sum = m_frame_interval_sum2 = m_frame_interval_max = 0;
+  m_stats_calc.setSparseEvents(m_sparse_output);
+  if (m_sparse_output) {
+    // the frames of the roi, not the ones of the whole detector
+    FrameDim frame_dim;
+    m_bufferCtrlObj.getFrameDim(frame_dim);
+    m_sparse_writer.open(frame_dim.getSize(), frame_dim.getDepth());
+  }
+  if (m_raw_output || m_hdf5_output || !m_frame_ring_name.empty()) {
+    FrameDim frame_dim;
+    m_bufferCtrlObj.getFrameDim(frame_dim);
+    if (m_raw_output)
+      m_raw_writer.open(frame_dim);
+    if (m_hdf5_output)
+      m_chunk_writer.open(frame_dim);
+    if (!m_frame_ring_name.empty())
+      m_frame_ring.open(m_frame_ring_name, frame_dim, m_frame_ring_nb_frames);
+  }
+  if (m_frame_ring_name.empty())
+    m_frame_ring.close();
+  m_acq_max_count = -1;
+  m_acq_overflow_frames = 0;
+  m_processing.setExposureTime((m_acq_sequence.empty()? m_exp_time_usec: m_acq_sequence[0].exp_time_usec) / 1e6);
   StdBufferCbMgr& buffer_mgr = m_bufferCtrlObj.getBuffer();
   buffer_mgr.setStartTimestamp(Timestamp::now());
 
@@ -246,11 +541,18 @@ void Camera::startAcq() {
   // detector can miss the trigger if we dont wait here 17ms minimum before returning
   // no wait to get synchronize with the read detector start
   // An other delay workaround when live-mode is started using hw triggering, 100ms seems enough
+  // With the handshake these delays are only upper bounds, we return as soon
+  // as the detector reports it is acquiring (armed, waiting for the trigger)
+  m_arm_latency = 0;
   if (trig_mode  != IntTrig) {
-    if (m_nb_frames == 0)
-      usleep(100000);      
-    else
-      usleep(17000);
+    unsigned int arm_time = (m_nb_frames == 0)? 100000: 17000;
+    if (m_arm_handshake) {
+      if (waitDetectorState(XpadStatus::Acquiring, arm_time))
+	m_arm_latency = (Timestamp::now() - m_expose_timestamp) * 1e3;
+      else
+	DEB_WARNING() << "Detector not seen armed after " << arm_time << " us";
+    } else
+      usleep(arm_time);
   }
   m_state = XpadStatus::Acquiring;
 }
@@ -261,10 +563,99 @@ void Camera::waitAcqEnd(){
   while (m_thread_running)
     m_cond.wait();
 
-  usleep(m_dead_time);
+  // m_dead_time is only an upper bound with the handshake
+  if (m_arm_handshake)
+    waitDetectorState(XpadStatus::Idle, m_dead_time);
+  else
+    usleep(m_dead_time);
   m_state = XpadStatus::Idle;
 }
 
+bool Camera::readDetectorState(XpadStatus::XpadState& state) {
+  DEB_MEMBER_FUNCT();
+
+  stringstream cmd;
+  string str;
+
+  cmd << "GetDetectorStatus";
+
+  AutoMutex aLock(m_xpad_alt_lock);
+  m_xpad_alt->sendWait(cmd.str(), str);
+  aLock.unlock();
+
+  size_t pos = str.find(".");
+  string name = str.substr (0, pos);
+  if (name.compare("Idle") == 0) {
+    state = XpadStatus::Idle;
+  }else if (name.compare("Acquiring") == 0) {
+    state = XpadStatus::Acquiring;
+  }else if (name.compare("Loading/Saving_calibration") == 0) {
+    state = XpadStatus::CalibrationManipulation;
+  }else if (name.compare("Calibrating") == 0) {
+    state = XpadStatus::Calibrating;
+  } else if (name.compare("Digital_Test") == 0) {
+    state = XpadStatus::DigitalTest;
+  } else if (name.compare("Resetting") == 0) {
+    state = XpadStatus::Resetting;
+  } else
+    return false;
+  return true;
+}
+
+bool Camera::waitDetectorState(XpadStatus::XpadState state, unsigned int timeout_usec) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(state, timeout_usec);
+
+  Timestamp t0 = Timestamp::now();
+  while (1)
+    {
+      XpadStatus::XpadState cur_state;
+      if (readDetectorState(cur_state) && cur_state == state)
+	return true;
+      if ((Timestamp::now() - t0) * 1e6 >= timeout_usec)
+	return false;
+      usleep(STATE_POLL_PERIOD);
+    }
+}
+
+void Camera::setArmHandshake(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_arm_handshake = flag;
+}
+
+bool Camera::getArmHandshake() {
+  DEB_MEMBER_FUNCT();
+
+  return m_arm_handshake;
+}
+
+void Camera::setPrearm(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_prearm = flag;
+}
+
+bool Camera::getPrearm() {
+  DEB_MEMBER_FUNCT();
+
+  return m_prearm;
+}
+
+int Camera::getExposureParametersSkipped() {
+  DEB_MEMBER_FUNCT();
+
+  return m_exposure_params_skipped;
+}
+
+double Camera::getArmLatency() {
+  DEB_MEMBER_FUNCT();
+
+  return m_arm_latency;
+}
+
 void Camera::setWaitAcqEndTime(unsigned int time){
   DEB_MEMBER_FUNCT();
 
@@ -289,18 +680,59 @@ void Camera::stopAcq() {
 void Camera::sendExposeCommand(){
   DEB_MEMBER_FUNCT();
 
+  m_first_frame_latency = 0;
+  m_expose_timestamp = Timestamp::now();
   m_xpad->sendExposeCommand();
 }
 
 int Camera::readFrameExpose(void *bptr, int frame_nb) {
   DEB_MEMBER_FUNCT();
 
+  // the LIMA buffers, the spill slots and the discard buffer: a LIMA frame
+  FrameDim frame_dim;
+  m_bufferCtrlObj.getFrameDim(frame_dim);
+  return readFrameExpose(bptr, frame_dim.getMemSize(), frame_nb);
+}
+
+int Camera::readFrameExpose(void *bptr, size_t buffer_size, int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
   DEB_TRACE() << "reading frame " << frame_nb;
 
   int ret;
+  FrameStats *stats = isDecodeStatsActive() ? &m_frame_stats : NULL;
+  if (stats)
+    stats->reset(frame_nb);
+
+  if (!isProcessingFrames()) {
+    ret = m_xpad->getDataExpose(bptr, buffer_size, m_image_format, &m_stats_calc, stats);
+    if (ret != 0)
+      DEB_ERROR() << "Frame " << frame_nb << " not read: " << m_xpad->getErrorMessage();
+    if (ret == 0 && stats)
+      storeFrameStats(*stats, m_frames_received);
+    if (ret == 0)
+      ++m_frames_received;
+    return ret;
+  }
 
-  ret = m_xpad->getDataExpose(bptr, m_image_format);
-  return ret;
+  // client-side processing: read raw frames until an output frame is ready,
+  // the statistics are the ones of the raw frames read for it
+  FrameDim frame_dim;
+  m_bufferCtrlObj.getFrameDim(frame_dim);
+  while (1) {
+    int width, height;
+    ret = m_xpad->getRawDataExpose(m_raw_frame, width, height);
+    if (ret != 0)
+      return ret;
+    if (stats)
+      m_stats_calc.add(*stats, &m_raw_frame[0], Size(width, height));
+    if (m_processing.processFrame(&m_raw_frame[0], Size(width, height), bptr, frame_dim)) {
+      if (stats)
+	storeFrameStats(*stats, m_frames_received);
+      ++m_frames_received;
+      return 0;
+    }
+  }
 }
 
 int Camera::getDataExposeReturn() {
@@ -317,29 +749,10 @@ void Camera::getStatus(XpadStatus& status) {
 
   if (m_thread_running == false || (m_thread_running && m_process_id > 0) || (m_nb_frames !=0 && m_acq_frame_nb == m_nb_frames)){
 
-    stringstream cmd;
-    string str;
-    unsigned short pos;
-    
-    cmd << "GetDetectorStatus";
-
-    m_xpad_alt->sendWait(cmd.str(), str);
-    pos = str.find(".");
-    string state = str.substr (0, pos);
-    if (state.compare("Idle") == 0) {
-      status.state = XpadStatus::Idle;
-    }else if (state.compare("Acquiring") == 0) {
-      status.state = XpadStatus::Acquiring;
-    }else if (state.compare("Loading/Saving_calibration") == 0) {
-      status.state = XpadStatus::CalibrationManipulation;
-    }else if (state.compare("Calibrating") == 0) {
-      status.state = XpadStatus::Calibrating;
-    } else if (state.compare("Digital_Test") == 0) {
-      status.state = XpadStatus::DigitalTest;
-    } else if (state.compare("Resetting") == 0) {
-      status.state = XpadStatus::Resetting;
-    }
-    m_state = status.state;
+    XpadStatus::XpadState state;
+    if (readDetectorState(state))
+      m_state = state;
+    status.state = m_state;
   } else{
     status.state = m_state;
   }
@@ -351,400 +764,2069 @@ int Camera::getNbHwAcquiredFrames() {
   return m_acq_frame_nb;
 }
 
+bool Camera::rearmLive() {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if (m_quit)
+    return false;
 
-void Camera::AcqThread::threadFunction()
-{
+  // same exposure parameters, no prepareAcq() needed; sent as soon as the
+  // last frame of the segment is read, the server starts the next segment
+  // right after the return of this one
+  m_xpad->sendExposeCommand();
+  ++m_live_rearms;
+  DEB_TRACE() << "Live acquisition re-armed " << DEB_VAR1(m_live_rearms);
+  return true;
+}
+
+void Camera::startLiveSegment() {
   DEB_MEMBER_FUNCT();
 
-  AutoMutex aLock(m_cam.m_cond.mutex());
-  //StdBufferCbMgr& buffer_mgr = m_cam.m_buffer_ctrl_obj.getBuffer();
-        
-  StdBufferCbMgr& buffer_mgr = m_cam.m_bufferCtrlObj.getBuffer();
+  // an accumulation window does not span two segments
+  m_processing.reset();
+  m_live_segment_frames = 0;
+}
 
-  while (1)
-    {
-      while (m_cam.m_wait_flag || m_cam.m_quit)
-	{
-	  DEB_TRACE() << "Acquisition thread waiting...";
-	  DEB_TRACE() << "wait flag value = " << m_cam.m_wait_flag;
-	  DEB_TRACE() << "quit flag value = " << m_cam.m_quit;
-	  m_cam.m_thread_running = false;
-	  m_cam.m_cond.broadcast();
-	  //aLock.unlock();
-	  m_cam.m_cond.wait();
-	}
+bool Camera::rearmSequence() {
+  DEB_MEMBER_FUNCT();
 
-      DEB_TRACE() << "Acqisition thread running...";
-      m_cam.m_thread_running = true;
-      m_cam.m_cond.broadcast();
-      aLock.unlock();
+  AutoMutex aLock(m_cond.mutex());
+  if (m_quit || m_sequence_entry + 1 >= int(m_acq_sequence.size()))
+    return false;
 
-      switch (m_cam.m_process_id)
-	{
-	case 0:
-	  {  //startAcq()
+  const SequenceEntry& entry = m_acq_sequence[++m_sequence_entry];
+  string cmd = getExposureParameters(m_processing.getNbRawFrames(entry.nb_frames), entry.exp_time_usec,
+				     entry.lat_time_usec, entry.xpad_trigger_mode);
+  int value;
+  m_exposure_params.clear();
+  m_xpad->sendWait(cmd, value);
+  if (value) {
+    DEB_ERROR() << "Sequence entry " << m_sequence_entry << ": SetExposureParameters FAILED";
+    return false;
+  }
+  m_exposure_params = cmd;
 
-	    DEB_TRACE() << "Starting to acquire images...";
+  // an accumulation window does not span two entries
+  m_processing.reset();
+  m_processing.setExposureTime(entry.exp_time_usec / 1e6);
+  m_xpad->sendExposeCommand();
+  m_segment_end += entry.nb_frames;
+  DEB_TRACE() << "Sequence entry " << m_sequence_entry << " started";
+  return true;
+}
 
-	    if (m_cam.m_quit == false)
-	      {
-		m_cam.sendExposeCommand();
+bool Camera::isLiveFrameShown() {
+  // the display lags behind: no LIMA buffer released for the frame
+  if (!m_live_buffer_free)
+    {
+      ++m_live_frames_skipped;
+      return false;
+    }
+  if (m_live_max_frame_rate <= 0)
+    return true;
 
-		bool continueFlag = true;
-		int ret;
+  Timestamp now = Timestamp::now();
+  if (m_live_last_shown.isSet() && (now - m_live_last_shown) < 1. / m_live_max_frame_rate)
+    {
+      ++m_live_frames_skipped;
+      return false;
+    }
+  m_live_last_shown = now;
+  return true;
+}
 
-		if (m_cam.m_image_transfer_flag == 1)
-		  {
-		    while (continueFlag && (m_cam.m_nb_frames == 0 || m_cam.m_acq_frame_nb < m_cam.m_nb_frames))
-		      {
+bool Camera::isSegmentEnd() {
+  // a live segment is counted in frames read, shown or not
+  if (m_nb_frames == 0)
+    return m_live_segment_frames >= LIVE_SEGMENT_FRAMES;
+  return m_acq_frame_nb >= m_segment_end;
+}
 
-			DEB_TRACE() << m_cam.m_acq_frame_nb;
-			void *bptr = buffer_mgr.getFrameBufferPtr(m_cam.m_acq_frame_nb);
+void Camera::addSequenceEntry(int nb_frames, double exp_time, double lat_time, TrigMode trig_mode) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR4(nb_frames, exp_time, lat_time, trig_mode);
 
-			ret = m_cam.readFrameExpose(bptr, m_cam.m_acq_frame_nb);
+  checkSequenceChange();
+  if (nb_frames < 1)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames);
 
-			if ( ret == 0 )
-			  {
-			    if (!m_cam.m_quit) {
-			      HwFrameInfoType frame_info;
-			      frame_info.acq_frame_nb = m_cam.m_acq_frame_nb;
-			      continueFlag = buffer_mgr.newFrameReady(frame_info);
-			      DEB_TRACE() << "acqThread::threadFunction() newframe ready ";
-
-			      ++m_cam.m_acq_frame_nb;
-
-			      DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
-			    }
-			    else {
-			      continueFlag = false;
-			      DEB_TRACE() << "Acq. Quit  detected";
-			    }
-			  }
-			else
-			  {
-			    continueFlag = false;
-			    DEB_TRACE() << "ABORT detected";
-			  }
-		      }
-		    m_cam.getDataExposeReturn();
-		  }
-		else
-		  {
+  SequenceEntry entry;
+  entry.nb_frames = nb_frames;
+  entry.exp_time_usec = exp_time * 1e6;
+  entry.lat_time_usec = lat_time * 1e6;
+  entry.xpad_trigger_mode = getXpadTrigMode(trig_mode);
+  m_sequence.push_back(entry);
 
-		    DEB_TRACE() << m_cam.m_acq_frame_nb;
-		    DEB_TRACE() << m_cam.m_image_size.getWidth() << " " << m_cam.m_image_size.getHeight();
+  m_sequence_ends.push_back(getSequenceNbFrames());
+}
 
-		    uint numData = m_cam.m_image_size.getWidth() * m_cam.m_image_size.getHeight();
+void Camera::clearSequence() {
+  DEB_MEMBER_FUNCT();
 
-		    int16_t *buffer_short;
-		    int32_t *buffer_int;
+  checkSequenceChange();
+  m_sequence.clear();
+  m_sequence_ends.clear();
+}
 
-		    while (continueFlag && (m_cam.m_nb_frames == 0 || m_cam.m_acq_frame_nb < m_cam.m_nb_frames) && m_cam.m_quit == false)
-		      {
+int Camera::getSequenceLength() {
+  DEB_MEMBER_FUNCT();
 
-			void *bptr = buffer_mgr.getFrameBufferPtr(m_cam.m_acq_frame_nb);
+  return m_sequence.size();
+}
 
-			if (m_cam.m_pixel_depth == Camera::B2)
-			  buffer_short = (int16_t *) bptr;
-			else
-			  buffer_int = (int32_t *) bptr;
+int Camera::getSequenceNbFrames() {
+  DEB_MEMBER_FUNCT();
 
-			stringstream fileName;
+  int nb_frames = 0;
+  for (size_t i = 0; i < m_sequence.size(); i++)
+    nb_frames += m_sequence[i].nb_frames;
+  return nb_frames;
+}
 
+int Camera::getFrameSequenceIndex(int frame_nb) {
+  DEB_MEMBER_FUNCT();
 
-			fileName << "/opt/cegitek/tmp_corrected/burst_" << m_cam.m_burstNumber << "_image_" << m_cam.m_acq_frame_nb  << ".bin";
-			while (access( fileName.str().c_str(), F_OK ) == -1)
-			  {
-			    if (m_cam.m_quit)
-			      {
-				DEB_TRACE() << "ABORT detected";
-				break;
-			      }
-			  }
+  // the frames of the last acquisition prepared
+  if (frame_nb < 0)
+    return -1;
+  std::vector<int>::iterator it = std::upper_bound(m_acq_sequence_ends.begin(),
+						   m_acq_sequence_ends.end(), frame_nb);
+  if (it == m_acq_sequence_ends.end())
+    return -1;
+  return it - m_acq_sequence_ends.begin();
+}
 
-			if (access( fileName.str().c_str(), F_OK ) == 0)
-			  {
+void Camera::checkSequenceChange() {
+  DEB_MEMBER_FUNCT();
 
-			    ifstream file(fileName.str().c_str(), ios::in | ios::binary);
+  if (m_thread_running && m_process_id == 0)
+    THROW_HW_ERROR(Error) << "Cannot change the sequence during an acquisition";
+}
 
-			    if (file.is_open())
-			      {
+void Camera::setLiveMaxFrameRate(double rate) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(rate);
 
-				DEB_TRACE() << "OPEN FILE : " << (char *) buffer_int;
-				file.read((char *) buffer_int, numData * sizeof (int32_t));
-
-				if (m_cam.m_pixel_depth == Camera::B2)
-				  {
-				    uint32_t count = 0;
-				    int i = 0;
-				    while (count < numData * sizeof (int32_t))
-				      {
-					buffer_short[i] = (uint16_t) (buffer_int[i]);
-					count += sizeof (int32_t);
-					i++;
-				      }
-				  }
-				file.close();
-			      }
+  if (rate < 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(rate);
+  m_live_max_frame_rate = rate;
+}
 
-			    remove(fileName.str().c_str());
+double Camera::getLiveMaxFrameRate() {
+  DEB_MEMBER_FUNCT();
 
-			    HwFrameInfoType frame_info;
-			    frame_info.acq_frame_nb = m_cam.m_acq_frame_nb;
-			    continueFlag = buffer_mgr.newFrameReady(frame_info);
-			    //DEB_TRACE() << "acqThread::threadFunction() newframe ready ";
-			    ++m_cam.m_acq_frame_nb;
+  return m_live_max_frame_rate;
+}
 
-			    DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
-			  }
-		      }
-		  }
-	      }
+void Camera::checkProcessingChange(bool frame_size) {
+  DEB_MEMBER_FUNCT();
 
-	    break;
-	  }
-	case 1:
-	  { //CalibrationOTN
-	    int ret;
-	    stringstream cmd;
+  // the raw frame count of a running acquisition is already programmed,
+  // the frame size is fixed whatever the acquisition
+  if (m_thread_running && m_process_id == 0 && (m_nb_frames != 0 || frame_size))
+    THROW_HW_ERROR(Error) << "Cannot change the processing during this acquisition";
+}
 
-	    cmd <<  "CalibrationOTN " << m_cam.m_calibration_configuration;
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+void Camera::setAccNbFrames(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
 
-	    if (ret == 0)
-	      DEB_TRACE() << "Calibration Over-The-Noise finished SUCCESFULLY";
-	    else if (ret == 1)
-	      DEB_TRACE() << "Calibration Over-The-Noise was ABORTED";
-	    else
-	      throw LIMA_HW_EXC(Error, "Calibration Over The Noise FAILED!");
+  checkProcessingChange();
+  m_processing.setAccNbFrames(nb_frames);
+}
 
-	    break;
-	  }
-	case 2:
-	  { //CalibrationOTNPulse
-	    int ret;
-	    stringstream cmd;
+int Camera::getAccNbFrames() {
+  DEB_MEMBER_FUNCT();
 
-	    cmd <<  "CalibrationOTNPulse " << m_cam.m_calibration_configuration;
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+  return m_processing.getAccNbFrames();
+}
 
-	    if (ret == 0)
-	      DEB_TRACE() << "Calibration Over-The-Noise with PULSE finished SUCCESFULLY";
-	    else if (ret == 1)
-	      DEB_TRACE() << "Calibration Over-The-Noise was ABORTED";
-	    else
-	      throw LIMA_HW_EXC(Error, "Calibration Over The Noise with PULSE FAILED!");
+void Camera::setAccSliding(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
 
-	    break;
+  checkProcessingChange();
+  m_processing.setAccSliding(flag);
+}
 
-	  }
-	case 3:
-	  { //CalibrationBEAM
-	    int ret;
-	    stringstream cmd;
+bool Camera::getAccSliding() {
+  DEB_MEMBER_FUNCT();
 
-	    cmd <<  "CalibrationBEAM " << m_cam.m_time << " " << m_cam.m_ITHL_max << " " << m_cam.m_calibration_configuration;
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+  return m_processing.getAccSliding();
+}
+
+void Camera::setClientGeometricalCorrection(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  checkProcessingChange(true);
+  m_processing.setGeometry(flag);
+  // the server must send the raw frames, this also updates the image size
+  if (flag && m_geometrical_correction_flag)
+    setGeometricalCorrectionFlag(0);
+  else
+    updateImageSize();
+}
+
+bool Camera::getClientGeometricalCorrection() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getGeometry();
+}
+
+void Camera::setGeometryEdgeWidth(int nb_pixels) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_pixels);
+
+  checkProcessingChange(true);
+  m_processing.setGeometryEdgeWidth(nb_pixels);
+  updateImageSize();
+}
+
+int Camera::getGeometryEdgeWidth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getGeometryEdgeWidth();
+}
+
+void Camera::setGeometryModuleGap(int nb_lines) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_lines);
+
+  checkProcessingChange(true);
+  m_processing.setGeometryModuleGap(nb_lines);
+  updateImageSize();
+}
+
+int Camera::getGeometryModuleGap() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getGeometryModuleGap();
+}
+
+void Camera::setClientFlatFieldCorrection(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  // the frame size does not change, it can be toggled between two frames
+  if (flag && !m_processing.hasWhiteImage())
+    THROW_HW_ERROR(Error) << "No white image loaded, see loadWhiteImage";
+  m_processing.setFlatField(flag);
+  if (flag && m_flat_field_correction_flag)
+    setFlatFieldCorrectionFlag(0);
+}
+
+bool Camera::getClientFlatFieldCorrection() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getFlatField();
+}
+
+void Camera::loadWhiteImage(std::string fileName) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(fileName);
+
+  // the server sends the modules read out
+  if (m_roi_module_mask)
+    THROW_HW_ERROR(Error) << "Cannot read a white image with a hardware roi";
+
+  Size size;
+  getRawImageSize(size);
+  size_t nb_pixels = size_t(size.getWidth()) * size.getHeight();
+
+  // the image depends on the modules enabled when it is read
+  stringstream key;
+  key << fileName << ":" << m_module_mask;
+  std::vector<int32_t>& white = m_white_cache[key.str()];
+
+  if (white.size() != nb_pixels) {
+    stringstream cmd;
+    cmd << "ReadWhiteImage " << fileName;
+    m_xpad->sendNoWait(cmd.str());
+
+    std::vector<char> data;
+    if (m_xpad->receiveData(data, nb_pixels * sizeof(int32_t))) {
+      m_white_cache.erase(key.str());
+      THROW_HW_ERROR(Error) << "Reading white image " << fileName << " FAILED for "
+			    << size << ": " << m_xpad->getErrorMessage();
+    }
+    white.resize(nb_pixels);
+    memcpy(&white[0], &data[0], data.size());
+    DEB_TRACE() << "White image " << fileName << " read from the server";
+  }
+
+  m_processing.setWhiteImage(white, size);
+  m_white_image = fileName;
+}
+
+std::string Camera::getLoadedWhiteImage() {
+  DEB_MEMBER_FUNCT();
+
+  return m_white_image;
+}
+
+void Camera::clearWhiteImageCache() {
+  DEB_MEMBER_FUNCT();
+
+  m_white_cache.clear();
+}
+
+void Camera::loadDeadNoisyMask() {
+  DEB_MEMBER_FUNCT();
+
+  if (m_roi_module_mask)
+    THROW_HW_ERROR(Error) << "Cannot read the pixel mask with a hardware roi";
+
+  Size size;
+  getRawImageSize(size);
+  size_t nb_pixels = size_t(size.getWidth()) * size.getHeight();
+
+  // one 32 bit value per raw pixel, not 0 for a dead or noisy pixel
+  m_xpad->sendNoWait("ReadDeadNoisyMask");
+  std::vector<char> data;
+  if (m_xpad->receiveData(data, nb_pixels * sizeof(int32_t)))
+    THROW_HW_ERROR(Error) << "Reading the dead/noisy pixel mask FAILED for "
+			  << size << ": " << m_xpad->getErrorMessage();
+
+  const int32_t *mask = (const int32_t *) &data[0];
+  std::vector<int32_t> pixels;
+  for (size_t i = 0; i < nb_pixels; i++)
+    if (mask[i])
+      pixels.push_back(i);
+  m_processing.setPixelMask(pixels, size);
+  DEB_TRACE() << pixels.size() << " dead/noisy pixels read from the server";
+}
+
+int Camera::getNbMaskedPixels() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getNbMaskedPixels();
+}
+
+void Camera::setClientPixelMaskMode(int mode) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(mode);
+
+  if (mode < Processing::MaskOff || mode > Processing::MaskInterpolate)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(mode);
+  // the frame size does not change, it can be changed between two frames
+  m_processing.setMaskMode(Processing::MaskMode(mode));
+  if (mode != Processing::MaskOff &&
+      (m_noisy_pixel_correction_flag || m_dead_pixel_correction_flag))
+    setDeadNoisyPixelCorrectionFlag(0);
+}
+
+int Camera::getClientPixelMaskMode() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getMaskMode();
+}
+
+void Camera::setPixelMaskSentinel(int value) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(value);
+
+  m_processing.setMaskSentinel(value);
+}
+
+int Camera::getPixelMaskSentinel() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getMaskSentinel();
+}
+
+void Camera::setPileUpCorrection(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  if (flag) {
+    std::vector<double> dead_times;
+    m_processing.getPileUpDeadTimes(dead_times);
+    if (dead_times.empty())
+      THROW_HW_ERROR(Error) << "No dead time set, see setPileUpDeadTime";
+  }
+  m_processing.setPileUp(flag);
+}
+
+bool Camera::getPileUpCorrection() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getPileUp();
+}
+
+void Camera::setPileUpDeadTime(double dead_time_ns) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(dead_time_ns);
+
+  m_processing.setPileUpDeadTimes(std::vector<double>(1, dead_time_ns * 1e-9));
+}
+
+double Camera::getPileUpDeadTime() {
+  DEB_MEMBER_FUNCT();
+
+  // the mean of the table when set per chip or per pixel
+  std::vector<double> dead_times;
+  m_processing.getPileUpDeadTimes(dead_times);
+  double sum = 0;
+  for (size_t i = 0; i < dead_times.size(); i++)
+    sum += dead_times[i];
+  return dead_times.empty()? 0: sum / dead_times.size() * 1e9;
+}
+
+void Camera::setPileUpDeadTimes(const std::vector<double>& dead_times_ns) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(dead_times_ns.size());
+
+  std::vector<double> dead_times(dead_times_ns);
+  for (size_t i = 0; i < dead_times.size(); i++)
+    dead_times[i] *= 1e-9;
+  m_processing.setPileUpDeadTimes(dead_times);
+}
+
+void Camera::setPileUpScale(int scale) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(scale);
+
+  m_processing.setPileUpScale(scale);
+}
+
+int Camera::getPileUpScale() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getPileUpScale();
+}
+
+double Camera::getPileUpTime() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getPileUpTime();
+}
+
+void Camera::setFrameStatistics(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_frame_statistics = flag;
+}
+
+bool Camera::getFrameStatistics() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_statistics;
+}
+
+void Camera::setFrameStatsNbRecords(int nb_records) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_records);
+
+  m_stats_ring.setNbRecords(nb_records);
+}
+
+int Camera::getFrameStatsNbRecords() {
+  DEB_MEMBER_FUNCT();
+
+  return m_stats_ring.getNbRecords();
+}
+
+void Camera::setSaturationLevel(int level) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(level);
+
+  m_stats_calc.setSaturation(level);
+}
+
+int Camera::getSaturationLevel() {
+  DEB_MEMBER_FUNCT();
+
+  return m_stats_calc.getSaturation();
+}
+
+int Camera::getLastFrameStatsNb() {
+  DEB_MEMBER_FUNCT();
+
+  return m_stats_ring.getLastFrameNb();
+}
+
+bool Camera::getFrameStats(int frame_nb, FrameStats& stats) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_nb);
+
+  return m_stats_ring.get(frame_nb, stats);
+}
+
+bool Camera::isDecodeStatsActive() {
+  return m_frame_statistics || m_roi_counters.getNbRois() > 0 || m_stats_calc.getSparseEvents();
+}
+
+void Camera::storeFrameStats(const FrameStats& stats, int counter_frame_nb) {
+  if (m_frame_statistics)
+    m_stats_ring.put(stats);
+  if (!stats.roi_sums.empty())
+    m_roi_counters.put(counter_frame_nb, &stats.roi_sums[0]);
+  if (m_stats_calc.getSparseEvents())
+    m_sparse_writer.write(counter_frame_nb, stats.events);
+}
+
+void Camera::setSparseOutput(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  checkProcessingChange(true);
+  m_sparse_output = flag;
+}
+
+bool Camera::getSparseOutput() {
+  DEB_MEMBER_FUNCT();
+
+  return m_sparse_output;
+}
+
+void Camera::setSparseThreshold(int threshold) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(threshold);
+
+  m_stats_calc.setSparseThreshold(threshold);
+}
+
+int Camera::getSparseThreshold() {
+  DEB_MEMBER_FUNCT();
+
+  return m_stats_calc.getSparseThreshold();
+}
+
+void Camera::setSparseFilePrefix(const std::string& prefix) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(prefix);
+
+  checkProcessingChange(true);
+  m_sparse_writer.setFilePrefix(prefix);
+}
+
+std::string Camera::getSparseFilePrefix() {
+  DEB_MEMBER_FUNCT();
+
+  return m_sparse_writer.getFilePrefix();
+}
+
+std::string Camera::getSparseFileName() {
+  DEB_MEMBER_FUNCT();
+
+  return m_sparse_writer.getFileName();
+}
+
+double Camera::getSparseCompressionRatio(int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
+  return m_sparse_writer.getRatio(frame_nb);
+}
+
+double Camera::getSparseMeanCompressionRatio() {
+  DEB_MEMBER_FUNCT();
+
+  return m_sparse_writer.getMeanRatio();
+}
+
+int Camera::addRoiCounter(const Roi& roi) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(roi);
+
+  checkProcessingChange(true);
+  return m_roi_counters.addRoi(roi);
+}
+
+int Camera::addMaskRoiCounter(const std::vector<int32_t>& pixels, int width) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(pixels.size(), width);
+
+  checkProcessingChange(true);
+  return m_roi_counters.addMaskRoi(pixels, width);
+}
+
+void Camera::clearRoiCounters() {
+  DEB_MEMBER_FUNCT();
+
+  checkProcessingChange(true);
+  m_roi_counters.clearRois();
+}
+
+int Camera::getNbRoiCounters() {
+  DEB_MEMBER_FUNCT();
+
+  return m_roi_counters.getNbRois();
+}
+
+void Camera::setRoiCountersNbRecords(int nb_records) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_records);
+
+  checkProcessingChange(true);
+  m_roi_counters.setNbRecords(nb_records);
+}
+
+int Camera::getRoiCountersNbRecords() {
+  DEB_MEMBER_FUNCT();
+
+  return m_roi_counters.getNbRecords();
+}
+
+int Camera::getLastRoiCountersFrameNb() {
+  DEB_MEMBER_FUNCT();
+
+  return m_roi_counters.getLastFrameNb();
+}
+
+int Camera::readRoiCounters(int first_frame, int nb_frames, std::vector<long long>& data) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(first_frame, nb_frames);
+
+  return m_roi_counters.read(first_frame, nb_frames, data);
+}
+
+bool Camera::isProcessingFrames() {
+  // float frames cannot be copied as received
+  return m_processing.isActive() || m_float_output;
+}
+
+void Camera::setProcessingThreads(int nb_threads) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_threads);
+
+  m_processing.setNbThreads(nb_threads);
+}
+
+int Camera::getProcessingThreads() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getNbThreads();
+}
+
+void Camera::updateImageSize() {
+  DEB_MEMBER_FUNCT();
+
+  Size size;
+  getImageSize(size);
+  m_image_size = size;
+  ImageType pixel_depth;
+  getImageType(pixel_depth);
+  maxImageSizeChanged(m_image_size, pixel_depth);
+}
+
+double Camera::getProcessingTime() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getProcessingTime();
+}
+
+int Camera::getLiveFramesShown() {
+  DEB_MEMBER_FUNCT();
+
+  return (m_nb_frames == 0)? m_acq_frame_nb: 0;
+}
+
+int Camera::getLiveFramesSkipped() {
+  DEB_MEMBER_FUNCT();
+
+  return m_live_frames_skipped;
+}
+
+int Camera::getLiveRearms() {
+  DEB_MEMBER_FUNCT();
+
+  return m_live_rearms;
+}
+
+
+void Camera::AcqThread::threadFunction()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cam.m_cond.mutex());
+  //StdBufferCbMgr& buffer_mgr = m_cam.m_buffer_ctrl_obj.getBuffer();
+        
+  StdBufferCbMgr& buffer_mgr = m_cam.m_bufferCtrlObj.getBuffer();
+
+  m_cam.m_acq_tid = syscall(SYS_gettid);
+  // the node of the cpus the thread is pinned to, else the current one
+  int numa_node = -1;
+  try
+    {
+      numa_node = m_cam.setThreadScheduling(m_cam.m_acq_tid, m_cam.m_acq_thread_cpus, m_cam.m_acq_rt_priority);
+    }
+  catch (Exception& e)
+    {
+      DEB_ERROR() << e.getErrMsg();
+    }
+  m_cam.m_acq_numa_node = (numa_node >= 0)? numa_node: XpadBufferAllocMgr::getCurrentNumaNode();
+
+  while (1)
+    {
+      while (m_cam.m_wait_flag || m_cam.m_quit)
+	{
+	  DEB_TRACE() << "Acquisition thread waiting...";
+	  DEB_TRACE() << "wait flag value = " << m_cam.m_wait_flag;
+	  DEB_TRACE() << "quit flag value = " << m_cam.m_quit;
+	  m_cam.m_thread_running = false;
+	  m_cam.m_cond.broadcast();
+	  //aLock.unlock();
+	  m_cam.m_cond.wait();
+	}
+
+      DEB_TRACE() << "Acqisition thread running...";
+      m_cam.m_thread_running = true;
+      m_cam.m_cond.broadcast();
+      aLock.unlock();
+
+      switch (m_cam.m_process_id)
+	{
+	case 0:
+	  {  //startAcq()
+
+	    DEB_TRACE() << "Starting to acquire images...";
+
+	    if (m_cam.m_quit == false)
+	      {
+		m_cam.sendExposeCommand();
+		m_cam.startFramePublish();
+
+		bool continueFlag = true;
+		int ret = 0;
+
+		if (m_cam.m_image_transfer_flag == 1)
+		  {
+		    // live mode: the detector is re-armed once the last frame of
+		    // each segment of LIVE_SEGMENT_FRAMES frames is read, until
+		    // stopAcq()
+		    bool live = (m_cam.m_nb_frames == 0);
+		    bool rearmed = false;
+
+		    while (1)
+		      {
+			while (continueFlag && !m_cam.isSegmentEnd())
+			  {
+
+			    DEB_TRACE() << m_cam.m_acq_frame_nb;
+			    if (!m_cam.flushFramesIfIdle())
+			      {
+				continueFlag = false;
+				break;
+			      }
+			    void *bptr = m_cam.getReceiveBuffer(m_cam.m_acq_frame_nb);
+
+			    ret = m_cam.readFrameExpose(bptr, m_cam.m_acq_frame_nb);
+
+			    if ( ret == 0 )
+			      {
+				++m_cam.m_live_segment_frames;
+				// the next segment armed before this one is drained
+				if (live && m_cam.isSegmentEnd())
+				  rearmed = m_cam.rearmLive();
+				m_cam.recordFrameInterval();
+				// every frame is written, shown in live mode or not
+				m_cam.writeRawFrame(bptr);
+				m_cam.writeChunkFrame(bptr);
+				m_cam.publishRingFrame(bptr);
+				if (!m_cam.m_quit) {
+				  // a frame not shown is overwritten by the next one
+				  if (live && !m_cam.isLiveFrameShown())
+				    continue;
+
+				  continueFlag = m_cam.commitReceivedFrame(m_cam.m_acq_frame_nb);
+				  DEB_TRACE() << "acqThread::threadFunction() newframe ready ";
+
+				  ++m_cam.m_acq_frame_nb;
+
+				  DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
+				}
+				else {
+				  continueFlag = false;
+				  DEB_TRACE() << "Acq. Quit  detected";
+				}
+			      }
+			    else
+			      {
+				continueFlag = false;
+				DEB_TRACE() << "ABORT detected";
+			      }
+			  }
+			if (continueFlag)
+			  continueFlag = m_cam.drainSpill(m_cam.m_spill.getDepth());
+			// the server keeps sending: stay in sync with it
+			if (!continueFlag && ret == 0 && !m_cam.m_quit)
+			  m_cam.discardFrames();
+			if (!m_cam.flushFrames())
+			  continueFlag = false;
+			m_cam.getDataExposeReturn();
+
+			if (rearmed)
+			  {
+			    rearmed = false;
+			    m_cam.startLiveSegment();
+			    if (ret != 0 || !continueFlag)
+			      {
+				// stopping: the segment already armed is read
+				// aside to stay in sync with the server
+				if (!m_cam.m_quit)
+				  m_cam.discardFrames();
+				m_cam.getDataExposeReturn();
+				break;
+			      }
+			  }
+			// only a segment read to its end is followed by the next one
+			else if (ret != 0 || !continueFlag || live || !m_cam.rearmSequence())
+			  break;
+			// the re-arm dead time is not a frame interval
+			m_cam.m_frame_interval_ts = Timestamp();
+			continueFlag = true;
+		      }
+		    m_cam.updatePixelDepth();
+		  }
+		else
+		  {
+
+		    DEB_TRACE() << m_cam.m_acq_frame_nb;
+		    DEB_TRACE() << m_cam.m_image_size.getWidth() << " " << m_cam.m_image_size.getHeight();
+
+		    // with a worker pool, files are ingested out of order and
+		    // published here in frame order through the reorder window
+		    bool ingest_pool = !m_cam.m_ingest_threads.empty();
+		    if (ingest_pool)
+		      m_cam.startFileIngest();
+
+		    while (continueFlag && (m_cam.m_nb_frames == 0 || m_cam.m_acq_frame_nb < m_cam.m_nb_frames) && m_cam.m_quit == false)
+		      {
+			if (ingest_pool)
+			  ret = m_cam.waitIngestedFrame(m_cam.m_acq_frame_nb) ? 0 : -1;
+			else
+			  {
+			    void *bptr = buffer_mgr.getFrameBufferPtr(m_cam.m_acq_frame_nb);
+			    ret = m_cam.readFrameFile(bptr, m_cam.m_acq_frame_nb);
+			  }
+
+			if (ret != 0)
+			  break;
+
+			m_cam.recordFrameInterval();
+			continueFlag = m_cam.publishFrame(m_cam.m_acq_frame_nb);
+			//DEB_TRACE() << "acqThread::threadFunction() newframe ready ";
+			++m_cam.m_acq_frame_nb;
+
+			DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
+		      }
+
+		    m_cam.flushFrames();
+		    if (ingest_pool)
+		      m_cam.stopFileIngest();
+		  }
+		m_cam.m_sparse_writer.close();
+		m_cam.m_raw_writer.close();
+		m_cam.m_chunk_writer.close();
+	      }
+
+	    break;
+	  }
+	case 1:
+	  { //CalibrationOTN
+	    int ret;
+	    stringstream cmd;
+
+	    cmd <<  "CalibrationOTN " << m_cam.m_calibration_configuration;
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+
+	    if (ret == 0)
+	      DEB_TRACE() << "Calibration Over-The-Noise finished SUCCESFULLY";
+	    else if (ret == 1)
+	      DEB_TRACE() << "Calibration Over-The-Noise was ABORTED";
+	    else
+	      throw LIMA_HW_EXC(Error, "Calibration Over The Noise FAILED!");
+
+	    break;
+	  }
+	case 2:
+	  { //CalibrationOTNPulse
+	    int ret;
+	    stringstream cmd;
+
+	    cmd <<  "CalibrationOTNPulse " << m_cam.m_calibration_configuration;
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+
+	    if (ret == 0)
+	      DEB_TRACE() << "Calibration Over-The-Noise with PULSE finished SUCCESFULLY";
+	    else if (ret == 1)
+	      DEB_TRACE() << "Calibration Over-The-Noise was ABORTED";
+	    else
+	      throw LIMA_HW_EXC(Error, "Calibration Over The Noise with PULSE FAILED!");
+
+	    break;
+
+	  }
+	case 3:
+	  { //CalibrationBEAM
+	    int ret;
+	    stringstream cmd;
+
+	    cmd <<  "CalibrationBEAM " << m_cam.m_time << " " << m_cam.m_ITHL_max << " " << m_cam.m_calibration_configuration;
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
 
 	    if (ret == 0)
 	      DEB_TRACE() << "Calibration BEAM finished SUCCESFULLY";
 	    else if (ret == 1)
 	      DEB_TRACE() << "Calibration BEAM was ABORTED";
 	    else
-	      throw LIMA_HW_EXC(Error, "Calibration BEAM FAILED!");
+	      throw LIMA_HW_EXC(Error, "Calibration BEAM FAILED!");
+
+	    break;
+
+	  }
+	case 4:
+	  { //loadCalibrationFromFile
+	    int ret1;
+
+	    size_t pos = m_cam.m_file_path.find(".cf");
+
+	    if (pos == string::npos)
+	      {
+		m_cam.m_file_path.append(".cfg");
+		pos = m_cam.m_file_path.length() - 4;
+	      }
+
+	    m_cam.m_file_path.replace(pos, 4, ".cfg");
+	    ret1 = m_cam.loadConfigGFromFile((char *) m_cam.m_file_path.c_str());
+
+	    if (ret1 == 0)
+	      {
+		m_cam.m_file_path.replace(pos, 4, ".cfl");
+		m_cam.loadConfigLFromFile((char *) m_cam.m_file_path.c_str());
+	      }
+
+	    break;
+	  }
+	case 5:
+	  { //saveCalibrationToFile
+	    int ret1;
+
+	    size_t pos = m_cam.m_file_path.find(".cf");
+
+	    if (pos == string::npos)
+	      {
+		m_cam.m_file_path.append(".cfg");
+		pos = m_cam.m_file_path.length() - 4;
+	      }
+	    m_cam.m_file_path.replace(pos, 4, ".cfg");
+	    ret1 = m_cam.saveConfigGToFile((char *) m_cam.m_file_path.c_str());
+
+	    if (ret1 == 0)
+	      {
+		m_cam.m_file_path.replace(pos, 4, ".cfl");
+		m_cam.saveConfigLToFile((char *) m_cam.m_file_path.c_str());
+	      }
+
+	    break;
+	  }
+	case 6:
+	  { //Load Default Config G values
+	    string ret;
+	    stringstream cmd;
+	    int value, regid;
+
+	    for (int i = 0; i < 7; i++)
+	      {
+		switch (i)
+		  {
+		  case 0: regid = AMPTP;
+		    value = 0;
+		    break;
+		  case 1: regid = IMFP;
+		    value = 50;
+		    break;
+		  case 2: regid = IOTA;
+		    value = 40;
+		    break;
+		  case 3: regid = IPRE;
+		    value = 60;
+		    break;
+		  case 4: regid = ITHL;
+		    value = 25;
+		    break;
+		  case 5: regid = ITUNE;
+		    value = 100;
+		    break;
+		  case 6: regid = IBUFF;
+		    value = 0;
+		    break;
+		  }
+
+		string register_name;
+		switch (regid)
+		  {
+		  case 31: register_name = "AMPTP";
+		    break;
+		  case 59: register_name = "IMFP";
+		    break;
+		  case 60: register_name = "IOTA";
+		    break;
+		  case 61: register_name = "IPRE";
+		    break;
+		  case 62: register_name = "ITHL";
+		    break;
+		  case 63: register_name = "ITUNE";
+		    break;
+		  case 64: register_name = "IBUFF";
+		    break;
+		  default: register_name = "ITHL";
+		    break;
+		  }
+
+		cmd.str(string());
+		cmd << "LoadConfigG " << register_name << " " << value ;
+		m_cam.m_xpad->sendWait(cmd.str(), ret);
+	      }
+
+	    if (ret.length() > 1)
+	      DEB_TRACE() << "Loading global configuratioin with values:\nAMPTP = 0, IMFP = 50, IOTA = 40, IPRE = 60, ITHL = 25, ITUNE = 100, IBUFF = 0";
+	    else
+	      throw LIMA_HW_EXC(Error, "Loading default global configuration values FAILED!");
+
+	    break;
+	  }
+	case 7:
+	  { //ITHL Increase
+	    int ret;
+	    stringstream cmd;
+
+	    cmd.str(string());
+	    cmd << "ITHLIncrease";
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+
+	    if (!ret)
+	      DEB_TRACE() << "ITHL was increased SUCCESFULLY";
+	    else
+	      throw LIMA_HW_EXC(Error, "ITHL increase FAILED!");
+
+	    break;
+	  }
+	case 8:
+	  {  //ITHL Decrease
+	    int ret;
+	    stringstream cmd;
+
+	    cmd.str(string());
+	    cmd << "ITHLDecrease";
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+
+	    if (!ret)
+	      DEB_TRACE() << "ITHL was decreased SUCCESFULLY";
+	    else
+	      throw LIMA_HW_EXC(Error, "ITHL decrease FAILED!");
+
+	    break;
+	  }
+	case 9:
+	  {  //LoadFloatConfigL
+	    int ret;
+	    stringstream cmd;
+
+	    cmd.str(string());
+	    cmd <<  "LoadFlatConfigL " << " " << m_cam.m_flat_value;
+	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+
+	    if (!ret)
+	      DEB_TRACE() << "Loading local configurations values, with flat value: " <<  m_cam.m_flat_value << " -> OK" ;
+	    else
+	      throw LIMA_HW_EXC(Error, "Loading local configuratin with FLAT value FAILED!");
+
+	    break;
+	  }
+	}
+      // calibrations and tests change the server exposure parameters
+      if (m_cam.m_process_id != 0)
+	m_cam.m_exposure_params.clear();
+      aLock.lock();
+      m_cam.m_quit = false;
+      m_cam.m_wait_flag = true;
+      m_cam.m_cond.broadcast();
+    }
+
+  DEB_TRACE() << "Acquisition thread finished";
+}
+
+
+
+Camera::AcqThread::AcqThread(Camera& cam) :
+m_cam(cam) {
+  AutoMutex aLock(m_cam.m_cond.mutex());
+  m_cam.m_wait_flag = true;
+  m_cam.m_quit = false;
+  m_cam.m_cond.broadcast();
+  aLock.unlock();
+  pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Camera::AcqThread::~AcqThread() {
+  AutoMutex aLock(m_cam.m_cond.mutex());
+  m_cam.m_quit = true;
+  m_cam.m_cond.broadcast();
+  aLock.unlock();
+}
+
+void Camera::FileIngestThread::threadFunction()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cam.m_ingest_cond.mutex());
+  ++m_cam.m_ingest_running;
+  m_cam.m_ingest_cond.broadcast();
+
+  pid_t tid = syscall(SYS_gettid);
+  m_cam.m_ingest_tids.push_back(tid);
+  try
+    {
+      m_cam.setThreadScheduling(tid, m_cam.m_ingest_thread_cpus, m_cam.m_acq_rt_priority);
+    }
+  catch (Exception& e)
+    {
+      DEB_ERROR() << e.getErrMsg();
+    }
+
+  StdBufferCbMgr& buffer_mgr = m_cam.m_bufferCtrlObj.getBuffer();
+
+  while (!m_cam.m_ingest_exit)
+    {
+      int window = m_cam.m_ingest_slots.size();
+      int frame_nb = m_cam.m_ingest_next_frame;
+
+      // claim the next frame only if it fits in the reorder window
+      if (!m_cam.m_ingest_active || m_cam.m_quit ||
+	  (m_cam.m_nb_frames != 0 && frame_nb >= m_cam.m_nb_frames) ||
+	  frame_nb >= m_cam.m_ingest_publish_frame + window)
+	{
+	  m_cam.m_ingest_cond.wait();
+	  continue;
+	}
+
+      ++m_cam.m_ingest_next_frame;
+      ++m_cam.m_ingest_busy;
+      aLock.unlock();
+
+      void *bptr = buffer_mgr.getFrameBufferPtr(frame_nb);
+      int ret = m_cam.readFrameFile(bptr, frame_nb);
+
+      aLock.lock();
+      --m_cam.m_ingest_busy;
+      if (ret == 0)
+	{
+	  m_cam.m_ingest_slots[frame_nb % window] = frame_nb;
+	  if (++m_cam.m_ingest_occupancy > m_cam.m_ingest_max_occupancy)
+	    m_cam.m_ingest_max_occupancy = m_cam.m_ingest_occupancy;
+	}
+      else if (m_cam.m_ingest_active)
+	m_cam.m_ingest_failed = true;
+      m_cam.m_ingest_cond.broadcast();
+    }
+
+  std::vector<pid_t>& tids = m_cam.m_ingest_tids;
+  tids.erase(std::find(tids.begin(), tids.end(), tid));
+  --m_cam.m_ingest_running;
+  m_cam.m_ingest_cond.broadcast();
+  DEB_TRACE() << "File ingest thread finished";
+}
+
+Camera::FileIngestThread::FileIngestThread(Camera& cam) :
+m_cam(cam) {
+  pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Camera::FileIngestThread::~FileIngestThread() {
+}
+
+int Camera::readFrameFile(void *bptr, int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
+  uint numData = m_image_size.getWidth() * m_image_size.getHeight();
+  bool ingest_pool = !m_ingest_threads.empty();
+
+  stringstream fileName;
+  fileName << "/opt/cegitek/tmp_corrected/burst_" << m_burstNumber << "_image_" << frame_nb << ".bin";
+
+  // the server may still be writing the file: wait for its full size
+  size_t file_size = numData * sizeof (int32_t);
+  struct stat file_stat;
+  while (stat( fileName.str().c_str(), &file_stat ) != 0 || size_t(file_stat.st_size) < file_size)
+    {
+      if (m_quit || (ingest_pool && !m_ingest_active))
+	{
+	  DEB_TRACE() << "ABORT detected";
+	  return -1;
+	}
+      // do not burn the core of the acq. thread or of each ingest worker
+      usleep(FILE_POLL_USEC);
+    }
+
+  ifstream file(fileName.str().c_str(), ios::in | ios::binary);
+  if (!file.is_open())
+    {
+      DEB_ERROR() << "Cannot open " << fileName.str();
+      return -1;
+    }
+  DEB_TRACE() << "OPEN FILE : " << fileName.str();
+
+  // with several ingest threads, one record per call
+  FrameStats stats;
+  bool with_stats = isDecodeStatsActive();
+  stats.reset(frame_nb);
+
+  vector<int32_t> buffer_int;
+  char *data = (char *) bptr;
+  if (m_pixel_depth == Camera::B2)
+    {
+      buffer_int.resize(numData);
+      data = (char *) &buffer_int[0];
+    }
+  file.read(data, file_size);
+  if (size_t(file.gcount()) != file_size)
+    {
+      DEB_ERROR() << "Short read of " << fileName.str() << ": " << file.gcount()
+		  << " bytes, " << file_size << " expected";
+      return -1;
+    }
+  file.close();
+
+  if (m_pixel_depth == Camera::B2)
+    {
+      int16_t *buffer_short = (int16_t *) bptr;
+      if (with_stats)
+	m_stats_calc.add(stats, &buffer_int[0], m_image_size, buffer_short);
+      else
+	for (uint i = 0; i < numData; i++)
+	  buffer_short[i] = (uint16_t) (buffer_int[i]);
+    }
+  else if (with_stats)
+    m_stats_calc.add(stats, (const int32_t *) bptr, m_image_size);
+  if (with_stats)
+    storeFrameStats(stats, frame_nb);
+
+  remove(fileName.str().c_str());
+
+  return 0;
+}
+
+int Camera::getNbBufferFrames() {
+  DEB_MEMBER_FUNCT();
+
+  int nb_buffers, nb_concat_frames;
+  m_bufferCtrlObj.getNbBuffers(nb_buffers);
+  m_bufferCtrlObj.getNbConcatFrames(nb_concat_frames);
+  return nb_buffers * nb_concat_frames;
+}
+
+void Camera::startFramePublish() {
+  DEB_MEMBER_FUNCT();
+
+  // pending frames hold their buffers: keep half of the ring for acquisition
+  m_publish_batch_size = std::max(1, std::min(m_publish_batch, getNbBufferFrames() / 2));
+  m_publish_pending.clear();
+  m_publish_pending.reserve(m_publish_batch_size);
+  m_bufferCtrlObj.getBuffer().getStartTimestamp(m_publish_start_ts);
+  DEB_TRACE() << DEB_VAR1(m_publish_batch_size);
+}
+
+bool Camera::publishFrame(int frame_nb, const Timestamp& timestamp) {
+  DEB_MEMBER_FUNCT();
+
+  // frames are timestamped when received, not when handed to LIMA
+  Timestamp now = Timestamp::now();
+  Timestamp received = timestamp.isSet()? timestamp: now;
+  if (frame_nb == 0)
+    m_first_frame_latency = (received - m_expose_timestamp) * 1e3;
+  if (m_publish_pending.empty())
+    m_publish_batch_ts = now;
+
+  HwFrameInfoType frame_info;
+  frame_info.acq_frame_nb = frame_nb;
+  frame_info.frame_timestamp = received - m_publish_start_ts;
+  m_publish_pending.push_back(frame_info);
+
+  if (int(m_publish_pending.size()) >= m_publish_batch_size ||
+      (now - m_publish_batch_ts) * 1e3 >= m_publish_max_delay)
+    return flushFrames();
+  return true;
+}
+
+bool Camera::flushFrames() {
+  DEB_MEMBER_FUNCT();
+
+  StdBufferCbMgr& buffer_mgr = m_bufferCtrlObj.getBuffer();
+  XpadBufferAllocMgr& alloc_mgr = m_bufferCtrlObj.getAllocMgr();
+  bool continueFlag = true;
+
+  // frames received after a stop request are not published
+  if (!m_quit)
+    for (size_t i = 0; continueFlag && i < m_publish_pending.size(); i++)
+      {
+	continueFlag = buffer_mgr.newFrameReady(m_publish_pending[i]);
+	alloc_mgr.setLastFrame(m_publish_pending[i].acq_frame_nb);
+	m_last_frame_published = m_publish_pending[i].acq_frame_nb;
+      }
+  m_publish_pending.clear();
+  return continueFlag;
+}
+
+bool Camera::flushFramesIfIdle() {
+  DEB_MEMBER_FUNCT();
+
+  // between triggers no frame comes to flush the batch: wait for the next
+  // one no longer than the max. delay left
+  if (m_publish_pending.empty())
+    return true;
+  double remaining = m_publish_max_delay - (Timestamp::now() - m_publish_batch_ts) * 1e3;
+  if (remaining > 0 && m_xpad->waitData(int(ceil(remaining))) != 0)
+    return true;
+  DEB_TRACE() << "Flushing " << m_publish_pending.size() << " frames on max. delay";
+  return flushFrames();
+}
+
+bool Camera::isLimaBufferFree(int frame_nb) {
+  // LIMA reports an overrun once a frame is more than a ring ahead of the
+  // last one released
+  return frame_nb - m_last_frame_released < m_spill_buffer_frames;
+}
+
+void *Camera::getReceiveBuffer(int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
+  // live mode: a frame with no LIMA buffer released for it is read aside
+  // and not shown; without the releases reported, only the rate is limited
+  m_live_buffer_free = m_nb_frames != 0 || !m_release_reporting || isLimaBufferFree(frame_nb);
+  if (!m_live_buffer_free) {
+    FrameDim frame_dim;
+    m_bufferCtrlObj.getFrameDim(frame_dim);
+    m_spill_write = false;
+    m_discard_frame.resize(frame_dim.getMemSize());
+    return &m_discard_frame[0];
+  }
+
+  // once a frame is spilled, the next ones follow it through the spill file
+  m_spill_write = m_spill_active && (!m_spill.empty() || !isLimaBufferFree(frame_nb));
+  if (!m_spill_write)
+    return m_bufferCtrlObj.getBuffer().getFrameBufferPtr(frame_nb);
+  if (m_spill.full()) {
+    // stopping: the frame is not published
+    m_spill_write = false;
+    m_discard_frame.resize(m_spill.getFrameSize());
+    return &m_discard_frame[0];
+  }
+  return m_spill.getWriteSlot();
+}
+
+bool Camera::commitReceivedFrame(int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
+  if (!m_spill_write)
+    return publishFrame(frame_nb);
+
+  m_spill.push(frame_nb, Timestamp::now());
+  ++m_spilled_frames;
+  m_spill_max_depth = std::max(m_spill_max_depth, m_spill.getDepth());
+  DEB_TRACE() << "Frame " << frame_nb << " spilled, " << DEB_VAR1(m_spill.getDepth());
+
+  // no slot left for the next frame: the reads wait for LIMA and the
+  // server is held back by the socket
+  return drainSpill(m_spill.full()? 1: 0);
+}
+
+bool Camera::drainSpill(int nb_wait) {
+  DEB_MEMBER_FUNCT();
+
+  StdBufferCbMgr& buffer_mgr = m_bufferCtrlObj.getBuffer();
+  int nb_drained = 0;
+  while (!m_spill.empty())
+    {
+      int frame_nb;
+      Timestamp timestamp;
+      void *frame = m_spill.front(frame_nb, timestamp);
+      if (!isLimaBufferFree(frame_nb))
+	{
+	  if (nb_drained >= nb_wait || m_quit)
+	    break;
+	  // the frames of a pending batch must reach LIMA to be released
+	  if (!flushFrames())
+	    return false;
+	  usleep(SPILL_POLL_USEC);
+	  continue;
+	}
+      memcpy(buffer_mgr.getFrameBufferPtr(frame_nb), frame, m_spill.getFrameSize());
+      m_spill.pop();
+      ++m_drained_frames;
+      ++nb_drained;
+      if (!publishFrame(frame_nb, timestamp))
+	return false;
+    }
+  return true;
+}
+
+void Camera::discardFrames() {
+  DEB_MEMBER_FUNCT();
+
+  DEB_WARNING() << "LIMA does not take frames any more, frame " << m_acq_frame_nb
+		<< " and next ones read and discarded";
+  FrameDim frame_dim;
+  m_bufferCtrlObj.getFrameDim(frame_dim);
+  m_discard_frame.resize(frame_dim.getMemSize());
+  while (!isSegmentEnd() && !m_quit &&
+	 readFrameExpose(&m_discard_frame[0], m_acq_frame_nb) == 0)
+    {
+      ++m_live_segment_frames;
+      writeRawFrame(&m_discard_frame[0]);
+      writeChunkFrame(&m_discard_frame[0]);
+      publishRingFrame(&m_discard_frame[0]);
+      ++m_acq_frame_nb;
+      ++m_discarded_frames;
+    }
+}
+
+void Camera::writeRawFrame(const void *frame) {
+  if (m_raw_output)
+    m_raw_writer.put(frame, Timestamp::now() - m_publish_start_ts);
+}
+
+void Camera::setRawOutput(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  checkProcessingChange(true);
+  m_raw_output = flag;
+}
+
+bool Camera::getRawOutput() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_output;
+}
+
+void Camera::setRawFilePrefix(const std::string& prefix) {
+  DEB_MEMBER_FUNCT();
+
+  m_raw_writer.setFilePrefix(prefix);
+}
+
+std::string Camera::getRawFilePrefix() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getFilePrefix();
+}
+
+void Camera::setRawFileSize(long long size) {
+  DEB_MEMBER_FUNCT();
+
+  m_raw_writer.setFileSize(size);
+}
+
+long long Camera::getRawFileSize() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getFileSize();
+}
+
+void Camera::setRawQueueFrames(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+
+  m_raw_writer.setQueueFrames(nb_frames);
+}
+
+int Camera::getRawQueueFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getQueueFrames();
+}
+
+std::string Camera::getRawIndexFileName() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getIndexFileName();
+}
+
+int Camera::getRawFramesWritten() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getNbFramesWritten();
+}
+
+int Camera::getRawFramesDropped() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getNbFramesDropped();
+}
+
+int Camera::getRawMaxQueueDepth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getMaxQueueDepth();
+}
+
+double Camera::getRawWriteRate() {
+  DEB_MEMBER_FUNCT();
+
+  return m_raw_writer.getWriteRate();
+}
+
+void Camera::writeChunkFrame(const void *frame) {
+  if (m_hdf5_output)
+    m_chunk_writer.put(frame);
+}
+
+void Camera::setHdf5Output(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  if (flag && !ChunkWriter::isAvailable())
+    THROW_HW_ERROR(NotSupported) << "Plugin built without HDF5";
+  checkProcessingChange(true);
+  m_hdf5_output = flag;
+}
+
+bool Camera::getHdf5Output() {
+  DEB_MEMBER_FUNCT();
+
+  return m_hdf5_output;
+}
+
+void Camera::setHdf5FilePrefix(const std::string& prefix) {
+  DEB_MEMBER_FUNCT();
+
+  m_chunk_writer.setFilePrefix(prefix);
+}
+
+std::string Camera::getHdf5FilePrefix() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getFilePrefix();
+}
+
+void Camera::setHdf5CompressThreads(int nb_threads) {
+  DEB_MEMBER_FUNCT();
+
+  m_chunk_writer.setNbThreads(nb_threads);
+}
+
+int Camera::getHdf5CompressThreads() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getNbThreads();
+}
+
+void Camera::setHdf5QueueFrames(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+
+  m_chunk_writer.setQueueFrames(nb_frames);
+}
+
+int Camera::getHdf5QueueFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getQueueFrames();
+}
+
+std::string Camera::getHdf5FileName() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getFileName();
+}
+
+int Camera::getHdf5FramesWritten() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getNbFramesWritten();
+}
+
+int Camera::getHdf5FramesDropped() {
+  DEB_MEMBER_FUNCT();
+
+  return m_chunk_writer.getNbFramesDropped();
+}
 
-	    break;
+int Camera::getHdf5MaxQueueDepth() {
+  DEB_MEMBER_FUNCT();
 
-	  }
-	case 4:
-	  { //loadCalibrationFromFile
-	    int ret1;
+  return m_chunk_writer.getMaxQueueDepth();
+}
 
-	    size_t pos = m_cam.m_file_path.find(".cf");
+double Camera::getHdf5CompressionRatio() {
+  DEB_MEMBER_FUNCT();
 
-	    if (pos == string::npos)
-	      {
-		m_cam.m_file_path.append(".cfg");
-		pos = m_cam.m_file_path.length() - 4;
-	      }
+  return m_chunk_writer.getCompressionRatio();
+}
 
-	    m_cam.m_file_path.replace(pos, 4, ".cfg");
-	    ret1 = m_cam.loadConfigGFromFile((char *) m_cam.m_file_path.c_str());
+double Camera::getHdf5CompressRate() {
+  DEB_MEMBER_FUNCT();
 
-	    if (ret1 == 0)
-	      {
-		m_cam.m_file_path.replace(pos, 4, ".cfl");
-		m_cam.loadConfigLFromFile((char *) m_cam.m_file_path.c_str());
-	      }
+  return m_chunk_writer.getCompressRate();
+}
 
-	    break;
-	  }
-	case 5:
-	  { //saveCalibrationToFile
-	    int ret1;
+double Camera::getHdf5WriteRate() {
+  DEB_MEMBER_FUNCT();
 
-	    size_t pos = m_cam.m_file_path.find(".cf");
+  return m_chunk_writer.getWriteRate();
+}
 
-	    if (pos == string::npos)
-	      {
-		m_cam.m_file_path.append(".cfg");
-		pos = m_cam.m_file_path.length() - 4;
-	      }
-	    m_cam.m_file_path.replace(pos, 4, ".cfg");
-	    ret1 = m_cam.saveConfigGToFile((char *) m_cam.m_file_path.c_str());
+double Camera::getHdf5Throughput() {
+  DEB_MEMBER_FUNCT();
 
-	    if (ret1 == 0)
-	      {
-		m_cam.m_file_path.replace(pos, 4, ".cfl");
-		m_cam.saveConfigLToFile((char *) m_cam.m_file_path.c_str());
-	      }
+  return m_chunk_writer.getThroughput();
+}
 
-	    break;
-	  }
-	case 6:
-	  { //Load Default Config G values
-	    string ret;
-	    stringstream cmd;
-	    int value, regid;
+void Camera::publishRingFrame(const void *frame) {
+  // numbered as received: the frames not shown in live mode have a number
+  // too, the LIMA frame numbers fall behind
+  if (m_frame_ring.isOpen())
+    m_frame_ring.publish(m_frames_received - 1, frame, Timestamp::now() - m_publish_start_ts);
+}
 
-	    for (int i = 0; i < 7; i++)
-	      {
-		switch (i)
-		  {
-		  case 0: regid = AMPTP;
-		    value = 0;
-		    break;
-		  case 1: regid = IMFP;
-		    value = 50;
-		    break;
-		  case 2: regid = IOTA;
-		    value = 40;
-		    break;
-		  case 3: regid = IPRE;
-		    value = 60;
-		    break;
-		  case 4: regid = ITHL;
-		    value = 25;
-		    break;
-		  case 5: regid = ITUNE;
-		    value = 100;
-		    break;
-		  case 6: regid = IBUFF;
-		    value = 0;
-		    break;
-		  }
+void Camera::setFrameRing(const std::string& name) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(name);
 
-		string register_name;
-		switch (regid)
-		  {
-		  case 31: register_name = "AMPTP";
-		    break;
-		  case 59: register_name = "IMFP";
-		    break;
-		  case 60: register_name = "IOTA";
-		    break;
-		  case 61: register_name = "IPRE";
-		    break;
-		  case 62: register_name = "ITHL";
-		    break;
-		  case 63: register_name = "ITUNE";
-		    break;
-		  case 64: register_name = "IBUFF";
-		    break;
-		  default: register_name = "ITHL";
-		    break;
-		  }
+  // mapped or retired at the next acquisition start
+  m_frame_ring_name = name;
+}
+
+std::string Camera::getFrameRing() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_ring_name;
+}
+
+void Camera::setFrameRingNbFrames(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if (nb_frames < 2)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames) << ", min. 2";
+  m_frame_ring_nb_frames = nb_frames;
+}
+
+int Camera::getFrameRingNbFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_ring_nb_frames;
+}
+
+int Camera::getFrameRingPublished() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_ring.getNbPublished();
+}
+
+void Camera::setSpillFile(const std::string& file_name) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(file_name);
+
+  m_spill_file = file_name;
+}
+
+std::string Camera::getSpillFile() {
+  DEB_MEMBER_FUNCT();
+
+  return m_spill_file;
+}
+
+void Camera::setSpillNbFrames(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if (nb_frames < 1)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames);
+  m_spill_nb_frames = nb_frames;
+}
+
+int Camera::getSpillNbFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_spill_nb_frames;
+}
+
+void Camera::setReleaseReporting(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_release_reporting = flag;
+}
+
+bool Camera::getReleaseReporting() {
+  DEB_MEMBER_FUNCT();
+
+  return m_release_reporting;
+}
+
+void Camera::setLastFrameReleased(int frame_nb) {
+  // a frame not published yet is one of the previous acquisition, reported
+  // late: its buffer is not free in this one
+  if (frame_nb > m_last_frame_published)
+    return;
+  int last;
+  while ((last = m_last_frame_released) < frame_nb &&
+	 !__sync_bool_compare_and_swap(&m_last_frame_released, last, frame_nb));
+}
+
+int Camera::getSpillDepth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_spill.getDepth();
+}
+
+int Camera::getSpillMaxDepth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_spill_max_depth;
+}
+
+int Camera::getSpilledFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_spilled_frames;
+}
+
+int Camera::getDrainedFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_drained_frames;
+}
+
+int Camera::getDiscardedFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_discarded_frames;
+}
+
+void Camera::setFramePublishBatch(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if (nb_frames < 1)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames);
+  m_publish_batch = nb_frames;
+}
+
+int Camera::getFramePublishBatch() {
+  DEB_MEMBER_FUNCT();
+
+  return m_publish_batch;
+}
+
+void Camera::setFramePublishMaxDelay(double delay_ms) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(delay_ms);
+
+  if (delay_ms < 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(delay_ms);
+  m_publish_max_delay = delay_ms;
+}
+
+double Camera::getFramePublishMaxDelay() {
+  DEB_MEMBER_FUNCT();
+
+  return m_publish_max_delay;
+}
+
+void Camera::startFileIngest() {
+  DEB_MEMBER_FUNCT();
+
+  // a frame can be ingested at most one ring of buffers ahead of publication,
+  // the frames pending in a publication batch are part of it
+  int nb_frames = getNbBufferFrames() - m_publish_batch_size;
+  int window = std::max(1, std::min(m_ingest_window, nb_frames));
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  m_ingest_slots.assign(window, -1);
+  m_ingest_next_frame = 0;
+  m_ingest_publish_frame = 0;
+  m_ingest_occupancy = 0;
+  m_ingest_max_occupancy = 0;
+  m_ingest_failed = false;
+  m_ingest_active = true;
+  m_ingest_cond.broadcast();
+}
+
+void Camera::stopFileIngest() {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  m_ingest_active = false;
+  m_ingest_cond.broadcast();
+  // workers may still be writing in the LIMA buffers
+  while (m_ingest_busy > 0)
+    m_ingest_cond.wait();
+  m_ingest_occupancy = 0;
+}
+
+bool Camera::waitIngestedFrame(int frame_nb) {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  int slot = frame_nb % m_ingest_slots.size();
+
+  while (m_ingest_slots[slot] != frame_nb)
+    {
+      // a frame not read stops the acquisition, as in the sequential ingestion
+      if (m_quit || m_ingest_failed)
+	return false;
+      m_ingest_cond.wait(0.1);
+    }
+
+  m_ingest_slots[slot] = -1;
+  --m_ingest_occupancy;
+  m_ingest_publish_frame = frame_nb + 1;
+  m_ingest_cond.broadcast();
+  return true;
+}
+
+void Camera::stopFileIngestThreads() {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  m_ingest_exit = true;
+  m_ingest_cond.broadcast();
+  while (m_ingest_running > 0)
+    m_ingest_cond.wait();
+  m_ingest_exit = false;
+  aLock.unlock();
+
+  for (size_t i = 0; i < m_ingest_threads.size(); i++)
+    delete m_ingest_threads[i];
+  m_ingest_threads.clear();
+}
+
+void Camera::setFileIngestThreads(int nb_threads) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_threads);
+
+  if (nb_threads < 1)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_threads);
+  if (m_ingest_active)
+    THROW_HW_ERROR(Error) << "Cannot resize the file ingest pool during acquisition";
+
+  this->stopFileIngestThreads();
+
+  // a single thread keeps the sequential ingestion in the acquisition thread
+  if (nb_threads > 1)
+    {
+      for (int i = 0; i < nb_threads; i++)
+	{
+	  FileIngestThread *thread = new FileIngestThread(*this);
+	  m_ingest_threads.push_back(thread);
+	  thread->start();
+	}
+    }
+}
+
+int Camera::getFileIngestThreads() {
+  DEB_MEMBER_FUNCT();
+
+  int nb_threads = m_ingest_threads.empty() ? 1 : m_ingest_threads.size();
+  DEB_RETURN() << DEB_VAR1(nb_threads);
+  return nb_threads;
+}
+
+void Camera::setFileIngestWindow(int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if (nb_frames < 1)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames);
+
+  m_ingest_window = nb_frames;
+}
+
+int Camera::getFileIngestWindow() {
+  DEB_MEMBER_FUNCT();
+
+  return m_ingest_window;
+}
+
+int Camera::getFileIngestWindowOccupancy() {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  return m_ingest_occupancy;
+}
+
+int Camera::getFileIngestMaxWindowOccupancy() {
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_ingest_cond.mutex());
+  return m_ingest_max_occupancy;
+}
+
+int Camera::setThreadScheduling(pid_t tid, const string& cpus, int rt_priority) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR3(tid, cpus, rt_priority);
+
+  cpu_set_t cpu_set;
+  if (cpus.empty())
+    {
+      // back to the cpus of the process
+      if (sched_getaffinity(getpid(), sizeof(cpu_set), &cpu_set) != 0)
+	THROW_HW_ERROR(Error) << "Cannot get the process cpu affinity: " << strerror(errno);
+    }
+  else if (!parseCpuList(cpus, cpu_set))
+    THROW_HW_ERROR(InvalidValue) << "Invalid cpu list " << DEB_VAR1(cpus);
+
+  int max_priority = sched_get_priority_max(SCHED_FIFO);
+  if (rt_priority < 0 || rt_priority > max_priority)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(rt_priority) << ", max. " << max_priority;
+
+  // the node the buffers are to be local to
+  int numa_node = -1;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (!CPU_ISSET(cpu, &cpu_set))
+	continue;
+      int node = XpadBufferAllocMgr::getCpuNumaNode(cpu);
+      if (node < 0 || (numa_node >= 0 && node != numa_node))
+	{
+	  numa_node = -1;
+	  break;
+	}
+      numa_node = node;
+    }
+  DEB_TRACE() << DEB_VAR1(numa_node);
+
+  if (tid == 0)
+    return numa_node;
+
+  if (sched_setaffinity(tid, sizeof(cpu_set), &cpu_set) != 0)
+    THROW_HW_ERROR(Error) << "Cannot set the cpus of thread " << tid << " to \"" << cpus << "\": " << strerror(errno);
+
+  struct sched_param param;
+  param.sched_priority = rt_priority;
+  if (sched_setscheduler(tid, rt_priority ? SCHED_FIFO : SCHED_OTHER, &param) != 0)
+    THROW_HW_ERROR(Error) << "Cannot set the SCHED_FIFO priority of thread " << tid << " to " << rt_priority
+			  << ": " << strerror(errno) << (errno == EPERM ? " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)" : "");
+  return numa_node;
+}
+
+void Camera::setAcqThreadCpus(const std::string& cpus) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(cpus);
+
+  AutoMutex aLock(m_cond.mutex());
+  m_acq_numa_node = setThreadScheduling(m_acq_tid, cpus, m_acq_rt_priority);
+  m_acq_thread_cpus = cpus;
+}
+
+std::string Camera::getAcqThreadCpus() {
+  DEB_MEMBER_FUNCT();
 
-		cmd.str(string());
-		cmd << "LoadConfigG " << register_name << " " << value ;
-		m_cam.m_xpad->sendWait(cmd.str(), ret);
-	      }
+  AutoMutex aLock(m_cond.mutex());
+  return m_acq_thread_cpus;
+}
 
-	    if (ret.length() > 1)
-	      DEB_TRACE() << "Loading global configuratioin with values:\nAMPTP = 0, IMFP = 50, IOTA = 40, IPRE = 60, ITHL = 25, ITUNE = 100, IBUFF = 0";
-	    else
-	      throw LIMA_HW_EXC(Error, "Loading default global configuration values FAILED!");
+void Camera::setIngestThreadCpus(const std::string& cpus) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(cpus);
 
-	    break;
-	  }
-	case 7:
-	  { //ITHL Increase
-	    int ret;
-	    stringstream cmd;
+  AutoMutex aLock(m_ingest_cond.mutex());
+  setThreadScheduling(0, cpus, m_acq_rt_priority);
+  for (size_t i = 0; i < m_ingest_tids.size(); i++)
+    setThreadScheduling(m_ingest_tids[i], cpus, m_acq_rt_priority);
+  m_ingest_thread_cpus = cpus;
+}
 
-	    cmd.str(string());
-	    cmd << "ITHLIncrease";
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+std::string Camera::getIngestThreadCpus() {
+  DEB_MEMBER_FUNCT();
 
-	    if (!ret)
-	      DEB_TRACE() << "ITHL was increased SUCCESFULLY";
-	    else
-	      throw LIMA_HW_EXC(Error, "ITHL increase FAILED!");
+  AutoMutex aLock(m_ingest_cond.mutex());
+  return m_ingest_thread_cpus;
+}
 
-	    break;
-	  }
-	case 8:
-	  {  //ITHL Decrease
-	    int ret;
-	    stringstream cmd;
+void Camera::setAcqRtPriority(int priority) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(priority);
 
-	    cmd.str(string());
-	    cmd << "ITHLDecrease";
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+  // the acquisition thread first: nothing is changed if not permitted
+  AutoMutex aLock(m_cond.mutex());
+  setThreadScheduling(m_acq_tid, m_acq_thread_cpus, priority);
+  m_acq_rt_priority = priority;
+  aLock.unlock();
 
-	    if (!ret)
-	      DEB_TRACE() << "ITHL was decreased SUCCESFULLY";
-	    else
-	      throw LIMA_HW_EXC(Error, "ITHL decrease FAILED!");
+  AutoMutex ingestLock(m_ingest_cond.mutex());
+  for (size_t i = 0; i < m_ingest_tids.size(); i++)
+    setThreadScheduling(m_ingest_tids[i], m_ingest_thread_cpus, priority);
+}
 
-	    break;
-	  }
-	case 9:
-	  {  //LoadFloatConfigL
-	    int ret;
-	    stringstream cmd;
+int Camera::getAcqRtPriority() {
+  DEB_MEMBER_FUNCT();
 
-	    cmd.str(string());
-	    cmd <<  "LoadFlatConfigL " << " " << m_cam.m_flat_value;
-	    m_cam.m_xpad->sendWait(cmd.str(), ret);
+  return m_acq_rt_priority;
+}
 
-	    if (!ret)
-	      DEB_TRACE() << "Loading local configurations values, with flat value: " <<  m_cam.m_flat_value << " -> OK" ;
-	    else
-	      throw LIMA_HW_EXC(Error, "Loading local configuratin with FLAT value FAILED!");
+void Camera::setReceiveBusyPoll(int usec) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(usec);
+
+  if (usec < 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(usec);
+  // frames are read on the main connection only
+  if (m_xpad->setBusyPoll(usec) < 0)
+    THROW_HW_ERROR(Error) << m_xpad->getErrorMessage();
+  m_receive_busy_poll = usec;
+}
 
-	    break;
-	  }
-	}
-      aLock.lock();
-      m_cam.m_quit = false;
-      m_cam.m_wait_flag = true;
-      m_cam.m_cond.broadcast();
+int Camera::getReceiveBusyPoll() {
+  DEB_MEMBER_FUNCT();
+
+  return m_receive_busy_poll;
+}
+
+void Camera::recordFrameInterval() {
+  Timestamp now = Timestamp::now();
+  if (m_frame_interval_ts.isSet())
+    {
+      double interval = (now - m_frame_interval_ts) * 1e6;
+      ++m_frame_interval_nb;
+      m_frame_interval_sum += interval;
+      m_frame_interval_sum2 += interval * interval;
+      m_frame_interval_max = std::max(m_frame_interval_max, interval);
     }
+  m_frame_interval_ts = now;
+}
 
-  DEB_TRACE() << "Acquisition thread finished";
+int Camera::getFrameIntervalNb() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_interval_nb;
 }
 
+double Camera::getFrameIntervalMean() {
+  DEB_MEMBER_FUNCT();
 
+  return m_frame_interval_nb ? m_frame_interval_sum / m_frame_interval_nb : 0;
+}
 
-Camera::AcqThread::AcqThread(Camera& cam) :
-m_cam(cam) {
-  AutoMutex aLock(m_cam.m_cond.mutex());
-  m_cam.m_wait_flag = true;
-  m_cam.m_quit = false;
-  m_cam.m_cond.broadcast();
-  aLock.unlock();
-  pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+double Camera::getFrameIntervalStdDev() {
+  DEB_MEMBER_FUNCT();
+
+  if (m_frame_interval_nb < 2)
+    return 0;
+  double mean = m_frame_interval_sum / m_frame_interval_nb;
+  double var = m_frame_interval_sum2 / m_frame_interval_nb - mean * mean;
+  return var > 0 ? sqrt(var) : 0;
 }
 
-Camera::AcqThread::~AcqThread() {
-  AutoMutex aLock(m_cam.m_cond.mutex());
-  m_cam.m_quit = true;
-  m_cam.m_cond.broadcast();
-  aLock.unlock();
+double Camera::getFrameIntervalMax() {
+  DEB_MEMBER_FUNCT();
+
+  return m_frame_interval_max;
 }
 
 void Camera::getImageSize(Size& size) {
+  DEB_MEMBER_FUNCT();
+
+  // size of the frames received, then of the frames processed by the plugin
+  getRawImageSize(size);
+  size = m_processing.getOutputSize(size);
+}
+
+void Camera::getRawImageSize(Size& size) {
 
   DEB_MEMBER_FUNCT();
   CHECK_DETECTOR_ACCESS
@@ -760,9 +2842,209 @@ void Camera::getImageSize(Size& size) {
   int row = atoi(ret.substr(0, pos).c_str());
   int columns = atoi(ret.substr(pos + 1, ret.length() - pos + 1).c_str());
 
+  // with a hardware roi the frames hold a subset of the modules
+  if (m_roi_module_mask)
+    row = row / __builtin_popcount(m_roi_module_mask) * __builtin_popcount(m_module_mask);
   size = Size(columns, row);
 }
 
+void Camera::mapRoi(const Roi& set_roi, Roi& hw_roi, int& first_module, int& last_module) {
+  DEB_MEMBER_FUNCT();
+
+  Size raw_size;
+  getRawImageSize(raw_size);
+  Size size = m_processing.getOutputSize(raw_size);
+
+  std::vector<int> col_begin, col_end, row_begin, row_end;
+  if (m_geometrical_correction_flag) {
+    // layout of the server correction unknown: modules as equal stripes
+    int nb_modules = __builtin_popcount(m_module_mask);
+    for (int module = 0; module < nb_modules; module++) {
+      row_begin.push_back(module * size.getHeight() / nb_modules);
+      row_end.push_back((module + 1) * size.getHeight() / nb_modules);
+    }
+  } else
+    m_processing.getChipLayout(raw_size, col_begin, col_end, row_begin, row_end);
+  // the columns are cropped by the client-side processing only
+  if (col_begin.empty() || !m_image_transfer_flag) {
+    col_begin.assign(1, 0);
+    col_end.assign(1, size.getWidth());
+  }
+  // the transfer files are read at the size of the whole detector
+  if (!m_image_transfer_flag) {
+    row_begin.assign(1, 0);
+    row_end.assign(1, size.getHeight());
+  }
+
+  first_module = 0;
+  last_module = row_begin.size() - 1;
+
+  // roi of the binned frame: chips rounded outwards, all the modules read
+  // out, so that the binning pattern stays the one of the full frame
+  Bin bin = m_processing.getBin();
+  if (!bin.isOne()) {
+    size = Size(size.getWidth() / bin.getX(), size.getHeight() / bin.getY());
+    for (size_t chip = 0; chip < col_begin.size(); chip++) {
+      col_begin[chip] /= bin.getX();
+      col_end[chip] = std::min((col_end[chip] + bin.getX() - 1) / bin.getX(), size.getWidth());
+    }
+    row_begin.assign(1, 0);
+    row_end.assign(1, size.getHeight());
+  }
+  if (set_roi.isEmpty()) {
+    hw_roi = Roi(Point(0, 0), size);
+    return;
+  }
+
+  Point top_left = set_roi.getTopLeft();
+  int x_end = top_left.x + set_roi.getSize().getWidth();
+  int y_end = top_left.y + set_roi.getSize().getHeight();
+  if (top_left.x < 0 || top_left.y < 0 || x_end > size.getWidth() || y_end > size.getHeight())
+    THROW_HW_ERROR(InvalidValue) << "Roi " << set_roi << " out of the frame " << size;
+
+  int first_chip = 0, last_chip;
+  int first_row = 0, last_row;
+  while (first_row < int(row_end.size()) - 1 && row_end[first_row] <= top_left.y)
+    ++first_row;
+  for (last_row = first_row; last_row < int(row_end.size()) - 1; ++last_row)
+    if (row_end[last_row] >= y_end)
+      break;
+  if (bin.isOne()) {
+    first_module = first_row;
+    last_module = last_row;
+  }
+  while (first_chip < int(col_end.size()) - 1 && col_end[first_chip] <= top_left.x)
+    ++first_chip;
+  for (last_chip = first_chip; last_chip < int(col_end.size()) - 1; ++last_chip)
+    if (col_end[last_chip] >= x_end)
+      break;
+
+  hw_roi = Roi(Point(col_begin[first_chip], row_begin[first_row]),
+	       Size(col_end[last_chip] - col_begin[first_chip],
+		    row_end[last_row] - row_begin[first_row]));
+}
+
+void Camera::checkRoi(const Roi& set_roi, Roi& hw_roi) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(set_roi);
+
+  int first_module, last_module;
+  mapRoi(set_roi, hw_roi, first_module, last_module);
+  DEB_RETURN() << DEB_VAR1(hw_roi);
+}
+
+void Camera::setRoi(const Roi& set_roi) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(set_roi);
+
+  Roi hw_roi, full_roi;
+  int first_module, last_module;
+  mapRoi(Roi(), full_roi, first_module, last_module);
+  mapRoi(set_roi, hw_roi, first_module, last_module);
+  Size raw_size;
+  getRawImageSize(raw_size);
+
+  // modules of the roi among the modules enabled
+  unsigned int module_mask = 0;
+  int module = 0;
+  for (unsigned int bit = 1; bit && bit <= m_module_mask; bit <<= 1)
+    if (m_module_mask & bit) {
+      if (module >= first_module && module <= last_module)
+	module_mask |= bit;
+      ++module;
+    }
+  if (hw_roi == full_roi)
+    module_mask = m_module_mask;
+  if (module_mask != (m_roi_module_mask ? m_roi_module_mask : m_module_mask))
+    sendModuleMask(module_mask);
+  m_roi_module_mask = (module_mask == m_module_mask)? 0: module_mask;
+
+  // the tables of the corrections are given for all the modules
+  if (m_roi_module_mask && !m_geometrical_correction_flag)
+    m_processing.setRawWindow(first_module * IMG_LINE, raw_size);
+  else
+    m_processing.setRawWindow(0, Size());
+
+  bool crop = hw_roi.getSize().getWidth() != full_roi.getSize().getWidth();
+  Size window_size(hw_roi.getSize());
+  m_processing.setCrop(crop? Roi(Point(hw_roi.getTopLeft().x, 0), window_size): Roi());
+
+  m_roi = (hw_roi == full_roi)? Roi(): hw_roi;
+  DEB_TRACE() << "Hardware roi " << m_roi << ", " << DEB_VAR1(m_roi_module_mask);
+}
+
+void Camera::getRoi(Roi& hw_roi) {
+  DEB_MEMBER_FUNCT();
+
+  if (m_roi.isEmpty()) {
+    int first_module, last_module;
+    mapRoi(Roi(), hw_roi, first_module, last_module);
+  } else
+    hw_roi = m_roi;
+  DEB_RETURN() << DEB_VAR1(hw_roi);
+}
+
+void Camera::checkBin(Bin& bin) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bin);
+
+  // vectorized factors, done by the client-side processing only
+  int bin_x = bin.getX() >= 4 ? 4 : bin.getX() >= 2 ? 2 : 1;
+  int bin_y = bin.getY() >= 4 ? 4 : bin.getY() >= 2 ? 2 : 1;
+  if (!m_image_transfer_flag)
+    bin_x = bin_y = 1;
+  bin = Bin(bin_x, bin_y);
+  DEB_RETURN() << DEB_VAR1(bin);
+}
+
+void Camera::setBin(const Bin& bin) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bin);
+
+  Bin hw_bin = bin;
+  checkBin(hw_bin);
+  if (hw_bin != bin)
+    THROW_HW_ERROR(InvalidValue) << "Binning not supported: " << DEB_VAR1(bin);
+  checkProcessingChange(true);
+  m_processing.setBin(bin);
+}
+
+void Camera::getBin(Bin& bin) {
+  DEB_MEMBER_FUNCT();
+
+  bin = m_processing.getBin();
+  DEB_RETURN() << DEB_VAR1(bin);
+}
+
+double Camera::getBinTime() {
+  DEB_MEMBER_FUNCT();
+
+  return m_processing.getBinTime();
+}
+
+double Camera::benchmarkBinning(int bin_x, int bin_y, int nb_frames) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR3(bin_x, bin_y, nb_frames);
+
+  Size raw_size;
+  getRawImageSize(raw_size);
+  return m_processing.benchmarkBin(m_processing.getOutputSize(raw_size), Bin(bin_x, bin_y), nb_frames);
+}
+
+void Camera::sendModuleMask(unsigned int module_mask) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(module_mask);
+
+  int ret;
+  stringstream cmd;
+
+  cmd << "SetModuleMask " << module_mask;
+  m_exposure_params.clear();
+  m_xpad->sendWait(cmd.str(), ret);
+  if (ret)
+    THROW_HW_ERROR(Error) << "Setting module mask " << module_mask << " FAILED!";
+}
+
 void Camera::getPixelSize(double& size_x, double& size_y) {
   DEB_MEMBER_FUNCT();
 
@@ -773,6 +3055,10 @@ void Camera::getPixelSize(double& size_x, double& size_y) {
 void Camera::getImageType(ImageType& pixel_depth) {
   DEB_MEMBER_FUNCT();
   //type = m_image_type;
+  if (m_float_output) {
+    pixel_depth = Bpp32F;
+    return;
+  }
   switch( m_image_format )
   {
     case 0:
@@ -789,16 +3075,27 @@ void Camera::setImageType(ImageType pixel_depth) {
   //this is what xpad generates but may need Bpp32 for accummulate
   DEB_MEMBER_FUNCT();
 
+  m_pixel_depth_promoted = false;
+  m_pixel_depth_change = false;
   switch( pixel_depth )
   {
     case Bpp16S:
     m_pixel_depth = B2;
     m_image_format = 0;
+    m_float_output = false;
     break;
 
     case Bpp32S:
     m_pixel_depth = B4;
     m_image_format = 1;
+    m_float_output = false;
+    break;
+
+    // converted by the plugin, mainly for the client-side flat-field
+    case Bpp32F:
+    m_pixel_depth = B4;
+    m_image_format = 1;
+    m_float_output = true;
     break;
     default:
     DEB_ERROR() << "Pixel Depth is unsupported: only 16 or 32 bits is supported" ;
@@ -807,6 +3104,77 @@ void Camera::setImageType(ImageType pixel_depth) {
   }
 }
 
+void Camera::setAdaptivePixelDepth(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  checkProcessingChange(true);
+  m_adaptive_pixel_depth = flag;
+}
+
+bool Camera::getAdaptivePixelDepth() {
+  DEB_MEMBER_FUNCT();
+
+  return m_adaptive_pixel_depth;
+}
+
+bool Camera::getPixelDepthPromoted() {
+  DEB_MEMBER_FUNCT();
+
+  return m_pixel_depth_promoted;
+}
+
+int Camera::getAcqMaxCount() {
+  DEB_MEMBER_FUNCT();
+
+  return m_acq_max_count;
+}
+
+int Camera::getAcqOverflowFrames() {
+  DEB_MEMBER_FUNCT();
+
+  return m_acq_overflow_frames;
+}
+
+void Camera::updatePixelDepth() {
+  DEB_MEMBER_FUNCT();
+
+  if (!m_processing.getTrackMax())
+    return;
+
+  int32_t max_count = m_processing.getMaxCount();
+  m_acq_max_count = (max_count == INT32_MIN)? -1: max_count;
+  m_acq_overflow_frames = m_processing.getNbOverflowFrames();
+  DEB_TRACE() << DEB_VAR2(m_acq_max_count, m_acq_overflow_frames);
+
+  // the LIMA buffers of an acquisition have a fixed type: 32 bit after
+  // frames above 16 bit, back to 16 bit after an acquisition below, the
+  // change applied by the next prepareAcq()
+  if (!m_adaptive_pixel_depth || max_count == INT32_MIN ||
+      (m_image_format != 0 && !m_pixel_depth_promoted))
+    return;
+  bool promote = max_count > INT16_MAX;
+  if (promote && !m_pixel_depth_promoted)
+    DEB_WARNING() << "Max. count " << m_acq_max_count << " above 16 bit ("
+		  << m_acq_overflow_frames << " frames saturated): image type to be promoted to Bpp32S";
+  m_pixel_depth_change = (promote != m_pixel_depth_promoted);
+}
+
+void Camera::applyPixelDepthChange() {
+  DEB_MEMBER_FUNCT();
+
+  // on the caller's thread, not the acq. thread: LIMA allocates the buffers
+  // of the acquisition being prepared before, the type applies to the next one
+  if (!__sync_bool_compare_and_swap(&m_pixel_depth_change, true, false))
+    return;
+  m_pixel_depth_promoted = !m_pixel_depth_promoted;
+  m_pixel_depth = m_pixel_depth_promoted? B4: B2;
+  m_image_format = m_pixel_depth_promoted? 1: 0;
+  ImageType pixel_depth = m_pixel_depth_promoted? Bpp32S: Bpp16S;
+  DEB_TRACE() << "Image type changed to " << pixel_depth;
+  maxImageSizeChanged(m_image_size, pixel_depth);
+}
+
 void Camera::getDetectorType(std::string& type) {
   DEB_MEMBER_FUNCT();
   CHECK_DETECTOR_ACCESS
@@ -837,30 +3205,123 @@ HwBufferCtrlObj* Camera::getBufferCtrlObj() {
   return &m_bufferCtrlObj;
 }
 
+void Camera::setBufferHugePages(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_bufferCtrlObj.getAllocMgr().setHugePages(flag);
+}
+
+bool Camera::getBufferHugePages() {
+  DEB_MEMBER_FUNCT();
+
+  return m_bufferCtrlObj.getAllocMgr().getHugePages();
+}
+
+void Camera::setBufferLockMemory(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_bufferCtrlObj.getAllocMgr().setLockMemory(flag);
+}
+
+bool Camera::getBufferLockMemory() {
+  DEB_MEMBER_FUNCT();
+
+  return m_bufferCtrlObj.getAllocMgr().getLockMemory();
+}
+
+void Camera::setBufferPrefault(bool flag) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(flag);
+
+  m_buffer_prefault = flag;
+}
+
+bool Camera::getBufferPrefault() {
+  DEB_MEMBER_FUNCT();
+
+  return m_buffer_prefault;
+}
+
+void Camera::setBufferNumaNode(int node) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(node);
+
+  // -1: the node of the acquisition thread
+  if (node < -1 || (node >= 0 && !XpadBufferAllocMgr::isNumaNode(node)))
+    THROW_HW_ERROR(InvalidValue) << "No NUMA node " << node << " on this host";
+  m_buffer_numa_node = node;
+}
+
+int Camera::getBufferNumaNode() {
+  DEB_MEMBER_FUNCT();
+
+  return (m_buffer_numa_node >= 0)? m_buffer_numa_node: m_acq_numa_node;
+}
+
+void Camera::setBufferSharedMemory(std::string name) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(name);
+
+  m_bufferCtrlObj.getAllocMgr().setSharedMemory(name);
+}
+
+std::string Camera::getBufferSharedMemory() {
+  DEB_MEMBER_FUNCT();
+
+  XpadBufferAllocMgr& alloc_mgr = m_bufferCtrlObj.getAllocMgr();
+  if (alloc_mgr.getMode() != XpadBufferAllocMgr::SharedMemory)
+    return "";
+  return alloc_mgr.getSharedMemoryName();
+}
+
+void Camera::setBufferExternalMemory(void *base, long long size) {
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(base, size);
+
+  if (base && size <= 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(size);
+  m_bufferCtrlObj.getAllocMgr().setExternalMemory(base, base ? size : 0);
+}
+
+double Camera::getBufferPrefaultTime() {
+  DEB_MEMBER_FUNCT();
+
+  return m_bufferCtrlObj.getAllocMgr().getPrefaultTime();
+}
+
+double Camera::getFirstFrameLatency() {
+  DEB_MEMBER_FUNCT();
+
+  return m_first_frame_latency;
+}
+
 
 void Camera::setTrigMode(TrigMode mode) {
   DEB_MEMBER_FUNCT();
   DEB_TRACE() << "Camera::setTrigMode - " << DEB_VAR1(mode);
   DEB_PARAM() << DEB_VAR1(mode);
 
+  m_xpad_trigger_mode = getXpadTrigMode(mode);
+}
+
+unsigned int Camera::getXpadTrigMode(TrigMode mode) {
+  DEB_MEMBER_FUNCT();
+
   switch( mode )
   {
     case IntTrig:
-    m_xpad_trigger_mode = 0;
-    break;
+    return 0;
     case ExtGate:
-    m_xpad_trigger_mode = 1;
-    break;
+    return 1;
     case ExtTrigSingle:
-    m_xpad_trigger_mode = 3;
-    break;
+    return 3;
     case ExtTrigMult:
-    m_xpad_trigger_mode = 2;
-    break;
+    return 2;
     default:
     DEB_ERROR() << "Error: Trigger mode unsupported: only IntTrig, ExtGate, ExtTrigSingle and ExtTrigMult" ;
     throw LIMA_HW_EXC(Error, "Trigger mode unsupported: only IntTrig, ExtGate, ExtTrigSingle and ExtTrigMult");
-    break;
   }
 }
 
@@ -966,6 +3427,7 @@ int Camera::setUSBDevice(unsigned short device){
 
   cmd.str(string());
   cmd << "SetUSBDevice " << device;
+  m_exposure_params.clear();
   m_xpad->sendWait(cmd.str(), ret);
 
   if(!ret)
@@ -985,9 +3447,15 @@ int Camera::setModuleMask(unsigned int moduleMask){
   stringstream cmd;
 
   m_module_mask = moduleMask;
+  // the hardware roi was made of the previous modules
+  m_roi = Roi();
+  m_roi_module_mask = 0;
+  m_processing.setRawWindow(0, Size());
+  m_processing.setCrop(Roi());
 
   cmd.str(string());
   cmd << "SetModuleMask " << moduleMask;
+  m_exposure_params.clear();
   m_xpad->sendWait(cmd.str(), ret);
 
   if(!ret)
@@ -1009,7 +3477,9 @@ void Camera::getModuleMask(){
   cmd << "GetModuleMask";
   m_xpad->sendWait(cmd.str(), ret);
 
-  m_module_mask = ret;
+  // with a hardware roi the server reads out a subset of the modules
+  if (!m_roi_module_mask)
+    m_module_mask = ret;
 
 }
 
@@ -1091,6 +3561,7 @@ int Camera::digitalTest(unsigned short mode){
 
   cmd.str(string());
   cmd << "SetGeometricalCorrectionFlag " << "false";
+  m_exposure_params.clear();
   m_xpad->sendWait(cmd.str(), ret);
 
   cmd.str(string());
@@ -1101,7 +3572,8 @@ int Camera::digitalTest(unsigned short mode){
   int columns = IMG_COLUMN * m_chip_number;
 
   int32_t buff[rows * columns];
-  this->readFrameExpose(buff, 1);
+  size_t pixel_size = m_image_format ? sizeof(int32_t) : sizeof(int16_t);
+  this->readFrameExpose(buff, size_t(rows) * columns * pixel_size, 1);
 
   int32_t val;
   //Saving Digital Test image to disk
@@ -1456,6 +3928,9 @@ void Camera:: setGeometricalCorrectionFlag(unsigned short flag){
   DEB_PARAM() << DEB_VAR1(flag);
 
   m_geometrical_correction_flag = flag;
+  // the server and the client corrections are exclusive
+  if (flag)
+    m_processing.setGeometry(false);
 
   int ret;
   string message, flag_state;
@@ -1469,6 +3944,7 @@ void Camera:: setGeometricalCorrectionFlag(unsigned short flag){
 
   cmd.str(string());
   cmd << "SetGeometricalCorrectionFlag " << flag_state.c_str();
+  m_exposure_params.clear();
   m_xpad->sendWait(cmd.str(), ret);
 
   if ( ret == 0)
@@ -1767,10 +4243,14 @@ void Camera::abortCurrentProcess(){
 
   stringstream cmd;
 
+  // under the lock: the acq. thread must not re-arm a live acquisition now
+  AutoMutex aLock(m_cond.mutex());
   m_quit = true;
   m_cond.broadcast();
+  aLock.unlock();
   DEB_TRACE() << "abortCurrentProcess() stopAcq()";
   cmd <<  "AbortCurrentProcess";
+  AutoMutex altLock(m_xpad_alt_lock);
   m_xpad_alt->sendNoWait(cmd.str());
 
 }
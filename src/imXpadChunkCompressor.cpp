@@ -0,0 +1,307 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadChunkCompressor.cpp
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "imXpadChunkCompressor.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace lima;
+using namespace lima::imXpad;
+
+static const size_t BSHUF_TARGET_BLOCK_BYTES = 8192;
+static const size_t BSHUF_BLOCKED_MULT = 8;
+static const size_t BSHUF_MIN_BLOCK = 128;
+
+// LZ4 block format: last literals and match limits of the reference encoder
+static const int LZ4_MIN_MATCH = 4;
+static const int LZ4_LAST_LITERALS = 5;
+static const int LZ4_MF_LIMIT = 12;
+static const int LZ4_HASH_LOG = 12;
+
+static inline void writeUint32BE(char *p, uint32_t v) {
+    p[0] = char(v >> 24); p[1] = char(v >> 16); p[2] = char(v >> 8); p[3] = char(v);
+}
+
+static inline void writeUint64BE(char *p, uint64_t v) {
+    writeUint32BE(p, uint32_t(v >> 32));
+    writeUint32BE(p + 4, uint32_t(v));
+}
+
+static inline uint32_t read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline size_t lz4MaxSize(size_t n) {
+    return n + n / 255 + 16;
+}
+
+//---------------------------
+//- bit transposition
+//---------------------------
+
+// elements -> planes of the bytes of the elements
+static void transposeBytes(const char *src, size_t nb_elems, int elem_size, char *dst) {
+    switch (elem_size) {
+    case 1:
+        memcpy(dst, src, nb_elems);
+        break;
+    case 2:
+        for (size_t i = 0; i < nb_elems; i++) {
+            dst[i] = src[2 * i];
+            dst[nb_elems + i] = src[2 * i + 1];
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < nb_elems; i++) {
+            dst[i] = src[4 * i];
+            dst[nb_elems + i] = src[4 * i + 1];
+            dst[2 * nb_elems + i] = src[4 * i + 2];
+            dst[3 * nb_elems + i] = src[4 * i + 3];
+        }
+        break;
+    default:
+        for (size_t i = 0; i < nb_elems; i++)
+            for (int b = 0; b < elem_size; b++)
+                dst[b * nb_elems + i] = src[i * elem_size + b];
+    }
+}
+
+// 8x8 bit matrix transposition, Hacker's Delight
+static inline uint64_t transposeBits8x8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// each byte plane of nb_elems bytes -> 8 bit planes of nb_elems / 8 bytes,
+// bit k of element i in bit (i % 8) of byte i / 8 of bit plane k
+static void transposeBitPlane(const char *plane, size_t nb_elems, char *dst) {
+    size_t nb_rows = nb_elems / 8;
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= nb_elems; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(plane + i));
+        for (int k = 7; k >= 0; k--) {
+            uint32_t mask = _mm256_movemask_epi8(x);
+            memcpy(dst + k * nb_rows + i / 8, &mask, sizeof(mask));
+            x = _mm256_slli_epi16(x, 1);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= nb_elems; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(plane + i));
+        for (int k = 7; k >= 0; k--) {
+            uint16_t mask = _mm_movemask_epi8(x);
+            memcpy(dst + k * nb_rows + i / 8, &mask, sizeof(mask));
+            x = _mm_slli_epi16(x, 1);
+        }
+    }
+#endif
+    for (; i < nb_elems; i += 8) {
+        uint64_t x = transposeBits8x8(read64(plane + i));
+        for (int k = 0; k < 8; k++)
+            dst[k * nb_rows + i / 8] = char(x >> (8 * k));
+    }
+}
+
+//---------------------------
+//- LZ4 block encoder, greedy
+//---------------------------
+
+static inline uint32_t lz4Hash(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline char *lz4WriteLength(char *op, size_t len) {
+    for (; len >= 255; len -= 255)
+        *op++ = char(255);
+    *op++ = char(len);
+    return op;
+}
+
+static char *lz4WriteLiterals(char *op, char *token, const char *anchor, size_t nb_literals) {
+    if (nb_literals >= 15) {
+        *token = char(15 << 4);
+        op = lz4WriteLength(op, nb_literals - 15);
+    } else {
+        *token = char(nb_literals << 4);
+    }
+    memcpy(op, anchor, nb_literals);
+    return op + nb_literals;
+}
+
+// blocks are smaller than 64 kB: positions in 16 bit, any match in range
+static size_t lz4Compress(const char *src, size_t size, char *dst, uint16_t *hash) {
+    const char *ip = src;
+    const char *anchor = src;
+    const char *iend = src + size;
+    const char *mflimit = iend - LZ4_MF_LIMIT;
+    const char *matchlimit = iend - LZ4_LAST_LITERALS;
+    char *op = dst;
+
+    if (size >= size_t(LZ4_MF_LIMIT + 1)) {
+        memset(hash, 0, sizeof(uint16_t) << LZ4_HASH_LOG);
+        ++ip;
+        unsigned misses = 0;
+        while (true) {
+            // next 4-byte match, faster skip over incompressible data
+            const char *ref = NULL;
+            while (ip < mflimit) {
+                uint32_t seq = read32(ip);
+                uint32_t h = lz4Hash(seq);
+                ref = src + hash[h];
+                hash[h] = uint16_t(ip - src);
+                if (ref < ip && read32(ref) == seq)
+                    break;
+                ip += 1 + (misses++ >> 6);
+            }
+            if (ip >= mflimit)
+                break;
+            misses = 0;
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+
+            char *token = op++;
+            op = lz4WriteLiterals(op, token, anchor, ip - anchor);
+            uint16_t offset = uint16_t(ip - ref);
+            *op++ = char(offset);
+            *op++ = char(offset >> 8);
+
+            const char *match_begin = ip;
+            ip += LZ4_MIN_MATCH;
+            ref += LZ4_MIN_MATCH;
+            while (ip + 8 <= matchlimit) {
+                uint64_t diff = read64(ip) ^ read64(ref);
+                if (diff) {
+                    ip += __builtin_ctzll(diff) >> 3;
+                    goto match_end;
+                }
+                ip += 8;
+                ref += 8;
+            }
+            while (ip < matchlimit && *ip == *ref) {
+                ++ip;
+                ++ref;
+            }
+        match_end:
+            size_t match_len = ip - match_begin - LZ4_MIN_MATCH;
+            if (match_len >= 15) {
+                *token |= 15;
+                op = lz4WriteLength(op, match_len - 15);
+            } else {
+                *token |= char(match_len);
+            }
+            anchor = ip;
+            if (ip >= mflimit)
+                break;
+            hash[lz4Hash(read32(ip - 2))] = uint16_t(ip - 2 - src);
+        }
+    }
+
+    char *token = op++;
+    op = lz4WriteLiterals(op, token, anchor, iend - anchor);
+    return op - dst;
+}
+
+//---------------------------
+//- ChunkCompressor
+//---------------------------
+
+ChunkCompressor::ChunkCompressor() :
+    m_planes(BSHUF_TARGET_BLOCK_BYTES + BSHUF_MIN_BLOCK * 8),
+    m_bits(m_planes.size()),
+    m_hash(1 << LZ4_HASH_LOG)
+{
+}
+
+size_t ChunkCompressor::getBlockSize(int elem_size) {
+    size_t block_size = BSHUF_TARGET_BLOCK_BYTES / elem_size;
+    block_size -= block_size % BSHUF_BLOCKED_MULT;
+    return std::max(block_size, BSHUF_MIN_BLOCK);
+}
+
+size_t ChunkCompressor::getMaxChunkSize(size_t nb_elems, int elem_size) {
+    size_t block_size = getBlockSize(elem_size);
+    size_t nb_blocks = nb_elems / block_size + 1;
+    return 12 + nb_elems * elem_size + nb_blocks * (4 + lz4MaxSize(block_size * elem_size) - block_size * elem_size);
+}
+
+size_t ChunkCompressor::compress(const void *src, size_t nb_elems, int elem_size, void *dst) {
+    const char *in = (const char *) src;
+    char *out = (char *) dst;
+    size_t block_size = getBlockSize(elem_size);
+    size_t block_bytes = block_size * elem_size;
+    if (m_planes.size() < block_bytes) {
+        m_planes.resize(block_bytes);
+        m_bits.resize(block_bytes);
+    }
+
+    writeUint64BE(out, uint64_t(nb_elems) * elem_size);
+    writeUint32BE(out + 8, uint32_t(block_bytes));
+    char *op = out + 12;
+
+    size_t i = 0;
+    for (; i + block_size <= nb_elems; i += block_size)
+        op += compressBlock(in + i * elem_size, block_size, elem_size, op);
+    size_t last_block = (nb_elems - i) - (nb_elems - i) % BSHUF_BLOCKED_MULT;
+    if (last_block) {
+        op += compressBlock(in + i * elem_size, last_block, elem_size, op);
+        i += last_block;
+    }
+    size_t leftover = (nb_elems - i) * elem_size;
+    memcpy(op, in + i * elem_size, leftover);
+    op += leftover;
+    return op - out;
+}
+
+size_t ChunkCompressor::compressBlock(const char *src, size_t nb_elems, int elem_size, char *dst) {
+    size_t block_bytes = nb_elems * elem_size;
+    transposeBytes(src, nb_elems, elem_size, &m_planes[0]);
+    for (int b = 0; b < elem_size; b++)
+        transposeBitPlane(&m_planes[b * nb_elems], nb_elems, &m_bits[b * nb_elems]);
+    size_t size = lz4Compress(&m_bits[0], block_bytes, dst + 4, &m_hash[0]);
+    writeUint32BE(dst, uint32_t(size));
+    return 4 + size;
+}
@@ -0,0 +1,559 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadChunkWriter.cpp
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "imXpadChunkWriter.h"
+#include "lima/Exceptions.h"
+
+#ifdef IMXPAD_WITH_HDF5
+#include <hdf5.h>
+#endif
+
+using namespace std;
+using namespace lima;
+using namespace lima::imXpad;
+
+static const char CHUNK_DATASET[] = "/entry/data/data";
+static const int CHUNK_EXTENT_STEP = 1024;	// frames the dataset is extended by
+
+//---------------------------
+//- compression threads
+//---------------------------
+class ChunkWriter::CompressThread : public Thread {
+    DEB_CLASS_NAMESPC(DebModCamera, "ChunkWriter", "CompressThread");
+public:
+    CompressThread(ChunkWriter& writer);
+    virtual ~CompressThread();
+
+protected:
+    virtual void threadFunction();
+
+private:
+    ChunkWriter& m_writer;
+    ChunkCompressor m_compressor;
+};
+
+ChunkWriter::CompressThread::CompressThread(ChunkWriter& writer) :
+    m_writer(writer)
+{
+    pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+ChunkWriter::CompressThread::~CompressThread() {
+}
+
+void ChunkWriter::CompressThread::threadFunction() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_writer.m_cond.mutex());
+    ++m_writer.m_nb_running;
+    m_writer.m_cond.broadcast();
+
+    while (!m_writer.m_thread_exit) {
+        int slot = m_writer.getSlotToCompress();
+        if (slot < 0) {
+            m_writer.m_cond.wait();
+            continue;
+        }
+        // the slot is marked Compressing, not touched by the other threads
+        aLock.unlock();
+        m_writer.compressSlot(slot, m_compressor);
+        aLock.lock();
+        m_writer.m_cond.broadcast();
+    }
+
+    --m_writer.m_nb_running;
+    m_writer.m_cond.broadcast();
+}
+
+//---------------------------
+//- writer thread
+//---------------------------
+class ChunkWriter::WriterThread : public Thread {
+    DEB_CLASS_NAMESPC(DebModCamera, "ChunkWriter", "WriterThread");
+public:
+    WriterThread(ChunkWriter& writer);
+    virtual ~WriterThread();
+
+protected:
+    virtual void threadFunction();
+
+private:
+    ChunkWriter& m_writer;
+};
+
+ChunkWriter::WriterThread::WriterThread(ChunkWriter& writer) :
+    m_writer(writer)
+{
+    pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+ChunkWriter::WriterThread::~WriterThread() {
+}
+
+void ChunkWriter::WriterThread::threadFunction() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_writer.m_cond.mutex());
+    ++m_writer.m_nb_running;
+    m_writer.m_cond.broadcast();
+
+    while (!m_writer.m_thread_exit) {
+        // the chunks are written in the order of the frames
+        if (m_writer.m_depth == 0 || m_writer.m_states[m_writer.m_head] != Compressed) {
+            m_writer.m_cond.wait();
+            continue;
+        }
+        aLock.unlock();
+        m_writer.writeSlot();
+        aLock.lock();
+        m_writer.m_cond.broadcast();
+    }
+
+    --m_writer.m_nb_running;
+    m_writer.m_cond.broadcast();
+}
+
+//---------------------------
+//- HDF5 file
+//---------------------------
+#ifdef IMXPAD_WITH_HDF5
+
+struct ChunkWriter::H5File {
+    hid_t file;
+    hid_t dataset;
+    hsize_t dims[3];
+    hsize_t extent;
+
+    H5File() : file(-1), dataset(-1), extent(0) {}
+};
+
+static hid_t getHdf5Type(ImageType image_type) {
+    switch (image_type) {
+    case Bpp8:   return H5T_NATIVE_UINT8;
+    case Bpp8S:  return H5T_NATIVE_INT8;
+    case Bpp16:  return H5T_NATIVE_UINT16;
+    case Bpp16S: return H5T_NATIVE_INT16;
+    case Bpp32:  return H5T_NATIVE_UINT32;
+    case Bpp32S: return H5T_NATIVE_INT32;
+    case Bpp32F: return H5T_NATIVE_FLOAT;
+    default:     return -1;
+    }
+}
+
+bool ChunkWriter::isAvailable() {
+    return true;
+}
+
+void ChunkWriter::openFile() {
+    DEB_MEMBER_FUNCT();
+
+    hid_t type = getHdf5Type(m_frame_dim.getImageType());
+    if (type < 0)
+        THROW_HW_ERROR(NotSupported) << "No HDF5 type for image type " << m_frame_dim.getImageType();
+
+    H5File *h5 = new H5File;
+    const Size& size = m_frame_dim.getSize();
+    h5->dims[0] = 0;
+    h5->dims[1] = size.getHeight();
+    h5->dims[2] = size.getWidth();
+    hsize_t max_dims[3] = { H5S_UNLIMITED, h5->dims[1], h5->dims[2] };
+    hsize_t chunk_dims[3] = { 1, h5->dims[1], h5->dims[2] };
+    // bitshuffle version, element size, block size, LZ4: the filter is
+    // optional, the file is written even where it is not installed
+    unsigned int cd_values[5] = { 0, 3, unsigned(m_frame_dim.getDepth()),
+                                  unsigned(ChunkCompressor::getBlockSize(m_frame_dim.getDepth())),
+                                  ChunkCompressor::Lz4 };
+
+    h5->file = H5Fcreate(m_file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (h5->file >= 0) {
+        hid_t space = H5Screate_simple(3, h5->dims, max_dims);
+        hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+        H5Pset_create_intermediate_group(lcpl, 1);
+        hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(dcpl, 3, chunk_dims);
+        H5Pset_filter(dcpl, ChunkCompressor::FilterId, H5Z_FLAG_OPTIONAL, 5, cd_values);
+        H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER);
+        h5->dataset = H5Dcreate2(h5->file, CHUNK_DATASET, type, space, lcpl, dcpl, H5P_DEFAULT);
+        H5Pclose(dcpl);
+        H5Pclose(lcpl);
+        H5Sclose(space);
+    }
+    if (h5->dataset < 0) {
+        if (h5->file >= 0)
+            H5Fclose(h5->file);
+        delete h5;
+        THROW_HW_ERROR(Error) << "Cannot create " << CHUNK_DATASET << " in " << m_file_name;
+    }
+    m_h5 = h5;
+}
+
+// writer thread, without the lock
+bool ChunkWriter::writeChunk(int frame_nb, const char *chunk, size_t size) {
+    DEB_MEMBER_FUNCT();
+
+    H5File *h5 = m_h5;
+    if (hsize_t(frame_nb) >= h5->extent) {
+        h5->dims[0] = h5->extent = frame_nb + CHUNK_EXTENT_STEP;
+        if (H5Dset_extent(h5->dataset, h5->dims) < 0)
+            return false;
+    }
+    hsize_t offset[3] = { hsize_t(frame_nb), 0, 0 };
+    return H5Dwrite_chunk(h5->dataset, H5P_DEFAULT, 0, offset, size, chunk) >= 0;
+}
+
+void ChunkWriter::closeFile() {
+    DEB_MEMBER_FUNCT();
+
+    H5File *h5 = m_h5;
+    if (!h5)
+        return;
+    // the extent ahead is given back
+    h5->dims[0] = m_write_frame_nb;
+    if (H5Dset_extent(h5->dataset, h5->dims) < 0)
+        DEB_ERROR() << "Cannot set the extent of " << CHUNK_DATASET << " to " << m_write_frame_nb;
+    H5Dclose(h5->dataset);
+    if (H5Fclose(h5->file) < 0)
+        DEB_ERROR() << "Closing " << m_file_name;
+    delete h5;
+    m_h5 = NULL;
+}
+
+#else
+
+struct ChunkWriter::H5File {
+};
+
+bool ChunkWriter::isAvailable() {
+    return false;
+}
+
+void ChunkWriter::openFile() {
+    DEB_MEMBER_FUNCT();
+
+    THROW_HW_ERROR(NotSupported) << "imXpad built without HDF5, see IMXPAD_ENABLE_HDF5";
+}
+
+bool ChunkWriter::writeChunk(int /*frame_nb*/, const char * /*chunk*/, size_t /*size*/) {
+    return false;
+}
+
+void ChunkWriter::closeFile() {
+}
+
+#endif
+
+//---------------------------
+//- ChunkWriter
+//---------------------------
+ChunkWriter::ChunkWriter() :
+    m_writer_thread(NULL), m_nb_running(0), m_thread_exit(false),
+    m_nb_threads(4), m_queue_frames(32), m_acq_nb(0), m_open(false), m_failed(false), m_h5(NULL),
+    m_frame_size(0), m_chunk_max_size(0), m_head(0), m_depth(0),
+    m_write_frame_nb(0), m_nb_written(0), m_nb_dropped(0), m_max_depth(0),
+    m_frame_bytes(0), m_chunk_bytes(0), m_written_bytes(0), m_compress_time(0), m_write_time(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+ChunkWriter::~ChunkWriter() {
+    DEB_DESTRUCTOR();
+
+    close();
+    stopThreads();
+}
+
+void ChunkWriter::startThreads() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    m_thread_exit = false;
+    for (int i = 0; i < m_nb_threads; i++) {
+        m_threads.push_back(new CompressThread(*this));
+        m_threads.back()->start();
+    }
+    m_writer_thread = new WriterThread(*this);
+    m_writer_thread->start();
+    while (m_nb_running < m_nb_threads + 1)
+        m_cond.wait();
+}
+
+void ChunkWriter::stopThreads() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    m_thread_exit = true;
+    m_cond.broadcast();
+    while (m_nb_running > 0)
+        m_cond.wait();
+    aLock.unlock();
+    for (size_t i = 0; i < m_threads.size(); i++)
+        delete m_threads[i];
+    m_threads.clear();
+    delete m_writer_thread;
+    m_writer_thread = NULL;
+}
+
+void ChunkWriter::setFilePrefix(const std::string& prefix) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(prefix);
+
+    AutoMutex aLock(m_cond.mutex());
+    if (prefix != m_prefix)
+        m_acq_nb = 0;
+    m_prefix = prefix;
+}
+
+const std::string& ChunkWriter::getFilePrefix() {
+    return m_prefix;
+}
+
+void ChunkWriter::setNbThreads(int nb_threads) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_threads);
+
+    if (nb_threads < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_threads) << ", min. 1";
+    AutoMutex aLock(m_cond.mutex());
+    if (m_open)
+        THROW_HW_ERROR(Error) << "Cannot change the compression threads while writing";
+    m_nb_threads = nb_threads;
+}
+
+int ChunkWriter::getNbThreads() {
+    return m_nb_threads;
+}
+
+void ChunkWriter::setQueueFrames(int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_frames);
+
+    if (nb_frames < 2)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames) << ", min. 2";
+    AutoMutex aLock(m_cond.mutex());
+    if (m_open)
+        THROW_HW_ERROR(Error) << "Cannot resize the chunk writer queue while writing";
+    m_queue_frames = nb_frames;
+}
+
+int ChunkWriter::getQueueFrames() {
+    return m_queue_frames;
+}
+
+void ChunkWriter::allocQueue() {
+    DEB_MEMBER_FUNCT();
+
+    size_t nb_elems = m_frame_size / m_frame_dim.getDepth();
+    m_chunk_max_size = ChunkCompressor::getMaxChunkSize(nb_elems, m_frame_dim.getDepth());
+    m_frames.resize(m_frame_size * m_queue_frames);
+    m_chunks.resize(m_chunk_max_size * m_queue_frames);
+    m_states.assign(m_queue_frames, Free);
+    m_chunk_sizes.assign(m_queue_frames, 0);
+}
+
+void ChunkWriter::open(const FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+
+    close();
+
+    if (int(m_threads.size()) != m_nb_threads) {
+        stopThreads();
+        startThreads();
+    }
+
+    AutoMutex aLock(m_cond.mutex());
+    if (m_prefix.empty())
+        THROW_HW_ERROR(Error) << "No HDF5 file prefix";
+
+    m_frame_dim = frame_dim;
+    m_frame_size = frame_dim.getMemSize();
+    allocQueue();
+
+    ostringstream name;
+    name << m_prefix << "_" << setfill('0') << setw(4) << m_acq_nb << ".h5";
+    m_file_name = name.str();
+    openFile();
+
+    m_failed = false;
+    m_head = m_depth = 0;
+    m_write_frame_nb = 0;
+    m_nb_written = m_nb_dropped = m_max_depth = 0;
+    m_frame_bytes = m_chunk_bytes = m_written_bytes = 0;
+    m_compress_time = m_write_time = 0;
+    m_first_put = m_last_written = Timestamp();
+    m_open = true;
+    DEB_TRACE() << "Compressed chunks written to " << m_file_name << ", " << DEB_VAR1(m_nb_threads);
+}
+
+// with the lock: the first frame waiting for a compression thread, -1 = none
+int ChunkWriter::getSlotToCompress() {
+    for (int i = 0; i < m_depth; i++) {
+        int slot = (m_head + i) % m_queue_frames;
+        if (m_states[slot] == Filled) {
+            m_states[slot] = Compressing;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// compression thread, without the lock
+void ChunkWriter::compressSlot(int slot, ChunkCompressor& compressor) {
+    DEB_MEMBER_FUNCT();
+
+    Timestamp t0 = Timestamp::now();
+    size_t size = compressor.compress(&m_frames[slot * m_frame_size], m_frame_size / m_frame_dim.getDepth(),
+                                      m_frame_dim.getDepth(), &m_chunks[slot * m_chunk_max_size]);
+    double elapsed = Timestamp::now() - t0;
+
+    AutoMutex aLock(m_cond.mutex());
+    m_chunk_sizes[slot] = size;
+    m_states[slot] = Compressed;
+    m_frame_bytes += m_frame_size;
+    m_chunk_bytes += size;
+    m_compress_time += elapsed;
+}
+
+// writer thread, without the lock: the head slot, compressed
+void ChunkWriter::writeSlot() {
+    DEB_MEMBER_FUNCT();
+
+    int slot = m_head;
+    size_t size = m_chunk_sizes[slot];
+    bool ok = !m_failed;
+    if (ok) {
+        Timestamp t0 = Timestamp::now();
+        ok = writeChunk(m_write_frame_nb, &m_chunks[slot * m_chunk_max_size], size);
+        m_write_time += Timestamp::now() - t0;
+        if (!ok)
+            DEB_ERROR() << "Writing frame " << m_write_frame_nb << " to " << m_file_name
+                        << ", HDF5 output stopped";
+    }
+    m_failed = !ok;
+    if (ok)
+        ++m_write_frame_nb;
+
+    AutoMutex aLock(m_cond.mutex());
+    m_states[slot] = Free;
+    m_head = (m_head + 1) % m_queue_frames;
+    --m_depth;
+    if (ok) {
+        ++m_nb_written;
+        m_written_bytes += size;
+        m_last_written = Timestamp::now();
+    } else {
+        ++m_nb_dropped;
+    }
+}
+
+void ChunkWriter::put(const void *frame) {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_open)
+        return;
+    // a full queue holds the acquisition thread back
+    while (m_depth == m_queue_frames)
+        m_cond.wait();
+    int slot = (m_head + m_depth) % m_queue_frames;
+    if (!m_first_put.isSet())
+        m_first_put = Timestamp::now();
+    ++m_depth;
+    m_max_depth = std::max(m_max_depth, m_depth);
+    aLock.unlock();
+
+    // the slot is in the queue but Free: not touched by the threads
+    memcpy(&m_frames[slot * m_frame_size], frame, m_frame_size);
+
+    aLock.lock();
+    m_states[slot] = Filled;
+    m_cond.broadcast();
+}
+
+void ChunkWriter::close() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_open)
+        return;
+    while (m_depth > 0)
+        m_cond.wait();
+    m_open = false;
+    aLock.unlock();
+
+    closeFile();
+    ++m_acq_nb;
+    DEB_TRACE() << DEB_VAR3(m_nb_written, m_nb_dropped, getCompressionRatio());
+}
+
+bool ChunkWriter::isOpen() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_open;
+}
+
+const std::string& ChunkWriter::getFileName() {
+    return m_file_name;
+}
+
+int ChunkWriter::getNbFramesWritten() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_nb_written;
+}
+
+int ChunkWriter::getNbFramesDropped() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_nb_dropped;
+}
+
+int ChunkWriter::getMaxQueueDepth() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_max_depth;
+}
+
+double ChunkWriter::getCompressionRatio() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_chunk_bytes ? double(m_frame_bytes) / m_chunk_bytes : 0;
+}
+
+double ChunkWriter::getCompressRate() {
+    AutoMutex aLock(m_cond.mutex());
+    return (m_compress_time > 0) ? m_frame_bytes / m_compress_time / 1e6 : 0;
+}
+
+double ChunkWriter::getWriteRate() {
+    AutoMutex aLock(m_cond.mutex());
+    return (m_write_time > 0) ? m_written_bytes / m_write_time / 1e6 : 0;
+}
+
+double ChunkWriter::getThroughput() {
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_first_put.isSet() || !m_last_written.isSet())
+        return 0;
+    double elapsed = m_last_written - m_first_put;
+    return (elapsed > 0) ? m_nb_written * double(m_frame_size) / elapsed / 1e6 : 0;
+}
@@ -31,6 +31,7 @@
 #include <iomanip>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
 
 #include <stdarg.h>
 #include <errno.h>
@@ -43,6 +44,7 @@
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdlib.h>
 
@@ -72,6 +74,7 @@ XpadClient::XpadClient() : m_debugMessages() {
     pipe_act.sa_handler = SIG_IGN;
     sigaction(SIGPIPE, &pipe_act, 0);
     m_valid = 0;
+    m_wire_pixel_depth = sizeof(int32_t);
 }
 
 XpadClient::~XpadClient() {
@@ -248,6 +251,78 @@ int XpadClient::receiveParametersFile(const char* filePath){
     }
 }
 
+int XpadClient::receiveData(std::vector<char>& data, uint32_t expected_size){
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(expected_size);
+
+    // size, 4 bytes not used, then the data
+    unsigned char data_chain[2*sizeof(uint32_t)];
+    if (readData(data_chain, sizeof(data_chain)) < 0) {
+        errmsg_handler("Connection lost while receiving data");
+        return -1;
+    }
+    uint32_t data_size = data_chain[3]<<24|data_chain[2]<<16|data_chain[1]<<8|data_chain[0];
+
+    // the server found nothing to send
+    data.clear();
+    if (data_size == 0) {
+        string ack = "File not received\n";
+        if (write(m_skt, ack.c_str(), ack.length()) < 0)
+            return -1;
+        errmsg_handler("No data sent by the server");
+        return -1;
+    }
+
+    // a size not expected is not allocated: the data read and dropped,
+    // then refused, to keep the connection in sync
+    if (data_size != expected_size) {
+        stringstream msg;
+        msg << "Received data size " << data_size << " instead of " << expected_size;
+        if (discardData(data_size) < 0)
+            msg << ", connection lost";
+        errmsg_handler(msg.str());
+        string ack = "File not received\n";
+        ssize_t wret = write(m_skt, ack.c_str(), ack.length());
+        (void) wret;
+        return -1;
+    }
+
+    data.resize(data_size);
+    if (readData(&data[0], data_size) < 0) {
+        data.clear();
+        errmsg_handler("Connection lost while receiving data");
+        return -1;
+    }
+    string ack = "File received\n";
+    if (write(m_skt, ack.c_str(), ack.length()) < 0)
+        return -1;
+    return 0;
+}
+
+int XpadClient::readData(void *buff, size_t size) {
+    size_t bytes_received = 0;
+    while (bytes_received < size) {
+        ssize_t bytes = read(m_skt, (char *)buff + bytes_received, size - bytes_received);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return -1;
+        bytes_received += bytes;
+    }
+    return 0;
+}
+
+int XpadClient::discardData(size_t size) {
+    char buff[65536];
+    while (size > 0) {
+        size_t n = std::min(size, sizeof(buff));
+        if (readData(buff, n) < 0)
+            return -1;
+        size -= n;
+    }
+    return 0;
+}
+
 void XpadClient::sendExposeCommand(){
     DEB_MEMBER_FUNCT();
     stringstream cmd;
@@ -255,78 +330,198 @@ void XpadClient::sendExposeCommand(){
     sendNoWait(cmd.str());
 }
 
-int XpadClient::getDataExpose(void *bptr, unsigned short xpadFormat) {
+int XpadClient::readFrameHeader(uint32_t& data_size, int& width, int& height) {
     DEB_MEMBER_FUNCT();
 
-    int16_t *buffer_short;
-    int32_t *buffer_int;
-    int32_t *data_buff;
     ssize_t wret;
-    
-    if (xpadFormat==0)
-        buffer_short = (int16_t *)bptr;
-    else
-        buffer_int = (int32_t *)bptr;
-
-    uint32_t data_size = 0;
-    uint32_t line_final_image = 0;
-    uint32_t column_final_image = 0;
-    uint32_t bytes_received = 0;
-
     unsigned char data_chain[3*sizeof(int32_t)];
 
-    while (read(m_skt, data_chain, 3*sizeof(uint32_t)) < 0);
+    if (readData(data_chain, sizeof(data_chain)) < 0) {
+        errmsg_handler("Connection lost while receiving a frame header");
+        return -1;
+    }
 
     data_size = data_chain[3]<<24|data_chain[2]<<16|data_chain[1]<<8|data_chain[0];
-    line_final_image = data_chain[7]<<24|data_chain[6]<<16|data_chain[5]<<8|data_chain[4];
-    column_final_image = data_chain[11]<<24|data_chain[10]<<16|data_chain[9]<<8|data_chain[8];
+    uint32_t line_final_image = data_chain[7]<<24|data_chain[6]<<16|data_chain[5]<<8|data_chain[4];
+    uint32_t column_final_image = data_chain[11]<<24|data_chain[10]<<16|data_chain[9]<<8|data_chain[8];
 
     //DEB_TRACE() << data_size << " " << line_final_image << " " << column_final_image;
 
     if(data_size > 0 && data_chain[0] != '*'){
+        width = column_final_image;
+        height = line_final_image;
 
-        unsigned char *data = new unsigned char[data_size];
-        data_buff = new int32_t[line_final_image*column_final_image ];
-        ssize_t bytes;
-	ssize_t wret;
+        // 16 bit pixels if asked for and supported by the server, else 32 bit
+        size_t nb_pixels = size_t(width) * height;
+        m_wire_pixel_depth = (nb_pixels && data_size == nb_pixels * sizeof(int16_t)) ?
+            sizeof(int16_t) : sizeof(int32_t);
+        return 0;
+    }
+    else{
+        wret = write(m_skt,"\n",sizeof(char));
+        return -1;
+    }
+}
 
-        while(bytes_received < data_size){
-            while ((bytes = read(m_skt, data+bytes_received, data_size-bytes_received)) < 0);
-            bytes_received += bytes;
-            //cout << "\tReceived " << bytes_received << " out of " << data_size << " Bytes" << endl;
-        }
+int XpadClient::readFramePayload(void *buff, uint32_t data_size) {
+    DEB_MEMBER_FUNCT();
 
-        //stringstream message;
-        //message << "Image received\n";
-        //string tmp = message.str();
-        //write(m_skt,(char *)tmp.c_str(),tmp.length());
-        wret = write(m_skt,"\n",sizeof(char));
+    ssize_t wret;
 
-        uint32_t count = 0;
-        int i=0;
-        while (count < data_size){
+    // the pixels are little-endian integers, received in place
+    if (readData(buff, data_size) < 0) {
+        errmsg_handler("Connection lost while receiving a frame");
+        return -1;
+    }
 
-            if (xpadFormat==0){
-                memcpy (&data_buff[i], &data[count], sizeof(int32_t) );
-                buffer_short[i] = (int16_t)(data_buff[i]);
-            }
-            else{
-                memcpy (&data_buff[i], &data[count], sizeof(int32_t) );
-                buffer_int[i] = (int32_t)(data_buff[i]);
-            }
-            count += sizeof(int32_t);
-            i++;
-        }
+    //stringstream message;
+    //message << "Image received\n";
+    //string tmp = message.str();
+    //write(m_skt,(char *)tmp.c_str(),tmp.length());
+    wret = write(m_skt,"\n",sizeof(char));
+    return 0;
+}
 
-        delete[] data_buff;
-	delete[] data;
+int XpadClient::refuseFramePayload(uint32_t data_size, const std::string& errmsg) {
+    DEB_MEMBER_FUNCT();
+
+    // read and dropped, the frame acked to keep the connection in sync
+    if (discardData(data_size) < 0) {
+        errmsg_handler(errmsg + ", connection lost");
+        return -1;
+    }
+    errmsg_handler(errmsg);
+    ssize_t wret = write(m_skt,"\n",sizeof(char));
+    (void) wret;
+    return -1;
+}
+
+int XpadClient::setBusyPoll(int usec) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(usec);
+
+    // the blocking reads poll the device queue for up to usec before sleeping
+#ifdef SO_BUSY_POLL
+    if (setsockopt(m_skt, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == 0)
         return 0;
+    errmsg_handler(string("Cannot set the socket busy poll: ") + strerror(errno));
+#else
+    errmsg_handler("Socket busy poll not supported");
+#endif
+    return -1;
+}
+
+int XpadClient::waitData(int timeout_ms) {
+    DEB_MEMBER_FUNCT();
 
+    // the socket is read unbuffered: poll() sees every byte not yet read
+    struct pollfd pfd;
+    pfd.fd = m_skt;
+    pfd.events = POLLIN;
+    int ret;
+    while ((ret = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR);
+    if (ret < 0) {
+        errmsg_handler(string("Cannot poll the socket: ") + strerror(errno));
+        return -1;
     }
-    else{
-        wret = write(m_skt,"\n",sizeof(char));
+    return (ret > 0)? 1: 0;
+}
+
+int XpadClient::getDataExpose(void *bptr, size_t buffer_size, unsigned short xpadFormat,
+                              const FrameStatsCalc *stats_calc, FrameStats *stats) {
+    DEB_MEMBER_FUNCT();
+
+    uint32_t data_size;
+    int width, height;
+
+    if (readFrameHeader(data_size, width, height) < 0)
         return -1;
+
+    // a frame not filling the buffer exactly (module mask or geometry
+    // changed, bad header) is read aside and dropped, never written past it
+    size_t nb_pixels = size_t(width) * height;
+    size_t pixel_size = xpadFormat ? sizeof(int32_t) : sizeof(int16_t);
+    if (data_size != nb_pixels * m_wire_pixel_depth || nb_pixels * pixel_size != buffer_size) {
+        stringstream msg;
+        msg << "Received frame of " << width << "x" << height << " pixels, " << data_size
+            << " bytes, for a buffer of " << buffer_size << " bytes";
+        return refuseFramePayload(data_size, msg.str());
     }
+
+    // statistics added by the loops decoding the pixels, or right
+    // after the frames received in place, still in cache
+    Size size(width, height);
+    if (!stats)
+        stats_calc = NULL;
+
+    // pixels of the format of the buffer: received directly in it
+    unsigned short wire_format = (m_wire_pixel_depth == sizeof(int16_t))? 0: 1;
+    if (wire_format == xpadFormat) {
+        if (readFramePayload(bptr, data_size) < 0)
+            return -1;
+        if (stats_calc && wire_format == 0)
+            stats_calc->add(*stats, (const int16_t *) bptr, size);
+        else if (stats_calc)
+            stats_calc->add(*stats, (const int32_t *) bptr, size);
+        return 0;
+    }
+
+    if (wire_format == 0) {
+        m_raw_data16.resize(nb_pixels);
+        if (readFramePayload(&m_raw_data16[0], data_size) < 0)
+            return -1;
+        int32_t *buffer_int = (int32_t *)bptr;
+        for (size_t i = 0; i < nb_pixels; i++)
+            buffer_int[i] = m_raw_data16[i];
+        if (stats_calc)
+            stats_calc->add(*stats, &m_raw_data16[0], size);
+    } else {
+        m_raw_data.resize(nb_pixels);
+        if (readFramePayload(&m_raw_data[0], data_size) < 0)
+            return -1;
+        int16_t *buffer_short = (int16_t *)bptr;
+        if (stats_calc)
+            stats_calc->add(*stats, &m_raw_data[0], size, buffer_short);
+        else
+            for (size_t i = 0; i < nb_pixels; i++)
+                buffer_short[i] = (int16_t)(m_raw_data[i]);
+    }
+
+    return 0;
+}
+
+int XpadClient::getRawDataExpose(std::vector<int32_t>& data, int& width, int& height) {
+    DEB_MEMBER_FUNCT();
+
+    uint32_t data_size;
+
+    if (readFrameHeader(data_size, width, height) < 0)
+        return -1;
+
+    size_t nb_pixels = size_t(width) * height;
+    if (data_size != nb_pixels * m_wire_pixel_depth) {
+        stringstream msg;
+        msg << "Received frame of " << width << "x" << height << " pixels, " << data_size
+            << " bytes";
+        return refuseFramePayload(data_size, msg.str());
+    }
+
+    // in a buffer reused from frame to frame
+    if (m_wire_pixel_depth == sizeof(int16_t)) {
+        m_raw_data16.resize(nb_pixels);
+        if (readFramePayload(&m_raw_data16[0], data_size) < 0)
+            return -1;
+        data.assign(m_raw_data16.begin(), m_raw_data16.end());
+    } else {
+        data.resize(nb_pixels);
+        if (readFramePayload(&data[0], data_size) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int XpadClient::getWirePixelDepth() {
+    return m_wire_pixel_depth;
 }
 
 void XpadClient::getExposeCommandReturn(int &value){
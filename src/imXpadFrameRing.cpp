@@ -0,0 +1,308 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadFrameRing.cpp
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "imXpadFrameRing.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+static const size_t RING_SLOT_HEADERS = 64;	// offset of the slot headers
+static const int RING_READ_RETRIES = 100;
+
+static size_t alignSize(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+static std::string shmName(const std::string& name)
+{
+    return (name[0] == '/') ? name : "/" + name;
+}
+
+//---------------------------
+//- FrameRing
+//---------------------------
+FrameRing::FrameRing() :
+    m_nb_slots(0), m_slot_size(0), m_map(NULL), m_map_size(0),
+    m_header(NULL), m_slots(NULL), m_data(NULL), m_nb_published(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+FrameRing::~FrameRing() {
+    DEB_DESTRUCTOR();
+    close();
+}
+
+void FrameRing::open(const std::string& name, const FrameDim& frame_dim, int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR3(name, frame_dim, nb_frames);
+
+    if (name.empty())
+        THROW_HW_ERROR(InvalidValue) << "No frame ring name";
+    if (nb_frames < 2)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames) << ", min. 2";
+
+    std::string shm_name = shmName(name);
+    if (!m_map || shm_name != m_name || frame_dim != m_frame_dim || nb_frames != m_nb_slots) {
+        close();
+        m_name = shm_name;
+        m_frame_dim = frame_dim;
+        m_nb_slots = nb_frames;
+        map();
+    }
+
+    // the frame numbers start again: readers tell the frames apart by acq. nb.
+    ++m_header->acq_nb;
+    m_header->last_frame = -1;
+    m_nb_published = 0;
+}
+
+// a new segment each time, the readers keep their mapping of the old one
+void FrameRing::map() {
+    DEB_MEMBER_FUNCT();
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t header_size = alignSize(RING_SLOT_HEADERS + m_nb_slots * sizeof(FrameSlotHeader), page_size);
+    m_slot_size = alignSize(m_frame_dim.getMemSize(), page_size);
+    m_map_size = header_size + m_slot_size * m_nb_slots;
+
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        THROW_HW_ERROR(Error) << "Cannot create shared memory " << m_name << ": " << strerror(errno);
+    if (ftruncate(fd, m_map_size) != 0) {
+        ::close(fd);
+        shm_unlink(m_name.c_str());
+        THROW_HW_ERROR(Error) << "Cannot size shared memory " << m_name << ": " << strerror(errno);
+    }
+    void *map = mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        THROW_HW_ERROR(Error) << "Cannot map shared memory " << m_name << ": " << strerror(errno);
+    }
+    m_map = (char *) map;
+    m_header = (FrameRingHeader *) m_map;
+    m_slots = (FrameSlotHeader *) (m_map + RING_SLOT_HEADERS);
+    m_data = m_map + header_size;
+
+    // touched now rather than on the first pass of the acquisition thread
+    for (size_t offset = 0; offset < m_map_size; offset += page_size)
+        m_map[offset] = 0;
+    for (int i = 0; i < m_nb_slots; i++)
+        m_slots[i].frame_nb = -1;
+
+    m_header->version = VERSION;
+    m_header->header_size = header_size;
+    m_header->nb_slots = m_nb_slots;
+    m_header->slot_size = m_slot_size;
+    m_header->slot_header_size = sizeof(FrameSlotHeader);
+    m_header->acq_nb = 0;
+    m_header->last_frame = -1;
+    __sync_synchronize();
+    m_header->magic = MAGIC;
+    DEB_TRACE() << "Frame ring " << m_name << ": " << m_nb_slots << " slots of " << m_slot_size << " bytes";
+}
+
+void FrameRing::unmap() {
+    DEB_MEMBER_FUNCT();
+
+    if (!m_map)
+        return;
+    m_header->magic = 0;
+    munmap(m_map, m_map_size);
+    m_map = NULL;
+    m_map_size = 0;
+    m_header = NULL;
+    m_slots = NULL;
+    m_data = NULL;
+}
+
+void FrameRing::close() {
+    DEB_MEMBER_FUNCT();
+
+    if (!m_map)
+        return;
+    unmap();
+    shm_unlink(m_name.c_str());
+}
+
+bool FrameRing::isOpen() const {
+    return m_map != NULL;
+}
+
+void FrameRing::publish(int frame_nb, const void *frame, double timestamp) {
+    if (!m_map)
+        return;
+    int slot = frame_nb % m_nb_slots;
+    FrameSlotHeader *header = &m_slots[slot];
+    const Size& size = m_frame_dim.getSize();
+
+    // odd sequence number while written
+    __sync_fetch_and_add(&header->seq, 1);
+    __sync_synchronize();
+    header->frame_nb = frame_nb;
+    header->acq_nb = m_header->acq_nb;
+    header->width = size.getWidth();
+    header->height = size.getHeight();
+    header->depth = m_frame_dim.getDepth();
+    header->image_type = m_frame_dim.getImageType();
+    header->data_size = m_frame_dim.getMemSize();
+    header->timestamp = timestamp;
+    memcpy(m_data + slot * m_slot_size, frame, header->data_size);
+    __sync_synchronize();
+    __sync_fetch_and_add(&header->seq, 1);
+
+    m_header->last_frame = frame_nb;
+    ++m_nb_published;
+}
+
+int FrameRing::getNbPublished() const {
+    return m_nb_published;
+}
+
+//---------------------------
+//- FrameRingReader
+//---------------------------
+FrameRingReader::FrameRingReader() :
+    m_map(NULL), m_map_size(0), m_header(NULL)
+{
+    DEB_CONSTRUCTOR();
+}
+
+FrameRingReader::~FrameRingReader() {
+    DEB_DESTRUCTOR();
+    close();
+}
+
+void FrameRingReader::open(const std::string& name) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(name);
+
+    close();
+    if (name.empty())
+        THROW_HW_ERROR(InvalidValue) << "No frame ring name";
+    m_name = shmName(name);
+
+    int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        THROW_HW_ERROR(Error) << "Cannot open shared memory " << m_name << ": " << strerror(errno);
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(FrameRingHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        THROW_HW_ERROR(Error) << "Cannot map shared memory " << m_name;
+
+    const FrameRingHeader *header = (const FrameRingHeader *) map;
+    size_t map_size = st.st_size;
+    if (header->magic != FrameRing::MAGIC || header->version != FrameRing::VERSION ||
+        header->header_size + header->slot_size * header->nb_slots > map_size) {
+        munmap(map, map_size);
+        THROW_HW_ERROR(Error) << m_name << " is not a frame ring";
+    }
+    m_map = (char *) map;
+    m_map_size = map_size;
+    m_header = header;
+}
+
+void FrameRingReader::close() {
+    if (!m_map)
+        return;
+    munmap(m_map, m_map_size);
+    m_map = NULL;
+    m_map_size = 0;
+    m_header = NULL;
+}
+
+bool FrameRingReader::isStale() const {
+    return !m_header || m_header->magic != FrameRing::MAGIC;
+}
+
+uint32_t FrameRingReader::getAcqNb() const {
+    return m_header ? *(const volatile uint32_t *) &m_header->acq_nb : 0;
+}
+
+int FrameRingReader::getLastFrameNb() const {
+    return m_header ? *(const volatile int32_t *) &m_header->last_frame : -1;
+}
+
+const void *FrameRingReader::getFrame(int frame_nb, FrameSlotHeader& header, uint32_t& seq) const {
+    if (isStale() || frame_nb < 0)
+        return NULL;
+    int slot = frame_nb % m_header->nb_slots;
+    const volatile FrameSlotHeader *slot_header =
+        (const volatile FrameSlotHeader *) (m_map + RING_SLOT_HEADERS) + slot;
+    uint32_t acq_nb = getAcqNb();
+
+    // a slot being written is read again, given up if rewritten meanwhile
+    for (int retry = 0; retry < RING_READ_RETRIES; retry++) {
+        seq = slot_header->seq;
+        if (seq & 1)
+            continue;
+        __sync_synchronize();
+        memcpy(&header, (const void *) slot_header, sizeof(header));
+        __sync_synchronize();
+        if (slot_header->seq != seq)
+            continue;
+        if (header.frame_nb != frame_nb || header.acq_nb != acq_nb)
+            return NULL;
+        return m_map + m_header->header_size + slot * m_header->slot_size;
+    }
+    return NULL;
+}
+
+bool FrameRingReader::isValid(int frame_nb, uint32_t seq) const {
+    if (!m_header || frame_nb < 0)
+        return false;
+    int slot = frame_nb % m_header->nb_slots;
+    const volatile FrameSlotHeader *slot_header =
+        (const volatile FrameSlotHeader *) (m_map + RING_SLOT_HEADERS) + slot;
+    __sync_synchronize();
+    return slot_header->seq == seq;
+}
+
+bool FrameRingReader::readFrame(int frame_nb, void *dst, size_t size, FrameSlotHeader& header) const {
+    for (int retry = 0; retry < RING_READ_RETRIES; retry++) {
+        uint32_t seq;
+        const void *frame = getFrame(frame_nb, header, seq);
+        if (!frame)
+            return false;
+        memcpy(dst, frame, std::min<size_t>(size, header.data_size));
+        if (isValid(frame_nb, seq))
+            return true;
+    }
+    return false;
+}
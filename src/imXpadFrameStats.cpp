@@ -0,0 +1,384 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadFrameStats.cpp
+ */
+
+#include <algorithm>
+#include "imXpadFrameStats.h"
+#include "lima/Exceptions.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace lima;
+using namespace lima::imXpad;
+
+//---------------------------
+//- kernels, vectorized when the target allows it
+//---------------------------
+
+#if !defined(__AVX2__) && defined(__SSE2__)
+// SSE2 has no signed 32 bit min/max
+static inline __m128i min_epi32(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static inline __m128i max_epi32(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+// sum (64 bit), min, max and pixels >= sat of n pixels, added to the arguments
+static void segmentStats(const int32_t *src, size_t n, int32_t sat, long long& sum,
+                         int32_t& min, int32_t& max, int& nb_sat)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (n >= 8) {
+        const __m256i vsat = _mm256_set1_epi32(sat - 1);
+        __m256i vsum = _mm256_setzero_si256();
+        __m256i vmin = _mm256_set1_epi32(min);
+        __m256i vmax = _mm256_set1_epi32(max);
+        __m256i vcnt = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256i lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(a));
+            __m256i hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(a, 1));
+            vsum = _mm256_add_epi64(vsum, _mm256_add_epi64(lo, hi));
+            vmin = _mm256_min_epi32(vmin, a);
+            vmax = _mm256_max_epi32(vmax, a);
+            // -1 per lane above sat - 1
+            vcnt = _mm256_sub_epi32(vcnt, _mm256_cmpgt_epi32(a, vsat));
+        }
+        long long s[4];
+        int32_t m[8], M[8], c[8];
+        _mm256_storeu_si256((__m256i *)s, vsum);
+        _mm256_storeu_si256((__m256i *)m, vmin);
+        _mm256_storeu_si256((__m256i *)M, vmax);
+        _mm256_storeu_si256((__m256i *)c, vcnt);
+        sum += s[0] + s[1] + s[2] + s[3];
+        for (int j = 0; j < 8; j++) {
+            min = std::min(min, m[j]);
+            max = std::max(max, M[j]);
+            nb_sat += c[j];
+        }
+    }
+#elif defined(__SSE2__)
+    if (n >= 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i vsat = _mm_set1_epi32(sat - 1);
+        __m128i vsum = _mm_setzero_si128();
+        __m128i vmin = _mm_set1_epi32(min);
+        __m128i vmax = _mm_set1_epi32(max);
+        __m128i vcnt = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            // sign extension to 64 bit
+            __m128i sign = _mm_cmpgt_epi32(zero, a);
+            vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(a, sign));
+            vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(a, sign));
+            vmin = min_epi32(vmin, a);
+            vmax = max_epi32(vmax, a);
+            vcnt = _mm_sub_epi32(vcnt, _mm_cmpgt_epi32(a, vsat));
+        }
+        long long s[2];
+        int32_t m[4], M[4], c[4];
+        _mm_storeu_si128((__m128i *)s, vsum);
+        _mm_storeu_si128((__m128i *)m, vmin);
+        _mm_storeu_si128((__m128i *)M, vmax);
+        _mm_storeu_si128((__m128i *)c, vcnt);
+        sum += s[0] + s[1];
+        for (int j = 0; j < 4; j++) {
+            min = std::min(min, m[j]);
+            max = std::max(max, M[j]);
+            nb_sat += c[j];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        int32_t v = src[i];
+        sum += v;
+        min = std::min(min, v);
+        max = std::max(max, v);
+        nb_sat += (v >= sat);
+    }
+}
+
+// 16 bit frames (from the 16 bit transfer): left to the compiler
+static void segmentStats(const int16_t *src, size_t n, int32_t sat, long long& sum,
+                         int32_t& min, int32_t& max, int& nb_sat)
+{
+    int32_t s = 0, m = min, M = max, c = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = src[i];
+        s += v;
+        m = std::min(m, v);
+        M = std::max(M, v);
+        c += (v >= sat);
+    }
+    sum += s;
+    min = m;
+    max = M;
+    nb_sat += c;
+}
+
+// pixels > threshold of a row appended to events, pixel indexes from first
+static void rowEvents(const int32_t *src, size_t n, int32_t threshold, uint32_t first,
+                      std::vector<SparseEvent>& events)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i t = _mm256_set1_epi32(threshold);
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        // most blocks have no event at low occupancy
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, t)));
+        for (; mask; mask &= mask - 1) {
+            int j = __builtin_ctz(mask);
+            SparseEvent event = { uint32_t(first + i + j), src[i + j] };
+            events.push_back(event);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i t = _mm_set1_epi32(threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, t)));
+        for (; mask; mask &= mask - 1) {
+            int j = __builtin_ctz(mask);
+            SparseEvent event = { uint32_t(first + i + j), src[i + j] };
+            events.push_back(event);
+        }
+    }
+#endif
+    for (; i < n; i++)
+        if (src[i] > threshold) {
+            SparseEvent event = { uint32_t(first + i), src[i] };
+            events.push_back(event);
+        }
+}
+
+static void rowEvents(const int16_t *src, size_t n, int32_t threshold, uint32_t first,
+                      std::vector<SparseEvent>& events)
+{
+    for (size_t i = 0; i < n; i++)
+        if (src[i] > threshold) {
+            SparseEvent event = { uint32_t(first + i), src[i] };
+            events.push_back(event);
+        }
+}
+
+//---------------------------
+//- FrameStats
+//---------------------------
+
+void FrameStats::reset(int nb) {
+    frame_nb = nb;
+    sum = 0;
+    min = INT32_MAX;
+    max = INT32_MIN;
+    nb_saturated = 0;
+    chip_sums.clear();
+    roi_sums.clear();
+    events.clear();
+}
+
+//---------------------------
+//- FrameStatsCalc
+//---------------------------
+
+FrameStatsCalc::FrameStatsCalc() :
+    m_chip_size(80, 120), m_saturation(INT16_MAX), m_roi_counters(NULL),
+    m_sparse_events(false), m_sparse_threshold(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+void FrameStatsCalc::setChipSize(const Size& chip_size) {
+    m_chip_size = chip_size;
+}
+
+Size FrameStatsCalc::getChipSize() const {
+    return m_chip_size;
+}
+
+void FrameStatsCalc::setSaturation(int32_t level) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(level);
+
+    if (level < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid saturation " << DEB_VAR1(level);
+    m_saturation = level;
+}
+
+int32_t FrameStatsCalc::getSaturation() const {
+    return m_saturation;
+}
+
+void FrameStatsCalc::setRoiCounters(const RoiCounters *roi_counters) {
+    m_roi_counters = roi_counters;
+}
+
+void FrameStatsCalc::setSparseEvents(bool flag) {
+    m_sparse_events = flag;
+}
+
+bool FrameStatsCalc::getSparseEvents() const {
+    return m_sparse_events;
+}
+
+void FrameStatsCalc::setSparseThreshold(int32_t threshold) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(threshold);
+
+    if (threshold < 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid sparse " << DEB_VAR1(threshold);
+    m_sparse_threshold = threshold;
+}
+
+int32_t FrameStatsCalc::getSparseThreshold() const {
+    return m_sparse_threshold;
+}
+
+void FrameStatsCalc::add(FrameStats& stats, const int32_t *frame, const Size& size, int16_t *out16) const {
+    addFrame(stats, frame, size, out16);
+}
+
+void FrameStatsCalc::add(FrameStats& stats, const int16_t *frame, const Size& size) const {
+    addFrame(stats, frame, size, NULL);
+}
+
+template <class T>
+void FrameStatsCalc::addFrame(FrameStats& stats, const T *frame, const Size& size, int16_t *out16) const {
+    int width = size.getWidth();
+    int height = size.getHeight();
+    int chip_width = m_chip_size.getWidth();
+    int chip_height = m_chip_size.getHeight();
+
+    // frames reshaped by the server (geometrical correction) have no chip sums
+    bool tiled = (width % chip_width == 0) && (height % chip_height == 0);
+    int nb_chip_columns = tiled ? width / chip_width : 1;
+    int segment = tiled ? chip_width : width;
+    if (tiled && stats.chip_sums.empty())
+        stats.chip_sums.assign(size_t(nb_chip_columns) * (height / chip_height), 0);
+    tiled = tiled && (stats.chip_sums.size() == size_t(nb_chip_columns) * (height / chip_height));
+    int nb_rois = m_roi_counters ? m_roi_counters->getNbRois() : 0;
+    if (nb_rois && stats.roi_sums.empty())
+        stats.roi_sums.assign(nb_rois, 0);
+    long long *roi_sums = (nb_rois && int(stats.roi_sums.size()) == nb_rois) ? &stats.roi_sums[0] : NULL;
+
+    long long sum = 0;
+    for (int row = 0; row < height; row++) {
+        const T *src = frame + size_t(row) * width;
+        long long *chip_sum = tiled ? &stats.chip_sums[size_t(row / chip_height) * nb_chip_columns] : NULL;
+        for (int chip = 0; chip < nb_chip_columns; chip++, src += segment) {
+            long long chip_row_sum = 0;
+            segmentStats(src, segment, m_saturation, chip_row_sum, stats.min, stats.max, stats.nb_saturated);
+            sum += chip_row_sum;
+            if (chip_sum)
+                chip_sum[chip] += chip_row_sum;
+        }
+        if (roi_sums)
+            m_roi_counters->addRow(row, frame + size_t(row) * width, width, roi_sums);
+        if (m_sparse_events)
+            rowEvents(frame + size_t(row) * width, width, m_sparse_threshold,
+                      uint32_t(row) * width, stats.events);
+        // the row is still in cache
+        if (out16) {
+            const int32_t *src32 = (const int32_t *) (frame + size_t(row) * width);
+            int16_t *dst = out16 + size_t(row) * width;
+            for (int i = 0; i < width; i++)
+                dst[i] = (int16_t) src32[i];
+        }
+    }
+    stats.sum += sum;
+}
+
+//---------------------------
+//- FrameStatsRing
+//---------------------------
+
+FrameStatsRing::FrameStatsRing(int nb_records) :
+    m_records(nb_records), m_last_frame_nb(-1)
+{
+    DEB_CONSTRUCTOR();
+}
+
+void FrameStatsRing::setNbRecords(int nb_records) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_records);
+
+    if (nb_records < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_records);
+
+    AutoMutex aLock(m_lock);
+    m_records.assign(nb_records, FrameStats());
+    m_last_frame_nb = -1;
+}
+
+int FrameStatsRing::getNbRecords() {
+    AutoMutex aLock(m_lock);
+    return m_records.size();
+}
+
+void FrameStatsRing::clear() {
+    AutoMutex aLock(m_lock);
+    for (size_t i = 0; i < m_records.size(); i++)
+        m_records[i].frame_nb = -1;
+    m_last_frame_nb = -1;
+}
+
+void FrameStatsRing::put(const FrameStats& stats) {
+    AutoMutex aLock(m_lock);
+    // the vectors of the record are reused, the events are not kept
+    FrameStats& record = m_records[stats.frame_nb % m_records.size()];
+    record.frame_nb = stats.frame_nb;
+    record.sum = stats.sum;
+    record.min = stats.min;
+    record.max = stats.max;
+    record.nb_saturated = stats.nb_saturated;
+    record.chip_sums = stats.chip_sums;
+    record.roi_sums = stats.roi_sums;
+    m_last_frame_nb = std::max(m_last_frame_nb, stats.frame_nb);
+}
+
+bool FrameStatsRing::get(int frame_nb, FrameStats& stats) {
+    AutoMutex aLock(m_lock);
+    if (frame_nb < 0)
+        return false;
+    const FrameStats& record = m_records[frame_nb % m_records.size()];
+    if (record.frame_nb != frame_nb)
+        return false;
+    stats = record;
+    return true;
+}
+
+int FrameStatsRing::getLastFrameNb() {
+    AutoMutex aLock(m_lock);
+    return m_last_frame_nb;
+}
@@ -32,7 +32,7 @@ using namespace lima;
 using namespace lima::imXpad;
 
 Interface::Interface(Camera& cam) :
-    m_cam(cam), m_det_info(cam), m_sync(cam)
+    m_cam(cam), m_det_info(cam), m_sync(cam), m_roi(cam), m_bin(cam)
 {
     DEB_CONSTRUCTOR();
 
@@ -46,6 +46,12 @@ Interface::Interface(Camera& cam) :
     HwSyncCtrlObj *sync = &m_sync;
     m_cap_list.push_back(sync);
 
+    HwRoiCtrlObj *roi = &m_roi;
+    m_cap_list.push_back(roi);
+
+    HwBinCtrlObj *bin = &m_bin;
+    m_cap_list.push_back(bin);
+
 #ifdef WITH_CONFIG
     m_config = new Config(m_cam);
     m_cap_list.push_back(m_config);
@@ -0,0 +1,1058 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadProcessing.cpp
+ */
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "imXpadProcessing.h"
+#include "imXpadProcessingKernels.h"
+#include "lima/Exceptions.h"
+#include "lima/Timestamp.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+//---------------------------
+//- kernels
+//---------------------------
+
+// float frames are scaled by 1 / scale, the integer ones kept as they are;
+// max. of the integer frames in *max if not NULL
+static void convertFrame(void *out, ImageType out_type, const int32_t *src, size_t n,
+                         int scale = 1, int32_t *max = NULL)
+{
+    switch (out_type) {
+    case Bpp16:
+    case Bpp16S:
+        convertFrame16((int16_t *) out, src, n, max);
+        break;
+    case Bpp32:
+    case Bpp32S:
+        memcpy(out, src, n * sizeof(int32_t));
+        if (max)
+            *max = frameMax(src, n);
+        break;
+    case Bpp32F:
+        convertFrameF((float *) out, src, 1.0f / scale, n);
+        break;
+    default:
+        throw LIMA_HW_EXC(NotSupported, "Output image type not supported");
+    }
+}
+
+//---------------------------
+//- worker thread of the parallel stages
+//---------------------------
+class Processing::WorkerThread : public Thread {
+    DEB_CLASS_NAMESPC(DebModCamera, "Processing", "WorkerThread");
+public:
+    WorkerThread(Processing& proc, int part);
+    virtual ~WorkerThread();
+
+protected:
+    virtual void threadFunction();
+
+private:
+    Processing& m_proc;
+    int m_part;
+};
+
+Processing::WorkerThread::WorkerThread(Processing& proc, int part) :
+    m_proc(proc), m_part(part)
+{
+    pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Processing::WorkerThread::~WorkerThread() {
+}
+
+void Processing::WorkerThread::threadFunction() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_proc.m_thread_cond.mutex());
+    ++m_proc.m_threads_running;
+    m_proc.m_thread_cond.broadcast();
+    int seq = m_proc.m_job_seq;
+
+    while (!m_proc.m_threads_exit) {
+        if (m_proc.m_job_seq == seq) {
+            m_proc.m_thread_cond.wait();
+            continue;
+        }
+        seq = m_proc.m_job_seq;
+
+        // part 0 is run by the calling thread
+        int nb_parts = m_proc.m_threads.size() + 1;
+        int nb_rows = m_proc.m_job_rows;
+        Job job = m_proc.m_job;
+        aLock.unlock();
+        m_proc.runJob(job, nb_rows * m_part / nb_parts, nb_rows * (m_part + 1) / nb_parts);
+        aLock.lock();
+
+        --m_proc.m_job_pending;
+        m_proc.m_thread_cond.broadcast();
+    }
+
+    --m_proc.m_threads_running;
+    m_proc.m_thread_cond.broadcast();
+}
+
+//---------------------------
+//- Processing
+//---------------------------
+
+Processing::Processing() :
+    m_acc_nb_frames(1), m_acc_sliding(false), m_acc_count(0), m_acc_slot(0),
+    m_window_first_line(0), m_bin_src(NULL), m_bin_src_width(0),
+    m_bin_nb_frames(0), m_bin_time(0),
+    m_mask_mode(MaskOff), m_mask_sentinel(-1),
+    m_pileup(false), m_pileup_scale(1), m_exp_time(1.), m_pileup_src(NULL),
+    m_pileup_nb_frames(0), m_pileup_time(0),
+    m_chip_size(80, 120), m_geometry(false), m_geo_edge_width(3), m_geo_module_gap(0),
+    m_geo_src(NULL),
+    m_flat_field(false), m_flat_src(NULL), m_flat_out(NULL), m_flat_type(Bpp32S),
+    m_track_max(false), m_max_count(INT32_MIN), m_nb_overflow_frames(0),
+    m_job(GeometryJob), m_job_rows(0), m_job_seq(0), m_job_pending(0),
+    m_threads_running(0), m_threads_exit(false),
+    m_nb_raw_frames(0), m_processing_time(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+Processing::~Processing() {
+    DEB_DESTRUCTOR();
+    stopThreads();
+}
+
+void Processing::setAccNbFrames(int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_frames);
+
+    if (nb_frames < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames);
+
+    AutoMutex aLock(m_lock);
+    m_acc_nb_frames = nb_frames;
+    m_acc_count = 0;
+    m_pileup_table.clear();
+}
+
+int Processing::getAccNbFrames() {
+    return m_acc_nb_frames;
+}
+
+void Processing::setAccSliding(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+
+    AutoMutex aLock(m_lock);
+    m_acc_sliding = flag;
+    m_acc_count = 0;
+}
+
+bool Processing::getAccSliding() {
+    return m_acc_sliding;
+}
+
+int Processing::getNbRawFrames(int nb_frames) {
+    if (m_acc_sliding)
+        return nb_frames + m_acc_nb_frames - 1;
+    return nb_frames * m_acc_nb_frames;
+}
+
+void Processing::setPixelMask(const std::vector<int32_t>& pixels, const Size& raw_size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(pixels.size(), raw_size);
+
+    std::vector<int32_t> mask(pixels);
+    std::sort(mask.begin(), mask.end());
+    mask.erase(std::unique(mask.begin(), mask.end()), mask.end());
+    if (!mask.empty() && (mask.front() < 0 ||
+                          mask.back() >= raw_size.getWidth() * raw_size.getHeight()))
+        THROW_HW_ERROR(InvalidValue) << "Masked pixel out of " << DEB_VAR1(raw_size);
+
+    AutoMutex aLock(m_lock);
+    m_mask_full.swap(mask);
+    m_mask_full_size = raw_size;
+    m_mask_size = Size();
+    m_flat_coef.clear();
+}
+
+void Processing::clearPixelMask() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_lock);
+    m_mask_full.clear();
+    m_mask_full_size = Size();
+    m_mask_size = Size();
+    m_flat_coef.clear();
+}
+
+void Processing::buildMask() {
+    DEB_MEMBER_FUNCT();
+
+    if (m_mask_full_size != getFullRawSize())
+        THROW_HW_ERROR(Error) << "Pixel mask " << m_mask_full_size << " does not match "
+                              << "the raw frames " << getFullRawSize();
+
+    // masked pixels of the raw window, the neighbors used for the
+    // interpolation, masked ones excluded
+    int width = m_raw_size.getWidth();
+    int height = m_raw_size.getHeight();
+    int32_t first = m_window_first_line * width;
+    std::vector<int32_t>::iterator begin, end;
+    begin = std::lower_bound(m_mask_full.begin(), m_mask_full.end(), first);
+    end = std::lower_bound(begin, m_mask_full.end(), first + width * height);
+    m_mask.clear();
+    for (; begin != end; ++begin)
+        m_mask.push_back(*begin - first);
+
+    m_mask_neighbors.assign(m_mask.size() * 4, -1);
+    for (size_t i = 0; i < m_mask.size(); i++) {
+        int x = m_mask[i] % width, y = m_mask[i] / width;
+        int32_t candidates[4] = {
+            (x > 0) ? m_mask[i] - 1 : -1,
+            (x < width - 1) ? m_mask[i] + 1 : -1,
+            (y > 0) ? m_mask[i] - width : -1,
+            (y < height - 1) ? m_mask[i] + width : -1 };
+        int nb = 0;
+        for (int j = 0; j < 4; j++)
+            if (candidates[j] >= 0 &&
+                !std::binary_search(m_mask.begin(), m_mask.end(), candidates[j]))
+                m_mask_neighbors[i * 4 + nb++] = candidates[j];
+    }
+    m_mask_size = m_raw_size;
+}
+
+int Processing::getNbMaskedPixels() {
+    return m_mask_full.size();
+}
+
+void Processing::setMaskMode(MaskMode mode) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(mode);
+
+    AutoMutex aLock(m_lock);
+    m_mask_mode = mode;
+    m_flat_coef.clear();
+}
+
+Processing::MaskMode Processing::getMaskMode() {
+    return m_mask_mode;
+}
+
+void Processing::setMaskSentinel(int32_t value) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(value);
+
+    AutoMutex aLock(m_lock);
+    m_mask_sentinel = value;
+}
+
+int32_t Processing::getMaskSentinel() {
+    return m_mask_sentinel;
+}
+
+void Processing::applyMask(int32_t *frame) {
+    size_t nb_pixels = m_mask.size();
+    const int32_t *mask = nb_pixels ? &m_mask[0] : NULL;
+
+    if (m_mask_mode == MaskSentinel) {
+        for (size_t i = 0; i < nb_pixels; i++)
+            frame[mask[i]] = m_mask_sentinel;
+        return;
+    }
+
+    // the neighbors are never masked, the order does not matter
+    const int32_t *neighbors = nb_pixels ? &m_mask_neighbors[0] : NULL;
+    for (size_t i = 0; i < nb_pixels; i++, neighbors += 4) {
+        int64_t sum = 0;
+        int nb = 0;
+        for (; nb < 4 && neighbors[nb] >= 0; nb++)
+            sum += frame[neighbors[nb]];
+        frame[mask[i]] = nb ? int32_t((sum + nb / 2) / nb) : m_mask_sentinel;
+    }
+}
+
+void Processing::setPileUp(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+
+    AutoMutex aLock(m_lock);
+    m_pileup = flag;
+}
+
+bool Processing::getPileUp() {
+    return m_pileup;
+}
+
+void Processing::setPileUpDeadTimes(const std::vector<double>& dead_times) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(dead_times.size());
+
+    for (size_t i = 0; i < dead_times.size(); i++)
+        if (dead_times[i] < 0)
+            THROW_HW_ERROR(InvalidValue) << "Invalid dead time " << dead_times[i];
+
+    AutoMutex aLock(m_lock);
+    m_pileup_dead_times = dead_times;
+    m_pileup_table.clear();
+}
+
+void Processing::getPileUpDeadTimes(std::vector<double>& dead_times) {
+    dead_times = m_pileup_dead_times;
+}
+
+void Processing::setPileUpScale(int scale) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(scale);
+
+    if (scale < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(scale);
+
+    AutoMutex aLock(m_lock);
+    m_pileup_scale = scale;
+}
+
+int Processing::getPileUpScale() {
+    return m_pileup_scale;
+}
+
+void Processing::setExposureTime(double exp_time) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(exp_time);
+
+    AutoMutex aLock(m_lock);
+    if (exp_time != m_exp_time) {
+        m_exp_time = exp_time;
+        m_pileup_table.clear();
+    }
+}
+
+double Processing::getPileUpTime() {
+    return m_pileup_nb_frames ? m_pileup_time / m_pileup_nb_frames * 1e6 : 0;
+}
+
+int Processing::getOutputScale() {
+    return isPileUpActive() ? m_pileup_scale : 1;
+}
+
+bool Processing::isPileUpActive() {
+    return m_pileup && !m_pileup_dead_times.empty();
+}
+
+void Processing::buildPileUpTable() {
+    DEB_MEMBER_FUNCT();
+
+    // the table is given for the full detector, the raw frames are a window
+    int width = m_raw_size.getWidth();
+    int height = m_raw_size.getHeight();
+    int full_height = getFullRawSize().getHeight();
+    size_t nb_pixels = size_t(width) * height;
+    size_t nb_full_pixels = size_t(width) * full_height;
+    int nb_chips = (width / m_chip_size.getWidth()) * (full_height / m_chip_size.getHeight());
+    size_t nb_times = m_pileup_dead_times.size();
+    if (nb_times != 1 && nb_times != size_t(nb_chips) && nb_times != nb_full_pixels)
+        THROW_HW_ERROR(Error) << nb_times << " dead times for " << nb_chips << " chips "
+                              << "and " << nb_full_pixels << " pixels";
+
+    // the counts of an accumulated frame come from acc_nb_frames exposures
+    double exposure = m_exp_time * m_acc_nb_frames;
+    if (exposure <= 0)
+        THROW_HW_ERROR(Error) << "Invalid exposure time " << exposure;
+
+    int chips_per_line = width / m_chip_size.getWidth();
+    m_pileup_table.resize(nb_pixels);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            int full_y = y + m_window_first_line;
+            size_t i = size_t(y) * width + x;
+            size_t t = (nb_times == 1) ? 0 :
+                (nb_times == nb_full_pixels) ? size_t(full_y) * width + x :
+                (full_y / m_chip_size.getHeight()) * chips_per_line + x / m_chip_size.getWidth();
+            m_pileup_table[i] = float(m_pileup_dead_times[t] / exposure);
+        }
+    m_pileup_frame.resize(nb_pixels);
+    DEB_TRACE() << "Pile-up table built for " << DEB_VAR2(m_raw_size, exposure);
+}
+
+void Processing::applyPileUp(const int32_t *frame) {
+    Timestamp t0 = Timestamp::now();
+    if (m_pileup_table.empty())
+        buildPileUpTable();
+    m_pileup_src = frame;
+    runParallel(PileUpJob, m_raw_size.getHeight());
+    ++m_pileup_nb_frames;
+    m_pileup_time += Timestamp::now() - t0;
+}
+
+void Processing::setChipSize(const Size& chip_size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(chip_size);
+
+    AutoMutex aLock(m_lock);
+    m_chip_size = chip_size;
+    m_geo_raw_size = Size();
+    m_pileup_table.clear();
+    m_flat_coef.clear();
+}
+
+void Processing::setGeometry(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+
+    AutoMutex aLock(m_lock);
+    m_geometry = flag;
+    m_flat_coef.clear();
+}
+
+bool Processing::getGeometry() {
+    return m_geometry;
+}
+
+void Processing::setGeometryEdgeWidth(int nb_pixels) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_pixels);
+
+    if (nb_pixels < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_pixels);
+
+    AutoMutex aLock(m_lock);
+    m_geo_edge_width = nb_pixels;
+    m_geo_raw_size = Size();
+    m_flat_coef.clear();
+}
+
+int Processing::getGeometryEdgeWidth() {
+    return m_geo_edge_width;
+}
+
+void Processing::setGeometryModuleGap(int nb_lines) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_lines);
+
+    if (nb_lines < 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_lines);
+
+    AutoMutex aLock(m_lock);
+    m_geo_module_gap = nb_lines;
+    m_geo_raw_size = Size();
+    m_flat_coef.clear();
+}
+
+int Processing::getGeometryModuleGap() {
+    return m_geo_module_gap;
+}
+
+void Processing::setRawWindow(int first_line, const Size& full_raw_size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(first_line, full_raw_size);
+
+    AutoMutex aLock(m_lock);
+    m_window_first_line = first_line;
+    m_window_full_size = full_raw_size;
+    m_mask_size = Size();
+    m_flat_coef.clear();
+    m_pileup_table.clear();
+}
+
+Size Processing::getFullRawSize() {
+    return m_window_full_size.isEmpty() ? m_raw_size : m_window_full_size;
+}
+
+void Processing::setBin(const Bin& bin) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(bin);
+
+    if (bin.getX() < 1 || bin.getY() < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(bin);
+
+    AutoMutex aLock(m_lock);
+    m_bin = bin;
+    m_flat_coef.clear();
+}
+
+Bin Processing::getBin() {
+    return m_bin;
+}
+
+double Processing::getBinTime() {
+    return m_bin_nb_frames ? m_bin_time / m_bin_nb_frames * 1e6 : 0;
+}
+
+double Processing::benchmarkBin(const Size& raw_size, const Bin& bin, int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR3(raw_size, bin, nb_frames);
+
+    if (nb_frames < 1 || bin.getX() < 1 || bin.getY() < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR2(bin, nb_frames);
+
+    std::vector<int32_t> frame(size_t(raw_size.getWidth()) * raw_size.getHeight());
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = i & 0xfff;
+
+    // the bin stage alone, on the processing threads
+    AutoMutex aLock(m_lock);
+    Bin saved_bin = m_bin;
+    Roi saved_crop = m_crop;
+    bool saved_geometry = m_geometry;
+    m_bin = bin;
+    m_crop = Roi();
+    m_geometry = false;
+    m_bin_time = 0;
+    m_bin_nb_frames = 0;
+    for (int i = 0; i < nb_frames; i++) {
+        Size size = raw_size;
+        applyLayout(&frame[0], size);
+    }
+    double bin_time = getBinTime();
+    m_bin = saved_bin;
+    m_crop = saved_crop;
+    m_geometry = saved_geometry;
+    m_bin_time = 0;
+    m_bin_nb_frames = 0;
+
+    DEB_RETURN() << DEB_VAR1(bin_time);
+    return bin_time;
+}
+
+void Processing::setCrop(const Roi& crop) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(crop);
+
+    AutoMutex aLock(m_lock);
+    m_crop = crop;
+    m_flat_coef.clear();
+}
+
+Roi Processing::getCrop() {
+    return m_crop;
+}
+
+void Processing::getChipLayout(const Size& raw_size, std::vector<int>& col_begin, std::vector<int>& col_end,
+                               std::vector<int>& row_begin, std::vector<int>& row_end) {
+    DEB_MEMBER_FUNCT();
+
+    int chip_width = m_chip_size.getWidth();
+    int chip_height = m_chip_size.getHeight();
+    int nb_chips = raw_size.getWidth() / chip_width;
+    int nb_modules = raw_size.getHeight() / chip_height;
+    Size size = getOutputSize(raw_size);
+
+    // border pixels of the chips widened, gaps between the modules
+    int extra = m_geometry ? m_geo_edge_width - 1 : 0;
+    int gap = m_geometry ? m_geo_module_gap : 0;
+    col_begin.clear();
+    col_end.clear();
+    for (int chip = 0; chip < nb_chips; chip++) {
+        col_begin.push_back(chip * chip_width + (chip > 0 ? (2 * chip - 1) * extra : 0));
+        if (chip > 0)
+            col_end.push_back(col_begin.back());
+    }
+    col_end.push_back(size.getWidth());
+
+    row_begin.clear();
+    row_end.clear();
+    for (int module = 0; module < nb_modules; module++) {
+        row_begin.push_back(module * (chip_height + gap));
+        row_end.push_back(row_begin.back() + chip_height);
+    }
+}
+
+Size Processing::getOutputSize(const Size& raw_size) {
+    DEB_MEMBER_FUNCT();
+
+    Size size = raw_size;
+    if (m_geometry) {
+        int nb_chips = raw_size.getWidth() / m_chip_size.getWidth();
+        int nb_modules = raw_size.getHeight() / m_chip_size.getHeight();
+        // two border pixels between adjacent chips
+        size = Size(raw_size.getWidth() + 2 * (nb_chips - 1) * (m_geo_edge_width - 1),
+                    raw_size.getHeight() + (nb_modules - 1) * m_geo_module_gap);
+    }
+    DEB_RETURN() << DEB_VAR1(size);
+    return size;
+}
+
+void Processing::setWhiteImage(const std::vector<int32_t>& white, const Size& raw_size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(raw_size);
+
+    if (white.size() != size_t(raw_size.getWidth()) * raw_size.getHeight())
+        THROW_HW_ERROR(InvalidValue) << "White image of " << white.size() << " pixels "
+                                     << "does not match " << DEB_VAR1(raw_size);
+
+    AutoMutex aLock(m_lock);
+    m_white = white;
+    m_white_size = raw_size;
+    m_flat_coef.clear();
+}
+
+void Processing::clearWhiteImage() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_lock);
+    m_white.clear();
+    m_white_size = Size();
+    m_flat_coef.clear();
+}
+
+bool Processing::hasWhiteImage() {
+    return !m_white.empty();
+}
+
+void Processing::setFlatField(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+
+    AutoMutex aLock(m_lock);
+    m_flat_field = flag;
+}
+
+void Processing::setTrackMax(bool flag) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(flag);
+
+    AutoMutex aLock(m_lock);
+    m_track_max = flag;
+}
+
+bool Processing::getTrackMax() {
+    return m_track_max;
+}
+
+void Processing::resetMaxCount() {
+    AutoMutex aLock(m_lock);
+    m_max_count = INT32_MIN;
+    m_nb_overflow_frames = 0;
+}
+
+int32_t Processing::getMaxCount() {
+    return m_max_count;
+}
+
+long long Processing::getNbOverflowFrames() {
+    return m_nb_overflow_frames;
+}
+
+bool Processing::getFlatField() {
+    return m_flat_field;
+}
+
+void Processing::setNbThreads(int nb_threads) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_threads);
+
+    if (nb_threads < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_threads);
+
+    AutoMutex aLock(m_lock);
+    stopThreads();
+    for (int i = 1; i < nb_threads; i++) {
+        WorkerThread *thread = new WorkerThread(*this, i);
+        m_threads.push_back(thread);
+        thread->start();
+    }
+
+    // a job posted before a worker is waiting would be missed
+    AutoMutex threadLock(m_thread_cond.mutex());
+    while (m_threads_running < int(m_threads.size()))
+        m_thread_cond.wait();
+}
+
+int Processing::getNbThreads() {
+    return m_threads.size() + 1;
+}
+
+void Processing::stopThreads() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_thread_cond.mutex());
+    m_threads_exit = true;
+    m_thread_cond.broadcast();
+    while (m_threads_running > 0)
+        m_thread_cond.wait();
+    m_threads_exit = false;
+    aLock.unlock();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+        delete m_threads[i];
+    m_threads.clear();
+}
+
+void Processing::runParallel(Job job, int nb_rows) {
+    if (m_threads.empty()) {
+        runJob(job, 0, nb_rows);
+        return;
+    }
+
+    AutoMutex aLock(m_thread_cond.mutex());
+    m_job = job;
+    m_job_rows = nb_rows;
+    m_job_pending = m_threads.size();
+    ++m_job_seq;
+    m_thread_cond.broadcast();
+    aLock.unlock();
+
+    runJob(job, 0, nb_rows / (m_threads.size() + 1));
+
+    aLock.lock();
+    while (m_job_pending > 0)
+        m_thread_cond.wait();
+}
+
+void Processing::runJob(Job job, int begin, int end) {
+    switch (job) {
+    case GeometryJob: {
+        int width = m_geo_size.getWidth();
+        for (int row = begin; row < end; row++)
+            gatherRow(&m_geo_frame[row * width], m_geo_src, &m_geo_table[row * width], width);
+        break;
+    }
+    case PileUpJob: {
+        size_t width = m_raw_size.getWidth();
+        size_t first = begin * width, n = (end - begin) * width;
+        pileUpFrame(&m_pileup_frame[first], m_pileup_src + first, &m_pileup_table[first],
+                    m_pileup_scale, n);
+        break;
+    }
+    case BinJob: {
+        int width = m_bin_size.getWidth();
+        for (int row = begin; row < end; row++)
+            for (int line = 0; line < m_bin.getY(); line++)
+                binRow(&m_bin_frame[size_t(row) * width],
+                       m_bin_src + size_t(row * m_bin.getY() + line) * m_bin_src_width,
+                       width, m_bin.getX(), line > 0);
+        break;
+    }
+    case FlatFieldJob: {
+        size_t width = m_flat_size.getWidth();
+        size_t first = begin * width, n = (end - begin) * width;
+        if (m_flat_type == Bpp32F)
+            flatFrameF((float *) m_flat_out + first, m_flat_src + first, &m_flat_coef[first],
+                       1.0f / getOutputScale(), n);
+        else
+            flatFrame((int32_t *) m_flat_out + first, m_flat_src + first, &m_flat_coef[first], n);
+        break;
+    }
+    }
+}
+
+void Processing::buildGeometryTable(const Size& raw_size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(raw_size);
+
+    int chip_width = m_chip_size.getWidth();
+    int chip_height = m_chip_size.getHeight();
+    int raw_width = raw_size.getWidth();
+    if (raw_width % chip_width || raw_size.getHeight() % chip_height)
+        THROW_HW_ERROR(Error) << "Raw frame " << raw_size << " is not made of "
+                              << m_chip_size << " chips";
+    int nb_chips = raw_width / chip_width;
+    int nb_modules = raw_size.getHeight() / chip_height;
+
+    // raw column, width and part of every output column
+    std::vector<int32_t> col_src, col_width, col_part;
+    for (int chip = 0; chip < nb_chips; chip++)
+        for (int col = 0; col < chip_width; col++) {
+            bool border = (col == 0 && chip > 0) || (col == chip_width - 1 && chip < nb_chips - 1);
+            int width = border ? m_geo_edge_width : 1;
+            for (int part = 0; part < width; part++) {
+                col_src.push_back(chip * chip_width + col);
+                col_width.push_back(width);
+                col_part.push_back(part);
+            }
+        }
+
+    // raw line of every output line, -1 in the gaps
+    std::vector<int32_t> row_src;
+    for (int module = 0; module < nb_modules; module++) {
+        if (module > 0)
+            row_src.insert(row_src.end(), m_geo_module_gap, -1);
+        for (int line = 0; line < chip_height; line++)
+            row_src.push_back(module * chip_height + line);
+    }
+
+    int width = col_src.size();
+    int height = row_src.size();
+    m_geo_size = Size(width, height);
+    m_geo_table.resize(size_t(width) * height);
+    m_geo_split.clear();
+    for (int row = 0; row < height; row++)
+        for (int col = 0; col < width; col++) {
+            size_t i = size_t(row) * width + col;
+            m_geo_table[i] = (row_src[row] < 0) ? -1 : row_src[row] * raw_width + col_src[col];
+            if (row_src[row] >= 0 && col_width[col] > 1) {
+                m_geo_split.push_back(i);
+                m_geo_split.push_back(col_width[col]);
+                m_geo_split.push_back(col_part[col]);
+            }
+        }
+    m_geo_frame.resize(m_geo_table.size());
+    m_geo_raw_size = raw_size;
+}
+
+void Processing::applyGeometry(const int32_t *frame) {
+    m_geo_src = frame;
+    runParallel(GeometryJob, m_geo_size.getHeight());
+
+    // the counts of a widened border pixel are shared by its output pixels
+    int32_t *out = &m_geo_frame[0];
+    for (size_t i = 0; i < m_geo_split.size(); i += 3) {
+        int32_t v = out[m_geo_split[i]];
+        int32_t width = m_geo_split[i + 1];
+        int32_t part = m_geo_split[i + 2];
+        out[m_geo_split[i]] = v / width + (part < v % width ? 1 : 0);
+    }
+}
+
+void Processing::buildFlatField() {
+    DEB_MEMBER_FUNCT();
+
+    if (m_white_size != getFullRawSize())
+        THROW_HW_ERROR(Error) << "White image " << m_white_size << " does not match "
+                              << "the raw frames " << getFullRawSize();
+
+    // the white image goes through the same stages as the frames,
+    // the masked pixels keep the value set by the mask (coefficient 1)
+    size_t first = size_t(m_window_first_line) * m_raw_size.getWidth();
+    const int32_t *white = &m_white[first];
+    Size size = m_raw_size;
+    if (isMaskActive()) {
+        if (m_mask_size != m_raw_size)
+            buildMask();
+        m_flat_white.assign(white, white + size_t(size.getWidth()) * size.getHeight());
+        if (m_mask_mode == MaskSentinel)
+            for (size_t i = 0; i < m_mask.size(); i++)
+                m_flat_white[m_mask[i]] = -1;
+        else
+            applyMask(&m_flat_white[0]);
+        white = &m_flat_white[0];
+    }
+    white = applyLayout(white, size);
+
+    size_t nb_pixels = size_t(size.getWidth()) * size.getHeight();
+    double sum = 0;
+    size_t nb_valid = 0;
+    for (size_t i = 0; i < nb_pixels; i++)
+        if (white[i] > 0) {
+            sum += white[i];
+            ++nb_valid;
+        }
+    if (nb_valid == 0)
+        THROW_HW_ERROR(Error) << "White image has no valid pixel";
+
+    // pixels without counts in the white image are set to 0
+    double mean = sum / nb_valid;
+    m_flat_coef.resize(nb_pixels);
+    for (size_t i = 0; i < nb_pixels; i++)
+        m_flat_coef[i] = (white[i] > 0) ? float(mean / white[i]) : (white[i] < 0) ? 1.0f : 0.0f;
+    m_flat_size = size;
+    DEB_TRACE() << "Flat-field built for " << DEB_VAR2(size, mean);
+}
+
+void Processing::applyFlatField(const int32_t *frame, void *out, ImageType out_type, int32_t *max) {
+    m_flat_src = frame;
+    m_flat_type = out_type;
+    switch (out_type) {
+    case Bpp32:
+    case Bpp32S:
+    case Bpp32F:
+        m_flat_out = out;
+        break;
+    default:
+        m_flat_frame.resize(m_flat_coef.size());
+        m_flat_out = &m_flat_frame[0];
+    }
+    runParallel(FlatFieldJob, m_flat_size.getHeight());
+
+    if (m_flat_out != out)
+        convertFrame(out, out_type, &m_flat_frame[0], m_flat_frame.size(), 1, max);
+    else if (max && out_type != Bpp32F)
+        *max = frameMax((const int32_t *) out, m_flat_coef.size());
+}
+
+bool Processing::isActive() {
+    return m_acc_nb_frames > 1 || m_geometry || (m_flat_field && !m_white.empty()) ||
+        isMaskActive() || isPileUpActive() || !m_bin.isOne() || !m_crop.isEmpty() || m_track_max;
+}
+
+bool Processing::isMaskActive() {
+    return m_mask_mode != MaskOff && !m_mask_full.empty();
+}
+
+void Processing::reset() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_lock);
+    m_acc_count = 0;
+    m_nb_raw_frames = 0;
+    m_processing_time = 0;
+    m_pileup_nb_frames = 0;
+    m_pileup_time = 0;
+    m_bin_nb_frames = 0;
+    m_bin_time = 0;
+}
+
+double Processing::getProcessingTime() {
+    return m_nb_raw_frames ? m_processing_time / m_nb_raw_frames * 1e6 : 0;
+}
+
+bool Processing::processFrame(int32_t *raw, const Size& raw_size, void *out, const FrameDim& out_dim) {
+    DEB_MEMBER_FUNCT();
+
+    Timestamp t0 = Timestamp::now();
+    AutoMutex aLock(m_lock);
+
+    if (raw_size != m_raw_size) {
+        m_raw_size = raw_size;
+        m_acc_count = 0;
+        m_mask_size = Size();
+        m_flat_coef.clear();
+        m_pileup_table.clear();
+    }
+
+    // cost proportional to the number of masked pixels, before any sum
+    if (isMaskActive()) {
+        if (raw_size != m_mask_size)
+            buildMask();
+        applyMask(raw);
+    }
+
+    const int32_t *frame = raw;
+    Size size = raw_size;
+    bool ready = true;
+
+    if (m_acc_nb_frames > 1) {
+        accumulate(raw, size_t(size.getWidth()) * size.getHeight());
+        ready = m_acc_sliding ? (m_acc_count >= m_acc_nb_frames)
+                              : (m_acc_count == m_acc_nb_frames);
+        if (ready && !m_acc_sliding)
+            m_acc_count = 0;
+        frame = &m_acc[0];
+    }
+
+    // rates per pixel, before the layout changes
+    if (ready && isPileUpActive()) {
+        applyPileUp(frame);
+        frame = &m_pileup_frame[0];
+    }
+
+    bool flat_field = ready && m_flat_field && !m_white.empty();
+    if (flat_field && m_flat_coef.empty())
+        buildFlatField();
+
+    if (ready)
+        frame = applyLayout(frame, size);
+
+    if (ready) {
+        if (size != out_dim.getSize())
+            THROW_HW_ERROR(Error) << "Processed frame " << size << " does not fit "
+                                  << "the LIMA frame " << out_dim.getSize();
+        // max. found by the conversion pass
+        ImageType out_type = out_dim.getImageType();
+        int32_t frame_max = INT32_MIN;
+        int32_t *max = m_track_max ? &frame_max : NULL;
+        if (flat_field)
+            applyFlatField(frame, out, out_type, max);
+        else
+            convertFrame(out, out_type, frame, size_t(size.getWidth()) * size.getHeight(),
+                         getOutputScale(), max);
+        if (frame_max > m_max_count)
+            m_max_count = frame_max;
+        if (frame_max > INT16_MAX && (out_type == Bpp16 || out_type == Bpp16S))
+            ++m_nb_overflow_frames;
+    }
+
+    ++m_nb_raw_frames;
+    m_processing_time += Timestamp::now() - t0;
+    return ready;
+}
+
+// stages changing the frame layout, size updated
+const int32_t *Processing::applyLayout(const int32_t *frame, Size& size) {
+    DEB_MEMBER_FUNCT();
+
+    if (m_geometry) {
+        if (size != m_geo_raw_size)
+            buildGeometryTable(size);
+        applyGeometry(frame);
+        frame = &m_geo_frame[0];
+        size = m_geo_size;
+    }
+
+    if (!m_bin.isOne()) {
+        m_bin_size = Size(size.getWidth() / m_bin.getX(), size.getHeight() / m_bin.getY());
+        m_bin_frame.resize(size_t(m_bin_size.getWidth()) * m_bin_size.getHeight());
+        m_bin_src = frame;
+        m_bin_src_width = size.getWidth();
+        Timestamp t0 = Timestamp::now();
+        runParallel(BinJob, m_bin_size.getHeight());
+        m_bin_time += Timestamp::now() - t0;
+        ++m_bin_nb_frames;
+        frame = &m_bin_frame[0];
+        size = m_bin_size;
+    }
+
+    if (!m_crop.isEmpty()) {
+        Point top_left = m_crop.getTopLeft();
+        Size crop_size = m_crop.getSize();
+        int width = crop_size.getWidth();
+        int height = crop_size.getHeight();
+        if (top_left.x + width > size.getWidth() || top_left.y + height > size.getHeight())
+            THROW_HW_ERROR(Error) << "Crop " << m_crop << " out of the frame " << size;
+        m_crop_frame.resize(size_t(width) * height);
+        const int32_t *src = frame + size_t(top_left.y) * size.getWidth() + top_left.x;
+        for (int row = 0; row < height; row++, src += size.getWidth())
+            memcpy(&m_crop_frame[size_t(row) * width], src, width * sizeof(int32_t));
+        frame = &m_crop_frame[0];
+        size = crop_size;
+    }
+    return frame;
+}
+
+void Processing::accumulate(const int32_t *raw, size_t nb_pixels) {
+    int window_size = m_acc_nb_frames;
+
+    if (m_acc_count == 0) {
+        m_acc.assign(raw, raw + nb_pixels);
+        if (m_acc_sliding) {
+            m_acc_window.resize(nb_pixels * window_size);
+            m_acc_slot = 0;
+        }
+    } else if (!m_acc_sliding || m_acc_count < window_size)
+        addFrame(&m_acc[0], raw, nb_pixels);
+    else
+        // the oldest frame of the window leaves the sum
+        addSubFrame(&m_acc[0], raw, &m_acc_window[m_acc_slot * nb_pixels], nb_pixels);
+
+    if (m_acc_sliding) {
+        memcpy(&m_acc_window[m_acc_slot * nb_pixels], raw, nb_pixels * sizeof(int32_t));
+        m_acc_slot = (m_acc_slot + 1) % window_size;
+        if (m_acc_count < window_size)
+            ++m_acc_count;
+    } else
+        ++m_acc_count;
+}
@@ -0,0 +1,385 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadProcessingKernels.h
+ *
+ * Pixel kernels of the client-side processing, private to the plugin:
+ * vectorized for AVX2 or SSE2 when the target allows it, scalar otherwise.
+ */
+
+#ifndef XPADPROCESSINGKERNELS_H_
+#define XPADPROCESSINGKERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//---------------------------
+//- kernels, vectorized when the target allows it
+//---------------------------
+
+static inline void addFrame(int32_t *dst, const int32_t *src, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi32(a, b));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(a, b));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] += src[i];
+}
+
+// dst += add - sub
+static inline void addSubFrame(int32_t *dst, const int32_t *add, const int32_t *sub, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(add + i));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(sub + i));
+        a = _mm256_sub_epi32(_mm256_add_epi32(a, b), c);
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(add + i));
+        __m128i c = _mm_loadu_si128((const __m128i *)(sub + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi32(_mm_add_epi32(a, b), c));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] += add[i] - sub[i];
+}
+
+#if !defined(__AVX2__) && defined(__SSE2__)
+// SSE2 has no signed 32 bit max
+static inline __m128i max_epi32(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+static inline int32_t frameMax(const int32_t *src, size_t n)
+{
+    int32_t max = INT32_MIN;
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (n >= 8) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)src);
+        for (i = 8; i + 8 <= n; i += 8)
+            m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i *)(src + i)));
+        int32_t v[8];
+        _mm256_storeu_si256((__m256i *)v, m);
+        for (int j = 0; j < 8; j++)
+            max = std::max(max, v[j]);
+    }
+#elif defined(__SSE2__)
+    if (n >= 4) {
+        __m128i m = _mm_loadu_si128((const __m128i *)src);
+        for (i = 4; i + 4 <= n; i += 4)
+            m = max_epi32(m, _mm_loadu_si128((const __m128i *)(src + i)));
+        int32_t v[4];
+        _mm_storeu_si128((__m128i *)v, m);
+        for (int j = 0; j < 4; j++)
+            max = std::max(max, v[j]);
+    }
+#endif
+    for (; i < n; i++)
+        max = std::max(max, src[i]);
+    return max;
+}
+
+// 32 bit to 16 bit, saturated, max. of src in *max if not NULL
+static inline void convertFrame16(int16_t *dst, const int32_t *src, size_t n, int32_t *max = NULL)
+{
+    size_t i = 0;
+    int32_t m = INT32_MIN;
+#if defined(__AVX2__)
+    __m256i vm = _mm256_set1_epi32(INT32_MIN);
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 8));
+        vm = _mm256_max_epi32(vm, _mm256_max_epi32(a, b));
+        // packs works per 128 bit lane, restore the order of the 64 bit blocks
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *)(dst + i), p);
+    }
+    int32_t v[8];
+    _mm256_storeu_si256((__m256i *)v, vm);
+    for (int j = 0; j < 8; j++)
+        m = std::max(m, v[j]);
+#elif defined(__SSE2__)
+    __m128i vm = _mm_set1_epi32(INT32_MIN);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        vm = max_epi32(vm, max_epi32(a, b));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+    }
+    int32_t v[4];
+    _mm_storeu_si128((__m128i *)v, vm);
+    for (int j = 0; j < 4; j++)
+        m = std::max(m, v[j]);
+#endif
+    for (; i < n; i++) {
+        int32_t v = src[i];
+        m = std::max(m, v);
+        dst[i] = (v > INT16_MAX)? INT16_MAX: (v < INT16_MIN)? INT16_MIN: v;
+    }
+    if (max)
+        *max = m;
+}
+
+static inline void convertFrameF(float *dst, const int32_t *src, float scale, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), s));
+    }
+#elif defined(__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), s));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] * scale;
+}
+
+// dst = src * coef, rounded to nearest
+static inline void flatFrame(int32_t *dst, const int32_t *src, const float *coef, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i)));
+        a = _mm256_mul_ps(a, _mm256_loadu_ps(coef + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(a));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i)));
+        a = _mm_mul_ps(a, _mm_loadu_ps(coef + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(a));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = lrintf(src[i] * coef[i]);
+}
+
+static inline void flatFrameF(float *dst, const int32_t *src, const float *coef, float scale, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i)));
+        a = _mm256_mul_ps(a, _mm256_loadu_ps(coef + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(a, s));
+    }
+#elif defined(__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i)));
+        a = _mm_mul_ps(a, _mm_loadu_ps(coef + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(a, s));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] * coef[i] * scale;
+}
+
+// non-paralyzable dead-time: dst = scale * c / (1 - c * k), the
+// denominator limited to PILEUP_MIN_DENOMINATOR
+#define PILEUP_MIN_DENOMINATOR 0.01f
+static inline void pileUpFrame(int32_t *dst, const int32_t *src, const float *k, float scale, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 min_d = _mm256_set1_ps(PILEUP_MIN_DENOMINATOR);
+    const __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256 c = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i)));
+        __m256 d = _mm256_sub_ps(one, _mm256_mul_ps(c, _mm256_loadu_ps(k + i)));
+        d = _mm256_max_ps(d, min_d);
+        __m256 r = _mm256_div_ps(_mm256_mul_ps(c, s), d);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(r));
+    }
+#elif defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 min_d = _mm_set1_ps(PILEUP_MIN_DENOMINATOR);
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= n; i += 4) {
+        __m128 c = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m128 d = _mm_sub_ps(one, _mm_mul_ps(c, _mm_loadu_ps(k + i)));
+        d = _mm_max_ps(d, min_d);
+        __m128 r = _mm_div_ps(_mm_mul_ps(c, s), d);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(r));
+    }
+#endif
+    for (; i < n; i++) {
+        float c = src[i];
+        float d = 1.0f - c * k[i];
+        if (d < PILEUP_MIN_DENOMINATOR)
+            d = PILEUP_MIN_DENOMINATOR;
+        dst[i] = lrintf(c * scale / d);
+    }
+}
+
+// sums of the pixel pairs of 2 n values in n values, dst += sums if add
+static inline void binRow2(int32_t *dst, const int32_t *src, size_t n, bool add)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 8));
+        // hadd works per 128 bit lane, restore the order of the 64 bit blocks
+        __m256i h = _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b), 0xd8);
+        if (add)
+            h = _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i *)(dst + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), h);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+        __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 2 * i + 4)));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i h = _mm_add_epi32(even, odd);
+        if (add)
+            h = _mm_add_epi32(h, _mm_loadu_si128((const __m128i *)(dst + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), h);
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (add ? dst[i] : 0) + src[2 * i] + src[2 * i + 1];
+}
+
+static inline void binRow4(int32_t *dst, const int32_t *src, size_t n, bool add)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    // two hadd levels leave the sums of the two lanes interleaved
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; i + 8 <= n; i += 8) {
+        const int32_t *s = src + 4 * i;
+        __m256i a = _mm256_hadd_epi32(_mm256_loadu_si256((const __m256i *) s),
+                                      _mm256_loadu_si256((const __m256i *)(s + 8)));
+        __m256i b = _mm256_hadd_epi32(_mm256_loadu_si256((const __m256i *)(s + 16)),
+                                      _mm256_loadu_si256((const __m256i *)(s + 24)));
+        __m256i h = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(a, b), order);
+        if (add)
+            h = _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i *)(dst + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), h);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 p[2];
+        for (int j = 0; j < 2; j++) {
+            __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 4 * i + 8 * j)));
+            __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(src + 4 * i + 8 * j + 4)));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            p[j] = _mm_castsi128_ps(_mm_add_epi32(even, odd));
+        }
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(p[0], p[1], _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(p[0], p[1], _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i h = _mm_add_epi32(even, odd);
+        if (add)
+            h = _mm_add_epi32(h, _mm_loadu_si128((const __m128i *)(dst + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), h);
+    }
+#endif
+    for (; i < n; i++) {
+        const int32_t *s = src + 4 * i;
+        dst[i] = (add ? dst[i] : 0) + s[0] + s[1] + s[2] + s[3];
+    }
+}
+
+static inline void binRow(int32_t *dst, const int32_t *src, size_t n, int bin_x, bool add)
+{
+    switch (bin_x) {
+    case 1:
+        if (add)
+            addFrame(dst, src, n);
+        else
+            memcpy(dst, src, n * sizeof(int32_t));
+        break;
+    case 2:
+        binRow2(dst, src, n, add);
+        break;
+    case 4:
+        binRow4(dst, src, n, add);
+        break;
+    default:
+        for (size_t i = 0; i < n; i++) {
+            int32_t sum = add ? dst[i] : 0;
+            for (int j = 0; j < bin_x; j++)
+                sum += src[i * bin_x + j];
+            dst[i] = sum;
+        }
+    }
+}
+
+// gather, -1 indexes give 0
+static inline void gatherRow(int32_t *dst, const int32_t *src, const int32_t *idx, size_t n)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i minus_one = _mm256_set1_epi32(-1);
+    for (; i + 8 <= n; i += 8) {
+        __m256i vidx = _mm256_loadu_si256((const __m256i *)(idx + i));
+        __m256i mask = _mm256_cmpgt_epi32(vidx, minus_one);
+        __m256i v = _mm256_mask_i32gather_epi32(zero, (const int *) src, vidx, mask, 4);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (idx[i] >= 0) ? src[idx[i]] : 0;
+}
+
+#endif /* XPADPROCESSINGKERNELS_H_ */
@@ -0,0 +1,413 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadRawWriter.cpp
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "imXpadRawWriter.h"
+#include "lima/Exceptions.h"
+
+using namespace std;
+using namespace lima;
+using namespace lima::imXpad;
+
+static const char RAW_INDEX_MAGIC[8] = { 'X', 'P', 'A', 'D', 'R', 'A', 'W', 'I' };
+static const uint32_t RAW_INDEX_VERSION = 1;
+
+struct RawIndexRecord {
+    int32_t frame_nb;
+    uint32_t file_nb;
+    uint64_t offset;
+    double timestamp;
+};
+
+//---------------------------
+//- writer thread
+//---------------------------
+class RawWriter::WriterThread : public Thread {
+    DEB_CLASS_NAMESPC(DebModCamera, "RawWriter", "WriterThread");
+public:
+    WriterThread(RawWriter& writer);
+    virtual ~WriterThread();
+
+protected:
+    virtual void threadFunction();
+
+private:
+    RawWriter& m_writer;
+};
+
+RawWriter::WriterThread::WriterThread(RawWriter& writer) :
+    m_writer(writer)
+{
+    pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+RawWriter::WriterThread::~WriterThread() {
+}
+
+void RawWriter::WriterThread::threadFunction() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_writer.m_cond.mutex());
+    m_writer.m_thread_running = true;
+    m_writer.m_cond.broadcast();
+
+    while (!m_writer.m_thread_exit) {
+        if (m_writer.m_depth == 0) {
+            m_writer.m_cond.wait();
+            continue;
+        }
+        // the slots from head to head + depth are not touched by put()
+        aLock.unlock();
+        m_writer.writeFrames();
+        aLock.lock();
+        m_writer.m_cond.broadcast();
+    }
+
+    m_writer.m_thread_running = false;
+    m_writer.m_cond.broadcast();
+}
+
+//---------------------------
+//- RawWriter
+//---------------------------
+RawWriter::RawWriter() :
+    m_thread(NULL), m_thread_running(false), m_thread_exit(false),
+    m_file_size(4LL << 30), m_queue_frames(64), m_acq_nb(0), m_open(false), m_failed(false),
+    m_frame_size(0), m_slot_size(0), m_file_frames(0), m_queue(NULL), m_queue_size(0),
+    m_head(0), m_depth(0), m_index(NULL), m_fd(-1), m_file_nb(0), m_file_pos(0),
+    m_write_frame_nb(0), m_nb_put(0), m_nb_written(0), m_nb_dropped(0), m_max_depth(0),
+    m_write_time(0)
+{
+    DEB_CONSTRUCTOR();
+
+    m_thread = new WriterThread(*this);
+    m_thread->start();
+    AutoMutex aLock(m_cond.mutex());
+    while (!m_thread_running)
+        m_cond.wait();
+}
+
+RawWriter::~RawWriter() {
+    DEB_DESTRUCTOR();
+
+    close();
+    AutoMutex aLock(m_cond.mutex());
+    m_thread_exit = true;
+    m_cond.broadcast();
+    while (m_thread_running)
+        m_cond.wait();
+    aLock.unlock();
+    delete m_thread;
+    freeQueue();
+}
+
+void RawWriter::setFilePrefix(const std::string& prefix) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(prefix);
+
+    AutoMutex aLock(m_cond.mutex());
+    if (prefix != m_prefix)
+        m_acq_nb = 0;
+    m_prefix = prefix;
+}
+
+const std::string& RawWriter::getFilePrefix() {
+    return m_prefix;
+}
+
+void RawWriter::setFileSize(long long size) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(size);
+
+    if (size < Alignment)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(size) << ", min. " << int(Alignment);
+    m_file_size = size;
+}
+
+long long RawWriter::getFileSize() {
+    return m_file_size;
+}
+
+void RawWriter::setQueueFrames(int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_frames);
+
+    if (nb_frames < 2)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_frames) << ", min. 2";
+    AutoMutex aLock(m_cond.mutex());
+    if (m_open)
+        THROW_HW_ERROR(Error) << "Cannot resize the raw writer queue while writing";
+    m_queue_frames = nb_frames;
+}
+
+int RawWriter::getQueueFrames() {
+    return m_queue_frames;
+}
+
+void RawWriter::allocQueue() {
+    DEB_MEMBER_FUNCT();
+
+    size_t queue_size = m_slot_size * m_queue_frames;
+    if (m_queue && queue_size == m_queue_size)
+        return;
+    freeQueue();
+    void *queue;
+    if (posix_memalign(&queue, Alignment, queue_size) != 0)
+        THROW_HW_ERROR(Error) << "Cannot allocate the raw writer queue of " << queue_size << " bytes";
+    // the slot padding is written as it is
+    memset(queue, 0, queue_size);
+    m_queue = (char *) queue;
+    m_queue_size = queue_size;
+}
+
+void RawWriter::freeQueue() {
+    free(m_queue);
+    m_queue = NULL;
+    m_queue_size = 0;
+}
+
+void RawWriter::open(const FrameDim& frame_dim) {
+    DEB_MEMBER_FUNCT();
+
+    close();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (m_prefix.empty())
+        THROW_HW_ERROR(Error) << "No raw file prefix";
+
+    m_frame_dim = frame_dim;
+    m_frame_size = frame_dim.getMemSize();
+    m_slot_size = (m_frame_size + Alignment - 1) / Alignment * Alignment;
+    m_file_frames = std::max<long long>(1, m_file_size / m_slot_size);
+    allocQueue();
+    m_timestamps.assign(m_queue_frames, 0);
+
+    ostringstream name;
+    name << m_prefix << "_" << setfill('0') << setw(4) << m_acq_nb << ".idx";
+    m_index_file_name = name.str();
+    m_index = fopen(m_index_file_name.c_str(), "wb");
+    if (!m_index)
+        THROW_HW_ERROR(Error) << "Cannot create " << m_index_file_name << ": " << strerror(errno);
+    const Size& size = frame_dim.getSize();
+    uint32_t header[6] = { RAW_INDEX_VERSION, uint32_t(size.getWidth()), uint32_t(size.getHeight()),
+                           uint32_t(frame_dim.getDepth()), uint32_t(m_frame_size), uint32_t(m_slot_size) };
+    fwrite(RAW_INDEX_MAGIC, sizeof(RAW_INDEX_MAGIC), 1, m_index);
+    fwrite(header, sizeof(header), 1, m_index);
+
+    m_failed = false;
+    try {
+        openFile(0);
+    } catch (...) {
+        fclose(m_index);
+        m_index = NULL;
+        throw;
+    }
+
+    m_head = m_depth = 0;
+    m_write_frame_nb = 0;
+    m_nb_put = m_nb_written = m_nb_dropped = m_max_depth = 0;
+    m_write_time = 0;
+    m_open = true;
+    DEB_TRACE() << "Raw frames written to " << m_prefix << ", " << DEB_VAR2(m_slot_size, m_file_frames);
+}
+
+void RawWriter::openFile(int file_nb) {
+    DEB_MEMBER_FUNCT();
+
+    ostringstream name;
+    name << m_prefix << "_" << setfill('0') << setw(4) << m_acq_nb << "_" << setw(4) << file_nb << ".raw";
+    string file_name = name.str();
+
+    int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) {
+        // file system without direct I/O (tmpfs...): through the page cache
+        DEB_WARNING() << "No O_DIRECT on " << file_name << ", page cache used";
+        fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0)
+        THROW_HW_ERROR(Error) << "Cannot create " << file_name << ": " << strerror(errno);
+
+    // the extents are allocated now rather than while streaming
+    off_t file_size = off_t(m_file_frames) * m_slot_size;
+    int ret = fallocate(fd, 0, 0, file_size);
+    if (ret != 0)
+        DEB_WARNING() << "Cannot preallocate " << file_name << ": " << strerror(errno);
+
+    m_fd = fd;
+    m_file_nb = file_nb;
+    m_file_pos = 0;
+}
+
+void RawWriter::closeFile() {
+    DEB_MEMBER_FUNCT();
+
+    if (m_fd < 0)
+        return;
+    // the preallocation not used is given back
+    if (ftruncate(m_fd, off_t(m_file_pos) * m_slot_size) != 0)
+        DEB_WARNING() << "Cannot truncate raw file " << m_file_nb << ": " << strerror(errno);
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+// writer thread, without the lock: writes the frames from the queue head
+// up to the end of the queue or of the file
+void RawWriter::writeFrames() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    int head = m_head;
+    int nb_frames = std::min(m_depth, m_queue_frames - head);
+    aLock.unlock();
+
+    bool ok = !m_failed;
+    if (ok && m_file_pos == m_file_frames) {
+        closeFile();
+        try {
+            openFile(m_file_nb + 1);
+        } catch (Exception&) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        nb_frames = std::min(nb_frames, m_file_frames - m_file_pos);
+        const char *buff = m_queue + head * m_slot_size;
+        size_t size = nb_frames * m_slot_size;
+        off_t offset = off_t(m_file_pos) * m_slot_size;
+        Timestamp t0 = Timestamp::now();
+        while (size > 0) {
+            ssize_t ret = pwrite(m_fd, buff, size, offset);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0) {
+                DEB_ERROR() << "Writing raw file " << m_file_nb << ": " << strerror(errno)
+                            << ", raw output stopped";
+                ok = false;
+                break;
+            }
+            buff += ret;
+            size -= ret;
+            offset += ret;
+        }
+        m_write_time += Timestamp::now() - t0;
+    }
+
+    if (ok) {
+        for (int i = 0; i < nb_frames; i++) {
+            RawIndexRecord record = { m_write_frame_nb + i, uint32_t(m_file_nb),
+                                      uint64_t(m_file_pos + i) * m_slot_size, m_timestamps[head + i] };
+            fwrite(&record, sizeof(record), 1, m_index);
+        }
+        m_file_pos += nb_frames;
+    }
+    m_failed = !ok;
+    m_write_frame_nb += nb_frames;
+
+    aLock.lock();
+    m_head = (m_head + nb_frames) % m_queue_frames;
+    m_depth -= nb_frames;
+    if (ok)
+        m_nb_written += nb_frames;
+    else
+        m_nb_dropped += nb_frames;
+}
+
+void RawWriter::put(const void *frame, double timestamp) {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_open)
+        return;
+    // a full queue holds the acquisition thread back
+    while (m_depth == m_queue_frames)
+        m_cond.wait();
+    int slot = (m_head + m_depth) % m_queue_frames;
+    aLock.unlock();
+
+    // the slot is not seen by the writer thread before depth is increased
+    memcpy(m_queue + slot * m_slot_size, frame, m_frame_size);
+
+    aLock.lock();
+    m_timestamps[slot] = timestamp;
+    ++m_depth;
+    ++m_nb_put;
+    m_max_depth = std::max(m_max_depth, m_depth);
+    m_cond.broadcast();
+}
+
+void RawWriter::close() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_open)
+        return;
+    while (m_depth > 0)
+        m_cond.wait();
+    m_open = false;
+    aLock.unlock();
+
+    closeFile();
+    if (fclose(m_index) != 0)
+        DEB_ERROR() << "Closing " << m_index_file_name << ": " << strerror(errno);
+    m_index = NULL;
+    ++m_acq_nb;
+    DEB_TRACE() << DEB_VAR3(m_nb_written, m_nb_dropped, getWriteRate());
+}
+
+bool RawWriter::isOpen() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_open;
+}
+
+const std::string& RawWriter::getIndexFileName() {
+    return m_index_file_name;
+}
+
+int RawWriter::getNbFramesWritten() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_nb_written;
+}
+
+int RawWriter::getNbFramesDropped() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_nb_dropped;
+}
+
+int RawWriter::getMaxQueueDepth() {
+    AutoMutex aLock(m_cond.mutex());
+    return m_max_depth;
+}
+
+double RawWriter::getWriteRate() {
+    AutoMutex aLock(m_cond.mutex());
+    return (m_write_time > 0) ? m_nb_written * double(m_slot_size) / m_write_time / 1e6 : 0;
+}
@@ -0,0 +1,276 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadRoiCounters.cpp
+ */
+
+#include <algorithm>
+#include "imXpadRoiCounters.h"
+#include "lima/Exceptions.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace lima;
+using namespace lima::imXpad;
+
+//---------------------------
+//- kernels, vectorized when the target allows it
+//---------------------------
+
+static long long spanSum(const int32_t *src, size_t n)
+{
+    long long sum = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    if (n >= 8) {
+        __m256i vsum = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(a)));
+            vsum = _mm256_add_epi64(vsum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(a, 1)));
+        }
+        long long s[4];
+        _mm256_storeu_si256((__m256i *)s, vsum);
+        sum = s[0] + s[1] + s[2] + s[3];
+    }
+#elif defined(__SSE2__)
+    if (n >= 4) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i vsum = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i sign = _mm_cmpgt_epi32(zero, a);
+            vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(a, sign));
+            vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(a, sign));
+        }
+        long long s[2];
+        _mm_storeu_si128((__m128i *)s, vsum);
+        sum = s[0] + s[1];
+    }
+#endif
+    for (; i < n; i++)
+        sum += src[i];
+    return sum;
+}
+
+static long long spanSum(const int16_t *src, size_t n)
+{
+    long long sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += src[i];
+    return sum;
+}
+
+//---------------------------
+//- RoiCounters
+//---------------------------
+
+RoiCounters::RoiCounters(int nb_records) :
+    m_nb_rois(0), m_nb_records(nb_records), m_last_frame_nb(-1)
+{
+    DEB_CONSTRUCTOR();
+    allocRing();
+}
+
+int RoiCounters::addRoi(const Roi& roi) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(roi);
+
+    Point top_left = roi.getTopLeft();
+    Size size = roi.getSize();
+    if (roi.isEmpty() || top_left.x < 0 || top_left.y < 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(roi);
+    if (m_nb_rois == MaxNbRois)
+        THROW_HW_ERROR(Error) << "Too many rois, max. " << int(MaxNbRois);
+
+    for (int row = top_left.y; row < top_left.y + size.getHeight(); row++)
+        addSpan(row, m_nb_rois, top_left.x, top_left.x + size.getWidth());
+    int index = m_nb_rois++;
+    allocRing();
+    return index;
+}
+
+int RoiCounters::addMaskRoi(const std::vector<int32_t>& pixels, int width) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(pixels.size(), width);
+
+    if (pixels.empty() || width < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid mask roi " << DEB_VAR2(pixels.size(), width);
+    if (m_nb_rois == MaxNbRois)
+        THROW_HW_ERROR(Error) << "Too many rois, max. " << int(MaxNbRois);
+
+    std::vector<int32_t> sorted(pixels);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (sorted[0] < 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid mask roi pixel " << sorted[0];
+
+    // runs of consecutive pixels of a row
+    size_t i = 0;
+    while (i < sorted.size()) {
+        int row = sorted[i] / width;
+        int begin = sorted[i] % width;
+        int end = begin + 1;
+        for (++i; i < sorted.size() && sorted[i] == row * width + end && end < width; ++i)
+            ++end;
+        addSpan(row, m_nb_rois, begin, end);
+    }
+    int index = m_nb_rois++;
+    allocRing();
+    return index;
+}
+
+void RoiCounters::addSpan(int row, int roi, int begin, int end) {
+    if (row >= int(m_row_spans.size()))
+        m_row_spans.resize(row + 1);
+    Span span = { roi, begin, end };
+    m_row_spans[row].push_back(span);
+}
+
+void RoiCounters::clearRois() {
+    DEB_MEMBER_FUNCT();
+
+    m_row_spans.clear();
+    m_nb_rois = 0;
+    allocRing();
+}
+
+int RoiCounters::getNbRois() const {
+    return m_nb_rois;
+}
+
+void RoiCounters::addRow(int row, const int32_t *src, int width, long long *sums) const {
+    addSpans(row, src, width, sums);
+}
+
+void RoiCounters::addRow(int row, const int16_t *src, int width, long long *sums) const {
+    addSpans(row, src, width, sums);
+}
+
+template <class T>
+void RoiCounters::addSpans(int row, const T *src, int width, long long *sums) const {
+    if (row >= int(m_row_spans.size()))
+        return;
+    const std::vector<Span>& spans = m_row_spans[row];
+    for (size_t i = 0; i < spans.size(); i++) {
+        const Span& span = spans[i];
+        int end = std::min(span.end, width);
+        if (span.begin < end)
+            sums[span.roi] += spanSum(src + span.begin, end - span.begin);
+    }
+}
+
+void RoiCounters::setNbRecords(int nb_records) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(nb_records);
+
+    if (nb_records < 1)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR1(nb_records);
+    m_nb_records = nb_records;
+    allocRing();
+}
+
+int RoiCounters::getNbRecords() const {
+    return m_nb_records;
+}
+
+// the rois and the ring size are changed between acquisitions only
+void RoiCounters::allocRing() {
+    m_sums.assign(size_t(m_nb_records) * std::max(m_nb_rois + 1, 1), 0);
+    m_frame_nbs.assign(m_nb_records, -1);
+    m_seqs.assign(m_nb_records, 0);
+    m_last_frame_nb = -1;
+}
+
+void RoiCounters::clearRecords() {
+    for (int i = 0; i < m_nb_records; i++) {
+        __sync_fetch_and_add(&m_seqs[i], 1);
+        __sync_synchronize();
+        m_frame_nbs[i] = -1;
+        __sync_synchronize();
+        __sync_fetch_and_add(&m_seqs[i], 1);
+    }
+    m_last_frame_nb = -1;
+}
+
+void RoiCounters::put(int frame_nb, const long long *sums) {
+    int slot = frame_nb % m_nb_records;
+    long long *record = &m_sums[size_t(slot) * (m_nb_rois + 1)];
+
+    // odd sequence number while written
+    __sync_fetch_and_add(&m_seqs[slot], 1);
+    __sync_synchronize();
+    m_frame_nbs[slot] = frame_nb;
+    std::copy(sums, sums + m_nb_rois, record);
+    __sync_synchronize();
+    __sync_fetch_and_add(&m_seqs[slot], 1);
+
+    int last;
+    while ((last = m_last_frame_nb) < frame_nb &&
+           !__sync_bool_compare_and_swap(&m_last_frame_nb, last, frame_nb));
+}
+
+int RoiCounters::read(int first_frame, int nb_frames, std::vector<long long>& data) const {
+    int row_size = m_nb_rois + 1;
+    data.clear();
+
+    // only the last m_nb_records frames can be in the ring
+    int last = m_last_frame_nb;
+    int begin = std::max(std::max(first_frame, last - m_nb_records + 1), 0);
+    int end = std::min(first_frame + nb_frames, last + 1);
+    if (begin >= end)
+        return 0;
+    data.reserve(size_t(end - begin) * row_size);
+
+    int nb_read = 0;
+    for (int frame_nb = begin; frame_nb < end; frame_nb++) {
+        int slot = frame_nb % m_nb_records;
+        const volatile int *seq = &m_seqs[slot];
+        const long long *record = &m_sums[size_t(slot) * row_size];
+        // a record being written is read again, given up if rewritten meanwhile
+        for (int retry = 0; retry < 100; retry++) {
+            int seq_begin = *seq;
+            if (seq_begin & 1)
+                continue;
+            __sync_synchronize();
+            bool found = (m_frame_nbs[slot] == frame_nb);
+            size_t pos = data.size();
+            if (found) {
+                data.push_back(frame_nb);
+                data.insert(data.end(), record, record + m_nb_rois);
+            }
+            __sync_synchronize();
+            if (*seq == seq_begin) {
+                nb_read += found;
+                break;
+            }
+            data.resize(pos);
+        }
+    }
+    return nb_read;
+}
+
+int RoiCounters::getLastFrameNb() const {
+    return m_last_frame_nb;
+}
@@ -0,0 +1,39 @@
+/*
+ * XpadRoiCtrlObj.cpp
+ */
+
+#include "imXpadInterface.h"
+#include "imXpadCamera.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+RoiCtrlObj::RoiCtrlObj(Camera& cam) : m_cam(cam) {
+    DEB_CONSTRUCTOR();
+}
+
+RoiCtrlObj::~RoiCtrlObj() {
+    DEB_DESTRUCTOR();
+}
+
+void RoiCtrlObj::checkRoi(const Roi& set_roi, Roi& hw_roi) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(set_roi);
+
+    m_cam.checkRoi(set_roi, hw_roi);
+    DEB_RETURN() << DEB_VAR1(hw_roi);
+}
+
+void RoiCtrlObj::setRoi(const Roi& set_roi) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(set_roi);
+
+    m_cam.setRoi(set_roi);
+}
+
+void RoiCtrlObj::getRoi(Roi& hw_roi) {
+    DEB_MEMBER_FUNCT();
+
+    m_cam.getRoi(hw_roi);
+    DEB_RETURN() << DEB_VAR1(hw_roi);
+}
@@ -0,0 +1,151 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadSparseWriter.cpp
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sstream>
+#include <iomanip>
+#include "imXpadSparseWriter.h"
+#include "lima/Exceptions.h"
+
+using namespace std;
+using namespace lima;
+using namespace lima::imXpad;
+
+static const char SPARSE_MAGIC[8] = { 'X', 'P', 'A', 'D', 'S', 'P', 'R', 'S' };
+static const uint32_t SPARSE_VERSION = 1;
+static const size_t SPARSE_FILE_BUFFER = 1 << 20;
+
+SparseWriter::SparseWriter(int nb_ratios) :
+    m_acq_nb(0), m_file(NULL), m_dense_frame_bytes(0), m_dense_bytes(0), m_sparse_bytes(0),
+    m_ratio_frames(nb_ratios, -1), m_ratios(nb_ratios, 0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+SparseWriter::~SparseWriter() {
+    DEB_DESTRUCTOR();
+    close();
+}
+
+void SparseWriter::setFilePrefix(const std::string& prefix) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(prefix);
+
+    AutoMutex aLock(m_lock);
+    if (prefix != m_prefix)
+        m_acq_nb = 0;
+    m_prefix = prefix;
+}
+
+const std::string& SparseWriter::getFilePrefix() {
+    return m_prefix;
+}
+
+const std::string& SparseWriter::getFileName() {
+    return m_file_name;
+}
+
+void SparseWriter::open(const Size& frame_size, int pixel_bytes) {
+    DEB_MEMBER_FUNCT();
+
+    close();
+
+    AutoMutex aLock(m_lock);
+    if (m_prefix.empty())
+        THROW_HW_ERROR(Error) << "No sparse file prefix";
+
+    ostringstream name;
+    name << m_prefix << "_" << setfill('0') << setw(4) << m_acq_nb << ".sparse";
+    m_file_name = name.str();
+    m_file = fopen(m_file_name.c_str(), "wb");
+    if (!m_file)
+        THROW_HW_ERROR(Error) << "Cannot create " << m_file_name << ": " << strerror(errno);
+    ++m_acq_nb;
+    setvbuf(m_file, NULL, _IOFBF, SPARSE_FILE_BUFFER);
+
+    uint32_t header[4] = { SPARSE_VERSION, uint32_t(frame_size.getWidth()),
+                           uint32_t(frame_size.getHeight()), uint32_t(pixel_bytes) };
+    fwrite(SPARSE_MAGIC, sizeof(SPARSE_MAGIC), 1, m_file);
+    fwrite(header, sizeof(header), 1, m_file);
+
+    m_dense_frame_bytes = (long long) frame_size.getWidth() * frame_size.getHeight() * pixel_bytes;
+    m_dense_bytes = 0;
+    m_sparse_bytes = 0;
+    for (size_t i = 0; i < m_ratio_frames.size(); i++)
+        m_ratio_frames[i] = -1;
+    DEB_TRACE() << "Sparse events written to " << m_file_name;
+}
+
+void SparseWriter::close() {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_lock);
+    if (!m_file)
+        return;
+    if (fclose(m_file) != 0)
+        DEB_ERROR() << "Closing " << m_file_name << ": " << strerror(errno);
+    m_file = NULL;
+}
+
+void SparseWriter::write(int frame_nb, const std::vector<SparseEvent>& events) {
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_lock);
+    if (!m_file)
+        return;
+
+    int32_t frame_header[2] = { frame_nb, int32_t(events.size()) };
+    bool ok = (fwrite(frame_header, sizeof(frame_header), 1, m_file) == 1);
+    if (ok && !events.empty())
+        ok = (fwrite(&events[0], sizeof(SparseEvent), events.size(), m_file) == events.size());
+    if (!ok) {
+        // the acquisition goes on, the LIMA frames are not affected
+        DEB_ERROR() << "Writing " << m_file_name << ": " << strerror(errno) << ", sparse output stopped";
+        fclose(m_file);
+        m_file = NULL;
+        return;
+    }
+
+    long long sparse_bytes = sizeof(frame_header) + events.size() * sizeof(SparseEvent);
+    m_dense_bytes += m_dense_frame_bytes;
+    m_sparse_bytes += sparse_bytes;
+    int slot = frame_nb % m_ratio_frames.size();
+    m_ratio_frames[slot] = frame_nb;
+    m_ratios[slot] = float(m_dense_frame_bytes) / sparse_bytes;
+}
+
+double SparseWriter::getRatio(int frame_nb) {
+    AutoMutex aLock(m_lock);
+    if (frame_nb < 0)
+        return 0;
+    int slot = frame_nb % m_ratio_frames.size();
+    return (m_ratio_frames[slot] == frame_nb) ? m_ratios[slot] : 0;
+}
+
+double SparseWriter::getMeanRatio() {
+    AutoMutex aLock(m_lock);
+    return m_sparse_bytes ? double(m_dense_bytes) / m_sparse_bytes : 0;
+}
@@ -0,0 +1,150 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * imXpadSpillBuffer.cpp
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "imXpadSpillBuffer.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::imXpad;
+
+SpillBuffer::SpillBuffer() :
+    m_fd(-1), m_map(NULL), m_frame_size(0), m_nb_frames(0), m_head(0), m_depth(0)
+{
+    DEB_CONSTRUCTOR();
+}
+
+SpillBuffer::~SpillBuffer() {
+    DEB_DESTRUCTOR();
+    close();
+}
+
+void SpillBuffer::open(const std::string& file_name, size_t frame_size, int nb_frames) {
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR3(file_name, frame_size, nb_frames);
+
+    if (nb_frames < 1 || frame_size == 0)
+        THROW_HW_ERROR(InvalidValue) << "Invalid " << DEB_VAR2(frame_size, nb_frames);
+    if (m_map && file_name == m_file_name && frame_size == m_frame_size && nb_frames == m_nb_frames) {
+        clear();
+        return;
+    }
+    close();
+
+    size_t map_size = frame_size * nb_frames;
+    int fd = ::open(file_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        THROW_HW_ERROR(Error) << "Cannot open spill file " << file_name << ": " << strerror(errno);
+    if (ftruncate(fd, map_size) != 0) {
+        ::close(fd);
+        THROW_HW_ERROR(Error) << "Cannot size spill file " << file_name << " to " << map_size
+                              << " bytes: " << strerror(errno);
+    }
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        THROW_HW_ERROR(Error) << "Cannot map spill file " << file_name << ": " << strerror(errno);
+    }
+    // written and read back once, in order
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    m_file_name = file_name;
+    m_fd = fd;
+    m_map = (char *) map;
+    m_frame_size = frame_size;
+    m_nb_frames = nb_frames;
+    m_frame_nbs.assign(nb_frames, -1);
+    m_timestamps.assign(nb_frames, Timestamp());
+    clear();
+}
+
+void SpillBuffer::close() {
+    DEB_MEMBER_FUNCT();
+
+    if (!m_map)
+        return;
+    munmap(m_map, m_frame_size * m_nb_frames);
+    ::close(m_fd);
+    m_map = NULL;
+    m_fd = -1;
+    m_nb_frames = 0;
+    clear();
+}
+
+bool SpillBuffer::isOpen() const {
+    return m_map != NULL;
+}
+
+void SpillBuffer::clear() {
+    m_head = 0;
+    m_depth = 0;
+}
+
+bool SpillBuffer::empty() const {
+    return m_depth == 0;
+}
+
+bool SpillBuffer::full() const {
+    return m_depth == m_nb_frames;
+}
+
+int SpillBuffer::getDepth() const {
+    return m_depth;
+}
+
+int SpillBuffer::getNbFrames() const {
+    return m_nb_frames;
+}
+
+size_t SpillBuffer::getFrameSize() const {
+    return m_frame_size;
+}
+
+void *SpillBuffer::getWriteSlot() {
+    int slot = (m_head + m_depth) % m_nb_frames;
+    return m_map + slot * m_frame_size;
+}
+
+void SpillBuffer::push(int frame_nb, const Timestamp& timestamp) {
+    int slot = (m_head + m_depth) % m_nb_frames;
+    m_frame_nbs[slot] = frame_nb;
+    m_timestamps[slot] = timestamp;
+    ++m_depth;
+}
+
+void *SpillBuffer::front(int& frame_nb, Timestamp& timestamp) {
+    frame_nb = m_frame_nbs[m_head];
+    timestamp = m_timestamps[m_head];
+    return m_map + m_head * m_frame_size;
+}
+
+void SpillBuffer::pop() {
+    m_head = (m_head + 1) % m_nb_frames;
+    --m_depth;
+}
@@ -222,6 +222,51 @@ class imXPAD(PyTango.Device_4Impl):
         _imXPADCam.ITHLDecrease()
         self._ITHL_offset -= 1
     
+    def addSequenceEntry(self, values):
+        nb_frames = int(values[0])
+        exp_time = float(values[1])
+        lat_time = float(values[2])
+        trig_mode = _imXPADCam.getTrigMode()
+        _imXPADCam.addSequenceEntry(nb_frames, exp_time, lat_time, trig_mode)
+
+    def clearSequence(self):
+        _imXPADCam.clearSequence()
+
+    def loadWhiteImage(self, file_name):
+        _imXPADCam.loadWhiteImage(file_name)
+
+    def clearWhiteImageCache(self):
+        _imXPADCam.clearWhiteImageCache()
+
+    def loadDeadNoisyMask(self):
+        _imXPADCam.loadDeadNoisyMask()
+
+    def addRoiCounter(self, values):
+        x, y, width, height = [int(v) for v in values]
+        return _imXPADCam.addRoiCounter(Core.Roi(x, y, width, height))
+
+    def addMaskRoiCounter(self, values):
+        return _imXPADCam.addMaskRoiCounter([int(v) for v in values[1:]], int(values[0]))
+
+    def clearRoiCounters(self):
+        _imXPADCam.clearRoiCounters()
+
+    def readRoiCounters(self, values):
+        first_frame, nb_frames = [int(v) for v in values]
+        data = []
+        for row in _imXPADCam.readRoiCounters(first_frame, nb_frames):
+            data.extend(row)
+        return data
+
+    def getSparseCompressionRatio(self, frame_nb):
+        return _imXPADCam.getSparseCompressionRatio(frame_nb)
+
+    def getFrameStats(self, frame_nb):
+        stats = _imXPADCam.getFrameStats(frame_nb)
+        if stats is None:
+            return []
+        return list(stats[:5]) + list(stats[5])
+
     def askReady(self):
         print ("In askReady Command")
         val= _imXPADCam.askReady()
@@ -342,7 +387,19 @@ class imXPADClass(PyTango.DeviceClass):
          'ip port',[]],
         'config_path' :
         [PyTango.DevString,
-         "Config path",['/tmp']]
+         "Config path",['/tmp']],
+        'acq_thread_cpus' :
+        [PyTango.DevString,
+         "Cpus of the acquisition thread, as taskset -c",['']],
+        'ingest_thread_cpus' :
+        [PyTango.DevString,
+         "Cpus of the file ingest threads, as taskset -c",['']],
+        'acq_rt_priority' :
+        [PyTango.DevLong,
+         "SCHED_FIFO priority of the acquisition threads, 0 = normal",[0]],
+        'receive_busy_poll' :
+        [PyTango.DevLong,
+         "Socket busy poll of the frame reads (us), 0 = off",[0]]
         }
     
     
@@ -443,6 +500,50 @@ class imXPADClass(PyTango.DeviceClass):
         [[PyTango.DevVoid, "Decrement of one unit in the global ITHL register"],
          [PyTango.DevVoid,""]],
 
+        'addSequenceEntry':
+        [[PyTango.DevVarDoubleArray, "nb_frames, exp_time, lat_time (current trigger mode)"],
+         [PyTango.DevVoid,""]],
+
+        'clearSequence':
+        [[PyTango.DevVoid, "Remove all the acquisition sequence entries"],
+         [PyTango.DevVoid,""]],
+
+        'loadWhiteImage':
+        [[PyTango.DevString, "Server white image used by the client flat-field"],
+         [PyTango.DevVoid,""]],
+
+        'clearWhiteImageCache':
+        [[PyTango.DevVoid, "Forget the white images already read"],
+         [PyTango.DevVoid,""]],
+
+        'loadDeadNoisyMask':
+        [[PyTango.DevVoid, "Read the server dead/noisy pixel mask for the client masking"],
+         [PyTango.DevVoid,""]],
+
+        'addRoiCounter':
+        [[PyTango.DevVarLongArray, "x, y, width, height in the frames as received"],
+         [PyTango.DevLong,"Index of the roi counter"]],
+
+        'addMaskRoiCounter':
+        [[PyTango.DevVarLongArray, "Frame width, then the pixel indexes"],
+         [PyTango.DevLong,"Index of the roi counter"]],
+
+        'clearRoiCounters':
+        [[PyTango.DevVoid, "Remove all the roi counters"],
+         [PyTango.DevVoid,""]],
+
+        'readRoiCounters':
+        [[PyTango.DevVarLongArray, "First frame, nb. frames"],
+         [PyTango.DevVarLong64Array, "Per frame still in the ring: frame nb., then the roi sums"]],
+
+        'getSparseCompressionRatio':
+        [[PyTango.DevLong, "Frame number"],
+         [PyTango.DevDouble, "Dense size / sparse size, 0 = unknown"]],
+
+        'getFrameStats':
+        [[PyTango.DevLong, "Frame number"],
+         [PyTango.DevVarDoubleArray, "frame_nb, sum, min, max, nb_saturated, chip sums (empty if not in the ring)"]],
+
             }
 
     attr_list = {                  
@@ -490,6 +591,471 @@ class imXPADClass(PyTango.DeviceClass):
         [[PyTango.DevLong, 
          PyTango.SCALAR, 
          PyTango.READ_WRITE]],
+
+        "buffer_huge_pages":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "buffer_lock_memory":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "buffer_prefault":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "buffer_numa_node":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "buffer_shared_memory":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "buffer_prefault_time":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "first_frame_latency":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "arm_handshake":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "arm_latency":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "prearm":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "exposure_parameters_skipped":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "wire_16_bit":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "wire_pixel_depth":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "adaptive_pixel_depth":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "pixel_depth_promoted":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "acq_max_count":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "acq_overflow_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "acc_nb_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "acc_sliding":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "client_geometrical_correction":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "geometry_edge_width":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "geometry_module_gap":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "client_flat_field_correction":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "loaded_white_image":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "client_pixel_mask_mode":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "pixel_mask_sentinel":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "nb_masked_pixels":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "pile_up_correction":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "pile_up_dead_time":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "pile_up_scale":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "pile_up_time":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "bin_time":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "processing_threads":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "processing_time":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "live_max_frame_rate":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "live_frames_shown":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "live_frames_skipped":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "frame_publish_batch":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_publish_max_delay":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_statistics":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_stats_nb_records":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "saturation_level":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "last_frame_stats_nb":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "nb_roi_counters":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "roi_counters_nb_records":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "last_roi_counters_frame_nb":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "sparse_output":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "sparse_threshold":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "sparse_file_prefix":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "sparse_file_name":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "sparse_mean_compression_ratio":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "file_ingest_threads":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "file_ingest_window":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "file_ingest_window_occupancy":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "raw_output":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "raw_file_prefix":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "raw_file_size":
+        [[PyTango.DevLong64,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "raw_queue_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "raw_index_file_name":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "raw_frames_written":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "raw_frames_dropped":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "raw_max_queue_depth":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "raw_write_rate":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_output":
+        [[PyTango.DevBoolean,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "hdf5_file_prefix":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "hdf5_compress_threads":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "hdf5_queue_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "hdf5_file_name":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_frames_written":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_frames_dropped":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_max_queue_depth":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_compression_ratio":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_compress_rate":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_write_rate":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "hdf5_throughput":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "frame_ring":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_ring_nb_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_ring_published":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "spill_file":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "spill_nb_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "spill_depth":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "spill_max_depth":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "spilled_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "drained_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "discarded_frames":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "acq_thread_cpus":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "ingest_thread_cpus":
+        [[PyTango.DevString,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "acq_rt_priority":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "receive_busy_poll":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ_WRITE]],
+
+        "frame_interval_nb":
+        [[PyTango.DevLong,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "frame_interval_mean":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "frame_interval_std_dev":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
+
+        "frame_interval_max":
+        [[PyTango.DevDouble,
+         PyTango.SCALAR,
+         PyTango.READ]],
         }
 
     def __init__(self,name) :
@@ -501,8 +1067,23 @@ class imXPADClass(PyTango.DeviceClass):
 #----------------------------------------------------------------------------
 _imXPADCam = None
 _imXPADInterface = None
+_imXPADImageStatusCb = None
+
+class _ImageStatusCallback(Core.CtControl.ImageStatusCallback):
+    # frees the spill file: the plugin cannot see the LIMA buffers released
+    def __init__(self, control):
+        Core.CtControl.ImageStatusCallback.__init__(self)
+        self._control = control
+
+    def imageStatusChanged(self, img_status):
+        last_released = img_status.LastImageReady
+        if self._control.saving().getSavingMode() != Core.CtSaving.Manual:
+            last_released = min(last_released, img_status.LastImageSaved)
+        _imXPADCam.setLastFrameReleased(last_released)
 
-def get_control(cam_ip_address = "localhost",port=3456,**keys) :
+def get_control(cam_ip_address = "localhost",port=3456,
+                acq_thread_cpus="",ingest_thread_cpus="",
+                acq_rt_priority=0,receive_busy_poll=0,**keys) :
     print (cam_ip_address,port)
     global _imXPADCam
     global _imXPADInterface
@@ -511,7 +1092,16 @@ def get_control(cam_ip_address = "localhost",port=3456,**keys) :
     if _imXPADCam is None:
         _imXPADCam = XpadAcq.Camera(cam_ip_address,port)
         _imXPADInterface = XpadAcq.Interface(_imXPADCam)
-    return Core.CtControl(_imXPADInterface)
+        _imXPADCam.setAcqThreadCpus(acq_thread_cpus)
+        _imXPADCam.setIngestThreadCpus(ingest_thread_cpus)
+        _imXPADCam.setAcqRtPriority(int(acq_rt_priority))
+        _imXPADCam.setReceiveBusyPoll(int(receive_busy_poll))
+    global _imXPADImageStatusCb
+    control = Core.CtControl(_imXPADInterface)
+    _imXPADImageStatusCb = _ImageStatusCallback(control)
+    control.registerImageStatusCallback(_imXPADImageStatusCb)
+    _imXPADCam.setReleaseReporting(True)
+    return control
 
 def get_tango_specific_class_n_device():
     return imXPADClass,imXPAD
@@ -0,0 +1,224 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2013
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * Frames compressed by the ChunkCompressor and decoded the way the
+ * bitshuffle HDF5 filter does: LZ4 blocks, then bit planes back to the
+ * elements. Built once for the SSE2 baseline and once with -mavx2 (exit
+ * code 77, skipped, on a CPU without AVX2).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "imXpadChunkCompressor.h"
+
+using namespace std;
+using namespace lima::imXpad;
+
+static int nb_errors = 0;
+
+static uint32_t readUint32BE(const unsigned char *p)
+{
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+static uint64_t readUint64BE(const unsigned char *p)
+{
+    return uint64_t(readUint32BE(p)) << 32 | readUint32BE(p + 4);
+}
+
+// LZ4 block format, -1 if it does not decode to exactly size bytes
+static int lz4Decode(const unsigned char *src, size_t src_size, unsigned char *dst, size_t size)
+{
+    const unsigned char *ip = src, *iend = src + src_size;
+    size_t op = 0;
+    while (ip < iend) {
+        int token = *ip++;
+        size_t len = token >> 4;
+        if (len == 15) {
+            int b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                len += b = *ip++;
+            } while (b == 255);
+        }
+        if (len > size_t(iend - ip) || len > size - op)
+            return -1;
+        memcpy(dst + op, ip, len);
+        ip += len;
+        op += len;
+        // the last sequence has literals only
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return -1;
+        len = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            int b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                len += b = *ip++;
+            } while (b == 255);
+        }
+        if (len > size - op)
+            return -1;
+        // overlapping copy
+        for (size_t i = 0; i < len; i++, op++)
+            dst[op] = dst[op - offset];
+    }
+    return (op == size) ? 0 : -1;
+}
+
+// bit row 8 * b + k holds the bit k of the byte b of each element
+static void bitUnshuffle(const unsigned char *bits, size_t nb_elems, int elem_size, unsigned char *out)
+{
+    size_t row_size = nb_elems / 8;
+    memset(out, 0, nb_elems * elem_size);
+    for (int b = 0; b < elem_size; b++)
+        for (int k = 0; k < 8; k++) {
+            const unsigned char *row = bits + (8 * b + k) * row_size;
+            for (size_t e = 0; e < nb_elems; e++)
+                if (row[e / 8] >> (e % 8) & 1)
+                    out[e * elem_size + b] |= 1 << k;
+        }
+}
+
+static bool decodeChunk(const vector<unsigned char>& chunk, size_t nb_elems, int elem_size,
+                        vector<unsigned char>& out)
+{
+    const unsigned char *p = &chunk[0], *end = p + chunk.size();
+    if (chunk.size() < 12 || readUint64BE(p) != uint64_t(nb_elems) * elem_size)
+        return false;
+    size_t block_size = readUint32BE(p + 8) / elem_size;
+    if (block_size != ChunkCompressor::getBlockSize(elem_size))
+        return false;
+    p += 12;
+
+    out.resize(nb_elems * elem_size + 1);
+    vector<unsigned char> bits(block_size * elem_size);
+    size_t i = 0;
+    while (nb_elems - i >= 8) {
+        size_t n = std::min(block_size, (nb_elems - i) / 8 * 8);
+        if (end - p < 4)
+            return false;
+        size_t size = readUint32BE(p);
+        p += 4;
+        if (size > size_t(end - p) || lz4Decode(p, size, &bits[0], n * elem_size) < 0)
+            return false;
+        p += size;
+        bitUnshuffle(&bits[0], n, elem_size, &out[i * elem_size]);
+        i += n;
+    }
+    // the last elements as they are
+    size_t leftover = (nb_elems - i) * elem_size;
+    if (size_t(end - p) != leftover)
+        return false;
+    memcpy(&out[i * elem_size], p, leftover);
+    return true;
+}
+
+// pixel counts: mostly low, some zero, some large
+static vector<unsigned char> sampleFrame(size_t nb_elems, int elem_size)
+{
+    vector<unsigned char> frame(nb_elems * elem_size + 1);
+    for (size_t e = 0; e < nb_elems; e++) {
+        uint64_t v = rand() % 8;
+        if (rand() % 16 == 0)
+            v = 0;
+        else if (rand() % 64 == 0)
+            v = uint64_t(rand()) << 16 | rand();
+        for (int b = 0; b < elem_size; b++)
+            frame[e * elem_size + b] = v >> (8 * b);
+    }
+    return frame;
+}
+
+static void testChunk(ChunkCompressor& compressor, size_t nb_elems, int elem_size)
+{
+    vector<unsigned char> frame = sampleFrame(nb_elems, elem_size);
+    vector<unsigned char> chunk(ChunkCompressor::getMaxChunkSize(nb_elems, elem_size));
+    size_t size = compressor.compress(&frame[0], nb_elems, elem_size, &chunk[0]);
+    if (size > chunk.size()) {
+        printf("n=%zu elem=%d: chunk of %zu bytes, max. %zu\n", nb_elems, elem_size,
+               size, chunk.size());
+        ++nb_errors;
+        return;
+    }
+    chunk.resize(size);
+
+    vector<unsigned char> out;
+    if (!decodeChunk(chunk, nb_elems, elem_size, out)) {
+        printf("n=%zu elem=%d: chunk of %zu bytes not decoded\n", nb_elems, elem_size, size);
+        ++nb_errors;
+    } else if (memcmp(&out[0], &frame[0], nb_elems * elem_size) != 0) {
+        printf("n=%zu elem=%d: decoded frame differs\n", nb_elems, elem_size);
+        ++nb_errors;
+    }
+}
+
+int main()
+{
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 not supported by the CPU, skipped\n");
+        return 77;
+    }
+    printf("AVX2 bitshuffle\n");
+#elif defined(__SSE2__)
+    printf("SSE2 bitshuffle\n");
+#else
+    printf("scalar bitshuffle\n");
+#endif
+
+    srand(1);
+    ChunkCompressor compressor;
+    const int elem_sizes[] = {1, 2, 4, 8};
+    for (int j = 0; j < 4; j++) {
+        int elem_size = elem_sizes[j];
+        size_t block_size = ChunkCompressor::getBlockSize(elem_size);
+        // leftovers only, partial last blocks, element counts not a
+        // multiple of 8, whole blocks
+        for (size_t n = 0; n <= 70; n++)
+            testChunk(compressor, n, elem_size);
+        testChunk(compressor, block_size, elem_size);
+        testChunk(compressor, block_size + 5, elem_size);
+        testChunk(compressor, 3 * block_size + 8 * 21 + 7, elem_size);
+        // the rows of a module
+        testChunk(compressor, 1120 * 80 + 3, elem_size);
+    }
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2013
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * Frame statistics (sum, min, max, saturated pixels, chip sums) and sparse
+ * events compared with their scalar versions, on chip and row widths with
+ * and without a scalar tail. Built once for the SSE2 baseline and once
+ * with -mavx2 (exit code 77, skipped, on a CPU without AVX2).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "imXpadFrameStats.h"
+
+using namespace std;
+using namespace lima;
+using namespace lima::imXpad;
+
+static int nb_errors = 0;
+
+static void error(const char *what, const Size& size, long long value, long long expected)
+{
+    printf("%s, %dx%d: %lld, expected %lld\n", what, size.getWidth(), size.getHeight(),
+           value, expected);
+    ++nb_errors;
+}
+
+// pixel counts, some at the saturation level or around the 32 bit limits
+static vector<int32_t> randomFrame(size_t n, int32_t sat)
+{
+    vector<int32_t> frame(n);
+    for (size_t i = 0; i < n; i++) {
+        switch (rand() % 16) {
+        case 0: frame[i] = sat; break;
+        case 1: frame[i] = sat - 1; break;
+        case 2: frame[i] = INT32_MAX - rand() % 4; break;
+        case 3: frame[i] = INT32_MIN + rand() % 4; break;
+        default: frame[i] = rand() % 2000 - 500;
+        }
+    }
+    return frame;
+}
+
+static void testFrame(const Size& size, const Size& chip_size)
+{
+    const int32_t sat = 1000, threshold = 900;
+    int width = size.getWidth(), height = size.getHeight();
+    vector<int32_t> frame = randomFrame(size_t(width) * height, sat);
+
+    FrameStatsCalc calc;
+    calc.setChipSize(chip_size);
+    calc.setSaturation(sat);
+    calc.setSparseEvents(true);
+    calc.setSparseThreshold(threshold);
+    FrameStats stats;
+    stats.reset(0);
+    vector<int16_t> out16(frame.size() + 1, 0x5555);
+    calc.add(stats, &frame[0], size, &out16[0]);
+
+    long long sum = 0;
+    int32_t min = INT32_MAX, max = INT32_MIN;
+    int nb_sat = 0;
+    bool tiled = width % chip_size.getWidth() == 0 && height % chip_size.getHeight() == 0;
+    int nb_chip_columns = width / chip_size.getWidth();
+    vector<long long> chip_sums;
+    if (tiled)
+        chip_sums.assign(size_t(nb_chip_columns) * (height / chip_size.getHeight()), 0);
+    vector<SparseEvent> events;
+    for (int row = 0; row < height; row++)
+        for (int col = 0; col < width; col++) {
+            int32_t v = frame[size_t(row) * width + col];
+            sum += v;
+            min = std::min(min, v);
+            max = std::max(max, v);
+            nb_sat += (v >= sat);
+            if (tiled)
+                chip_sums[size_t(row / chip_size.getHeight()) * nb_chip_columns +
+                          col / chip_size.getWidth()] += v;
+            if (v > threshold) {
+                SparseEvent event = { uint32_t(row * width + col), v };
+                events.push_back(event);
+            }
+        }
+
+    if (stats.sum != sum)
+        error("sum", size, stats.sum, sum);
+    if (stats.min != min)
+        error("min", size, stats.min, min);
+    if (stats.max != max)
+        error("max", size, stats.max, max);
+    if (stats.nb_saturated != nb_sat)
+        error("saturated", size, stats.nb_saturated, nb_sat);
+    if (stats.chip_sums.size() != chip_sums.size())
+        error("chip sums", size, stats.chip_sums.size(), chip_sums.size());
+    else
+        for (size_t i = 0; i < chip_sums.size(); i++)
+            if (stats.chip_sums[i] != chip_sums[i]) {
+                error("chip sum", size, stats.chip_sums[i], chip_sums[i]);
+                break;
+            }
+    if (stats.events.size() != events.size())
+        error("events", size, stats.events.size(), events.size());
+    else
+        for (size_t i = 0; i < events.size(); i++)
+            if (stats.events[i].index != events[i].index || stats.events[i].count != events[i].count) {
+                error("event index", size, stats.events[i].index, events[i].index);
+                break;
+            }
+    for (size_t i = 0; i < frame.size(); i++)
+        if (out16[i] != int16_t(frame[i])) {
+            error("out16", size, out16[i], int16_t(frame[i]));
+            break;
+        }
+    if (out16[frame.size()] != 0x5555)
+        error("out16 end", size, out16[frame.size()], 0x5555);
+}
+
+int main()
+{
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 not supported by the CPU, skipped\n");
+        return 77;
+    }
+    printf("AVX2 statistics\n");
+#elif defined(__SSE2__)
+    printf("SSE2 statistics\n");
+#else
+    printf("scalar statistics\n");
+#endif
+
+    srand(1);
+    // all the remainders of the 8 pixel blocks, as chips and as rows
+    for (int w = 1; w <= 24; w++) {
+        testFrame(Size(w, 3), Size(w, 1));
+        testFrame(Size(3 * w, 2), Size(w, 2));
+        testFrame(Size(w + 1, 3), Size(w, 1));
+    }
+    // a module, chips of 80x120
+    testFrame(Size(1120, 120), Size(80, 120));
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
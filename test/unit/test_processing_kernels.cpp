@@ -0,0 +1,180 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2013
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * Processing kernels compared with their scalar versions, on sizes with
+ * and without a scalar tail. Built once for the SSE2 baseline and once
+ * with -mavx2 (exit code 77, skipped, on a CPU without AVX2).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "imXpadProcessingKernels.h"
+
+using namespace std;
+
+static int nb_errors = 0;
+
+template <class T>
+static void check(const char *kernel, size_t n, const vector<T>& out, const vector<T>& ref)
+{
+    for (size_t i = 0; i < n; i++)
+        if (out[i] != ref[i]) {
+            printf("%s, n=%zu: element %zu is %g, expected %g\n", kernel, n, i,
+                   double(out[i]), double(ref[i]));
+            ++nb_errors;
+            return;
+        }
+}
+
+// pixel counts, some of them out of the 16 bit range
+static vector<int32_t> randomFrame(size_t n, int32_t min, int32_t max)
+{
+    vector<int32_t> frame(n);
+    for (size_t i = 0; i < n; i++)
+        frame[i] = min + int32_t(rand() % (int64_t(max) - min + 1));
+    return frame;
+}
+
+static vector<float> randomCoef(size_t n, float min, float max)
+{
+    vector<float> coef(n);
+    for (size_t i = 0; i < n; i++)
+        coef[i] = min + (max - min) * (rand() / float(RAND_MAX));
+    return coef;
+}
+
+static void testFrameKernels(size_t n)
+{
+    vector<int32_t> src = randomFrame(n, -40000, 70000);
+    vector<int32_t> src2 = randomFrame(n, -1000, 1000);
+    vector<float> coef = randomCoef(n, 0.5f, 1.5f);
+    vector<float> k = randomCoef(n, 0.f, 2e-5f);
+
+    // addFrame
+    vector<int32_t> out(src), ref(src);
+    addFrame(&out[0], &src2[0], n);
+    for (size_t i = 0; i < n; i++)
+        ref[i] += src2[i];
+    check("addFrame", n, out, ref);
+
+    // convertFrame16, with the max.
+    vector<int16_t> out16(n + 1), ref16(n + 1);
+    int32_t max = 0, ref_max = INT32_MIN;
+    convertFrame16(&out16[0], &src[0], n, &max);
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = src[i];
+        ref_max = std::max(ref_max, v);
+        ref16[i] = (v > INT16_MAX)? INT16_MAX: (v < INT16_MIN)? INT16_MIN: v;
+    }
+    check("convertFrame16", n, out16, ref16);
+    if (max != ref_max) {
+        printf("convertFrame16, n=%zu: max. is %d, expected %d\n", n, max, ref_max);
+        ++nb_errors;
+    }
+
+    // flatFrame, rounded to nearest
+    flatFrame(&out[0], &src[0], &coef[0], n);
+    for (size_t i = 0; i < n; i++)
+        ref[i] = lrintf(src[i] * coef[i]);
+    check("flatFrame", n, out, ref);
+
+    // pileUpFrame, including denominators below the limit
+    pileUpFrame(&out[0], &src[0], &k[0], 0.5f, n);
+    for (size_t i = 0; i < n; i++) {
+        float c = src[i];
+        float d = 1.0f - c * k[i];
+        if (d < PILEUP_MIN_DENOMINATOR)
+            d = PILEUP_MIN_DENOMINATOR;
+        ref[i] = lrintf(c * 0.5f / d);
+    }
+    check("pileUpFrame", n, out, ref);
+}
+
+static void testBinKernels(size_t n)
+{
+    for (int bin_x = 2; bin_x <= 4; bin_x += 2) {
+        vector<int32_t> src = randomFrame(n * bin_x, -100000, 100000);
+        vector<int32_t> dst = randomFrame(n, -100000, 100000);
+        for (int add = 0; add < 2; add++) {
+            vector<int32_t> out(dst), ref(dst);
+            if (bin_x == 2)
+                binRow2(&out[0], &src[0], n, add);
+            else
+                binRow4(&out[0], &src[0], n, add);
+            for (size_t i = 0; i < n; i++) {
+                int32_t sum = add ? ref[i] : 0;
+                for (int j = 0; j < bin_x; j++)
+                    sum += src[i * bin_x + j];
+                ref[i] = sum;
+            }
+            check((bin_x == 2)? "binRow2": "binRow4", n, out, ref);
+        }
+    }
+}
+
+static void testGatherRow(size_t n)
+{
+    // -1 indexes give 0
+    vector<int32_t> src = randomFrame(2 * n + 1, -100000, 100000);
+    vector<int32_t> idx = randomFrame(n, -1, 2 * n);
+    vector<int32_t> out(n), ref(n);
+    gatherRow(&out[0], &src[0], &idx[0], n);
+    for (size_t i = 0; i < n; i++)
+        ref[i] = (idx[i] >= 0) ? src[idx[i]] : 0;
+    check("gatherRow", n, out, ref);
+}
+
+int main()
+{
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 not supported by the CPU, skipped\n");
+        return 77;
+    }
+    printf("AVX2 kernels\n");
+#elif defined(__SSE2__)
+    printf("SSE2 kernels\n");
+#else
+    printf("scalar kernels\n");
+#endif
+
+    srand(1);
+    // all the remainders of the 16 pixel blocks, then frames and rows
+    // of the detector size
+    for (size_t n = 1; n <= 40; n++) {
+        testFrameKernels(n);
+        testBinKernels(n);
+        testGatherRow(n);
+    }
+    testFrameKernels(1120 * 80 + 3);
+    testBinKernels(560 + 3);
+    testGatherRow(1120 + 3);
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,235 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2013
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+/*
+ * Roi sums (rectangles and masks) compared with their scalar versions, on
+ * spans with and without a scalar tail, then the ring of the sums: wrap
+ * around, and records read while a thread rewrites them (seqlock). Built
+ * once for the SSE2 baseline and once with -mavx2 (exit code 77, skipped,
+ * on a CPU without AVX2).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+#include "imXpadRoiCounters.h"
+
+using namespace std;
+using namespace lima;
+using namespace lima::imXpad;
+
+static int nb_errors = 0;
+
+static void testSums(int width, int height)
+{
+    vector<int32_t> frame(size_t(width) * height);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (rand() % 8 == 0) ? INT32_MAX - rand() % 4 : rand() % 2000 - 1000;
+
+    // rectangles of every width up to the frame one, a mask of random pixels
+    RoiCounters counters;
+    vector<Roi> rois;
+    for (int w = 1; w <= width && int(rois.size()) < RoiCounters::MaxNbRois - 1; w += 1 + w / 8) {
+        int x = rand() % (width - w + 1);
+        int y = rand() % height;
+        rois.push_back(Roi(x, y, w, 1 + rand() % (height - y)));
+        counters.addRoi(rois.back());
+    }
+    vector<int32_t> mask;
+    for (size_t i = 0; i < frame.size(); i++)
+        if (rand() % 3)
+            mask.push_back(i);
+    counters.addMaskRoi(mask, width);
+
+    vector<long long> sums(counters.getNbRois(), 0);
+    for (int row = 0; row < height; row++)
+        counters.addRow(row, &frame[size_t(row) * width], width, &sums[0]);
+
+    for (size_t r = 0; r < rois.size(); r++) {
+        long long sum = 0;
+        Point top_left = rois[r].getTopLeft();
+        Size size = rois[r].getSize();
+        for (int y = top_left.y; y < top_left.y + size.getHeight(); y++)
+            for (int x = top_left.x; x < top_left.x + size.getWidth(); x++)
+                sum += frame[size_t(y) * width + x];
+        if (sums[r] != sum) {
+            printf("roi %zu of %dx%d: %lld, expected %lld\n", r, width, height, sums[r], sum);
+            ++nb_errors;
+        }
+    }
+    long long sum = 0;
+    for (size_t i = 0; i < mask.size(); i++)
+        sum += frame[mask[i]];
+    if (sums.back() != sum) {
+        printf("mask roi of %dx%d: %lld, expected %lld\n", width, height, sums.back(), sum);
+        ++nb_errors;
+    }
+}
+
+// the sums of frame_nb: frame_nb * (roi + 1)
+static void frameSums(int frame_nb, int nb_rois, vector<long long>& sums)
+{
+    sums.resize(nb_rois);
+    for (int roi = 0; roi < nb_rois; roi++)
+        sums[roi] = (long long) frame_nb * (roi + 1);
+}
+
+static bool checkRecords(const vector<long long>& data, int nb_rois, int first, int nb_frames)
+{
+    if (data.size() != size_t(nb_frames) * (nb_rois + 1))
+        return false;
+    for (int i = 0; i < nb_frames; i++) {
+        const long long *record = &data[size_t(i) * (nb_rois + 1)];
+        if (record[0] != first + i)
+            return false;
+        for (int roi = 0; roi < nb_rois; roi++)
+            if (record[roi + 1] != (long long) record[0] * (roi + 1))
+                return false;
+    }
+    return true;
+}
+
+static void testRing()
+{
+    RoiCounters counters(8);
+    counters.addRoi(Roi(0, 0, 4, 4));
+    counters.addRoi(Roi(2, 2, 4, 4));
+    int nb_rois = counters.getNbRois();
+
+    vector<long long> sums, data;
+    for (int frame_nb = 0; frame_nb < 21; frame_nb++) {
+        frameSums(frame_nb, nb_rois, sums);
+        counters.put(frame_nb, &sums[0]);
+    }
+
+    // frames 13 to 20 left in the ring of 8 records
+    int nb = counters.read(0, 100, data);
+    if (nb != 8 || !checkRecords(data, nb_rois, 13, 8)) {
+        printf("ring: %d frames read, expected 13 to 20\n", nb);
+        ++nb_errors;
+    }
+    nb = counters.read(10, 5, data);
+    if (nb != 2 || !checkRecords(data, nb_rois, 13, 2)) {
+        printf("ring: %d frames read of 10 to 14, expected 13 and 14\n", nb);
+        ++nb_errors;
+    }
+    nb = counters.read(21, 5, data);
+    if (nb != 0 || !data.empty()) {
+        printf("ring: %d frames read after the last one\n", nb);
+        ++nb_errors;
+    }
+    if (counters.getLastFrameNb() != 20) {
+        printf("ring: last frame %d, expected 20\n", counters.getLastFrameNb());
+        ++nb_errors;
+    }
+}
+
+struct Writer {
+    RoiCounters *counters;
+    int nb_frames;
+    volatile bool done;
+};
+
+static void *writeFrames(void *arg)
+{
+    Writer *writer = (Writer *) arg;
+    int nb_rois = writer->counters->getNbRois();
+    vector<long long> sums;
+    for (int frame_nb = 0; frame_nb < writer->nb_frames; frame_nb++) {
+        frameSums(frame_nb, nb_rois, sums);
+        writer->counters->put(frame_nb, &sums[0]);
+    }
+    writer->done = true;
+    return NULL;
+}
+
+// records rewritten while read: a record is returned whole or not at all
+static void testConcurrentRead()
+{
+    RoiCounters counters(4);
+    for (int roi = 0; roi < RoiCounters::MaxNbRois; roi++)
+        counters.addRoi(Roi(0, 0, 1, 1));
+    int nb_rois = counters.getNbRois();
+
+    Writer writer = { &counters, 2000000, false };
+    pthread_t thread;
+    pthread_create(&thread, NULL, writeFrames, &writer);
+    vector<long long> data;
+    long long nb_reads = 0, nb_records = 0;
+    while (!writer.done) {
+        int last = counters.getLastFrameNb();
+        int nb = counters.read(last - 3, 4, data);
+        ++nb_reads;
+        nb_records += nb;
+        if (data.size() != size_t(nb) * (nb_rois + 1)) {
+            printf("concurrent read: %zu values for %d frames\n", data.size(), nb);
+            ++nb_errors;
+            break;
+        }
+        for (int i = 0; i < nb; i++) {
+            const long long *record = &data[size_t(i) * (nb_rois + 1)];
+            for (int roi = 0; roi < nb_rois; roi++)
+                if (record[roi + 1] != record[0] * (roi + 1)) {
+                    printf("concurrent read: frame %lld, roi %d is %lld, torn record\n",
+                           record[0], roi, record[roi + 1]);
+                    ++nb_errors;
+                    i = nb;
+                    break;
+                }
+        }
+        if (nb_errors)
+            break;
+    }
+    pthread_join(thread, NULL);
+    printf("%lld reads, %lld records\n", nb_reads, nb_records);
+}
+
+int main()
+{
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 not supported by the CPU, skipped\n");
+        return 77;
+    }
+    printf("AVX2 roi sums\n");
+#elif defined(__SSE2__)
+    printf("SSE2 roi sums\n");
+#else
+    printf("scalar roi sums\n");
+#endif
+
+    srand(1);
+    // all the remainders of the 8 pixel blocks, then a module
+    for (int width = 1; width <= 40; width++)
+        testSums(width, 3);
+    testSums(1120, 120);
+    testRing();
+    testConcurrentRead();
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}